@@ -54,6 +54,12 @@ and get deterministic behaviour.
 
 #include <wx/defs.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || \
+   (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
 //////////////////////////////////////////////////////////////////////////
 
 // Constants for the noise shaping buffer
@@ -78,6 +84,55 @@ static inline float DITHER_NOISE()
     return rand() / (float)RAND_MAX - 0.5f;
 }
 
+// Dither implementations
+
+// No dither, just return sample
+static inline float NoDither(State &, float sample)
+{
+    return sample;
+}
+
+// Rectangle dithering, apply one-step noise
+static inline float RectangleDither(State &, float sample)
+{
+    return sample - DITHER_NOISE();
+}
+
+// Triangle dither - high pass filtered
+static inline float TriangleDither(State &state, float sample)
+{
+    float r = DITHER_NOISE();
+    float result = sample + r - state.mTriangleState;
+    state.mTriangleState = r;
+
+    return result;
+}
+
+// Shaped dither
+static inline float ShapedDither(State &state, float sample)
+{
+    // Generate triangular dither, +-1 LSB, flat psd
+    float r = DITHER_NOISE() + DITHER_NOISE();
+    if(sample != sample)  // test for NaN
+       sample = 0; // and do the best we can with it
+
+    // Run FIR
+    float xe = sample + state.mBuffer[state.mPhase] * SHAPED_BS[0]
+        + state.mBuffer[(state.mPhase - 1) & BUF_MASK] * SHAPED_BS[1]
+        + state.mBuffer[(state.mPhase - 2) & BUF_MASK] * SHAPED_BS[2]
+        + state.mBuffer[(state.mPhase - 3) & BUF_MASK] * SHAPED_BS[3]
+        + state.mBuffer[(state.mPhase - 4) & BUF_MASK] * SHAPED_BS[4];
+
+    // Accumulate FIR and triangular noise
+    float result = xe + r;
+
+    // Roll buffer and store last error
+    state.mPhase = (state.mPhase + 1) & BUF_MASK;
+    state.mBuffer[state.mPhase] = xe - lrintf(result);
+
+    return result;
+}
+
 // Defines for sample conversion
 constexpr auto CONVERT_DIV16 = float(1<<15);
 constexpr auto CONVERT_DIV24 = float(1<<23);
@@ -120,8 +175,8 @@ static inline void IMPLEMENT_STORE(
 }
 
 // Dither single float 'sample' and store it in pointer 'dst', using 'dither' as algorithm
-static inline void DITHER_TO_INT16(Ditherer dither, State &state,
-   short *dst, float sample)
+template<Ditherer dither>
+static inline void DITHER_TO_INT16(State &state, short *dst, float sample)
 {
     IMPLEMENT_STORE<short>(dst,
         dither(state, sample * CONVERT_DIV16),
@@ -129,8 +184,8 @@ static inline void DITHER_TO_INT16(Ditherer dither, State &state,
 }
 
 // Dither single float 'sample' and store it in pointer 'dst', using 'dither' as algorithm
-static inline void DITHER_TO_INT24(Ditherer dither, State &state,
-   int *dst, float sample)
+template<Ditherer dither>
+static inline void DITHER_TO_INT24(State &state, int *dst, float sample)
 {
     IMPLEMENT_STORE<int>(dst,
         dither(state, sample * CONVERT_DIV24), -8388608, 8388607);
@@ -138,51 +193,203 @@ static inline void DITHER_TO_INT24(Ditherer dither, State &state,
 
 // Implement one single dither step
 
-// Implement a dithering loop
-template<typename srcType, typename dstType>
-static inline void DITHER_LOOP( Ditherer dither, State &state,
-    void (*store)(Ditherer, State &, dstType *, float),
-    float (*load)(const srcType *),
-    samplePtr dst, sampleFormat dstFormat, size_t dstStride,
-    constSamplePtr src, sampleFormat srcFormat, size_t srcStride, size_t len)
+// Implement a dithering loop.  The functions are template arguments, not
+// pointers, so that the compiler can inline them into the loop
+template<typename srcType, typename dstType,
+    void (*store)(State &, dstType *, float),
+    float (*load)(const srcType *)>
+static inline void DITHER_LOOP(State &state,
+    samplePtr dst, size_t dstStride,
+    constSamplePtr src, size_t srcStride, size_t len)
 {
-    char *d;
-    const char *s;
-    unsigned int ii;
-    for (d = (char*)dst, s = (char*)src, ii = 0;
-        ii < len;
-        ii++, d += SAMPLE_SIZE(dstFormat) * dstStride,
-        s += SAMPLE_SIZE(srcFormat) * srcStride) {
-            store(dither, state, reinterpret_cast<dstType *>(d), load(reinterpret_cast<const srcType *>(s)));
-        }
+    auto d = reinterpret_cast<dstType *>(dst);
+    auto s = reinterpret_cast<const srcType *>(src);
+    for (size_t ii = 0; ii < len; ++ii, d += dstStride, s += srcStride)
+        store(state, d, load(s));
 }
 
 // Implement a dither. There are only 3 cases where we must dither,
 // in all other cases, no dithering is necessary.
-static inline void DITHER( Ditherer dither, State &state,
+template<Ditherer dither>
+static inline void DITHER(State &state,
    samplePtr dst, sampleFormat dstFormat, size_t dstStride,
    constSamplePtr src, sampleFormat srcFormat, size_t srcStride, size_t len)
 {
     if (srcFormat == int24Sample && dstFormat == int16Sample)
-        DITHER_LOOP<int, short>(dither, state,
-            DITHER_TO_INT16, FROM_INT24, dst,
-            int16Sample, dstStride, src, int24Sample, srcStride, len);
+        DITHER_LOOP<int, short, DITHER_TO_INT16<dither>, FROM_INT24>(
+            state, dst, dstStride, src, srcStride, len);
     else if (srcFormat == floatSample && dstFormat == int16Sample)
-        DITHER_LOOP<float, short>(dither, state,
-            DITHER_TO_INT16, FROM_FLOAT, dst,
-            int16Sample, dstStride, src, floatSample, srcStride, len);
+        DITHER_LOOP<float, short, DITHER_TO_INT16<dither>, FROM_FLOAT>(
+            state, dst, dstStride, src, srcStride, len);
     else if (srcFormat == floatSample && dstFormat == int24Sample)
-        DITHER_LOOP<float, int>(dither, state,
-            DITHER_TO_INT24, FROM_FLOAT, dst,
-            int24Sample, dstStride, src, floatSample, srcStride, len);
+        DITHER_LOOP<float, int, DITHER_TO_INT24<dither>, FROM_FLOAT>(
+            state, dst, dstStride, src, srcStride, len);
     else { wxASSERT(false); }
 }
 
+// Vectorized loops over contiguous samples, for the conversions that need
+// no random numbers.  Each returns how many leading samples it converted,
+// exactly as the scalar code would; the caller converts the rest.
+#ifdef USE_SSE2
+static size_t ConvertInt16ToFloat(const short *src, float *dst, size_t len)
+{
+    const auto scale = _mm_set1_ps(1.0f / CONVERT_DIV16);
+    size_t ii = 0;
+    for (; ii + 8 <= len; ii += 8) {
+        const auto x = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(src + ii));
+        // Sign extend to 32 bits, by shifting the 16 bits to the top
+        const auto low = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        const auto high = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        // Division by a power of two is exact, so multiplying by the
+        // reciprocal gives the same
+        _mm_storeu_ps(dst + ii, _mm_mul_ps(_mm_cvtepi32_ps(low), scale));
+        _mm_storeu_ps(dst + ii + 4,
+            _mm_mul_ps(_mm_cvtepi32_ps(high), scale));
+    }
+    return ii;
+}
+
+static size_t ConvertInt24ToFloat(const int *src, float *dst, size_t len)
+{
+    const auto scale = _mm_set1_ps(1.0f / CONVERT_DIV24);
+    size_t ii = 0;
+    for (; ii + 4 <= len; ii += 4) {
+        const auto x = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(src + ii));
+        _mm_storeu_ps(dst + ii, _mm_mul_ps(_mm_cvtepi32_ps(x), scale));
+    }
+    return ii;
+}
+
+static size_t ConvertInt16ToInt24(const short *src, int *dst, size_t len)
+{
+    size_t ii = 0;
+    for (; ii + 8 <= len; ii += 8) {
+        const auto x = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(src + ii));
+        // Sign extend and shift left by 8 at once, from the top 16 bits
+        const auto zero = _mm_setzero_si128();
+        const auto low = _mm_srai_epi32(_mm_unpacklo_epi16(zero, x), 8);
+        const auto high = _mm_srai_epi32(_mm_unpackhi_epi16(zero, x), 8);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + ii), low);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + ii + 4), high);
+    }
+    return ii;
+}
+
+//! FROM_FLOAT for four samples; NaN must have been excluded
+static inline __m128 ClipFloats(__m128 x)
+{
+    return _mm_max_ps(_mm_set1_ps(-1.0f), _mm_min_ps(_mm_set1_ps(1.0f), x));
+}
+
+//! lrintf and the clipping of IMPLEMENT_STORE to 24 bits, for four samples
+static inline __m128i RoundToInt24(__m128 x)
+{
+    // Conversion rounds as lrintf does, in the current rounding mode
+    const auto rounded = _mm_cvtps_epi32(x);
+    const auto maxBound = _mm_set1_epi32(8388607);
+    const auto minBound = _mm_set1_epi32(-8388608);
+    const auto over = _mm_cmpgt_epi32(rounded, maxBound);
+    const auto under = _mm_cmplt_epi32(rounded, minBound);
+    const auto inRange = _mm_andnot_si128(_mm_or_si128(over, under), rounded);
+    return _mm_or_si128(inRange, _mm_or_si128(
+        _mm_and_si128(over, maxBound), _mm_and_si128(under, minBound)));
+}
+
+//! Whether any of four samples is NaN, which lrintf converts differently on
+//! different platforms; the scalar code must handle those
+static inline bool AnyNaN(__m128 x)
+{
+    return _mm_movemask_ps(_mm_cmpunord_ps(x, x)) != 0;
+}
+
+static size_t ConvertFloatToInt16(const float *src, short *dst, size_t len)
+{
+    const auto scale = _mm_set1_ps(CONVERT_DIV16);
+    size_t ii = 0;
+    for (; ii + 8 <= len; ii += 8) {
+        const auto x0 = _mm_loadu_ps(src + ii);
+        const auto x1 = _mm_loadu_ps(src + ii + 4);
+        if (AnyNaN(_mm_add_ps(x0, x1)))
+            break;
+        // Packing saturates as IMPLEMENT_STORE clips
+        const auto result = _mm_packs_epi32(
+            _mm_cvtps_epi32(_mm_mul_ps(ClipFloats(x0), scale)),
+            _mm_cvtps_epi32(_mm_mul_ps(ClipFloats(x1), scale)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + ii), result);
+    }
+    return ii;
+}
+
+static size_t ConvertFloatToInt24(const float *src, int *dst, size_t len)
+{
+    const auto scale = _mm_set1_ps(CONVERT_DIV24);
+    size_t ii = 0;
+    for (; ii + 4 <= len; ii += 4) {
+        const auto x = _mm_loadu_ps(src + ii);
+        if (AnyNaN(x))
+            break;
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + ii),
+            RoundToInt24(_mm_mul_ps(ClipFloats(x), scale)));
+    }
+    return ii;
+}
+
+static size_t ConvertInt24ToInt16(const int *src, short *dst, size_t len)
+{
+    const auto fromScale = _mm_set1_ps(1.0f / CONVERT_DIV24);
+    const auto toScale = _mm_set1_ps(CONVERT_DIV16);
+    size_t ii = 0;
+    for (; ii + 8 <= len; ii += 8) {
+        const auto x0 = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(src + ii));
+        const auto x1 = _mm_loadu_si128(
+            reinterpret_cast<const __m128i *>(src + ii + 4));
+        // The same two exact scalings as FROM_INT24 and DITHER_TO_INT16
+        const auto result = _mm_packs_epi32(
+            _mm_cvtps_epi32(_mm_mul_ps(
+                _mm_mul_ps(_mm_cvtepi32_ps(x0), fromScale), toScale)),
+            _mm_cvtps_epi32(_mm_mul_ps(
+                _mm_mul_ps(_mm_cvtepi32_ps(x1), fromScale), toScale)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + ii), result);
+    }
+    return ii;
+}
+#else
+static size_t ConvertInt16ToFloat(const short *, float *, size_t)
+{ return 0; }
+static size_t ConvertInt24ToFloat(const int *, float *, size_t)
+{ return 0; }
+static size_t ConvertInt16ToInt24(const short *, int *, size_t)
+{ return 0; }
+static size_t ConvertFloatToInt16(const float *, short *, size_t)
+{ return 0; }
+static size_t ConvertFloatToInt24(const float *, int *, size_t)
+{ return 0; }
+static size_t ConvertInt24ToInt16(const int *, short *, size_t)
+{ return 0; }
+#endif
+
+// The vectorized conversion without dither, for the same three cases as
+// DITHER
+static size_t ConvertWithoutDither(
+   samplePtr dst, sampleFormat dstFormat,
+   constSamplePtr src, sampleFormat srcFormat, size_t len)
+{
+    if (srcFormat == int24Sample && dstFormat == int16Sample)
+        return ConvertInt24ToInt16(reinterpret_cast<const int *>(src),
+            reinterpret_cast<short *>(dst), len);
+    else if (srcFormat == floatSample && dstFormat == int16Sample)
+        return ConvertFloatToInt16(reinterpret_cast<const float *>(src),
+            reinterpret_cast<short *>(dst), len);
+    else if (srcFormat == floatSample && dstFormat == int24Sample)
+        return ConvertFloatToInt24(reinterpret_cast<const float *>(src),
+            reinterpret_cast<int *>(dst), len);
+    return 0;
+}
 
-static inline float NoDither(State &, float sample);
-static inline float RectangleDither(State &, float sample);
-static inline float TriangleDither(State &state, float sample);
-static inline float ShapedDither(State &state, float sample);
 
 Dither::Dither()
 {
@@ -236,6 +443,8 @@ void Dither::Apply(enum DitherType ditherType,
     if (len == 0)
         return; // nothing to do
 
+    const bool contiguous = (sourceStride == 1 && destStride == 1);
+
     if (destFormat == sourceFormat)
     {
         // No need to dither, because source and destination
@@ -281,13 +490,15 @@ void Dither::Apply(enum DitherType ditherType,
         if (sourceFormat == int16Sample)
         {
             auto s = (const short*)source;
-            for (i = 0; i < len; i++, d += destStride, s += sourceStride)
+            i = contiguous ? ConvertInt16ToFloat(s, d, len) : 0;
+            for (d += i, s += i; i < len; i++, d += destStride, s += sourceStride)
                 *d = FROM_INT16(s);
         } else
         if (sourceFormat == int24Sample)
         {
             auto s = (const int*)source;
-            for (i = 0; i < len; i++, d += destStride, s += sourceStride)
+            i = contiguous ? ConvertInt24ToFloat(s, d, len) : 0;
+            for (d += i, s += i; i < len; i++, d += destStride, s += sourceStride)
                 *d = FROM_INT24(s);
         } else {
             wxASSERT(false); // source format unknown
@@ -298,7 +509,8 @@ void Dither::Apply(enum DitherType ditherType,
         // Special case when promoting 16 bit to 24 bit
         auto d = (int*)dest;
         auto s = (const short*)source;
-        for (i = 0; i < len; i++, d += destStride, s += sourceStride)
+        i = contiguous ? ConvertInt16ToInt24(s, d, len) : 0;
+        for (d += i, s += i; i < len; i++, d += destStride, s += sourceStride)
             *d = ((int)*s) << 8;
     } else
     {
@@ -306,18 +518,27 @@ void Dither::Apply(enum DitherType ditherType,
         switch (ditherType)
         {
         case DitherType::none:
-            DITHER(NoDither, mState, dest, destFormat, destStride, source, sourceFormat, sourceStride, len);
+        {
+            // Without noise, samples convert independently of each other
+            i = contiguous
+                ? ConvertWithoutDither(dest, destFormat, source, sourceFormat, len)
+                : 0;
+            DITHER<NoDither>(mState,
+                dest + i * SAMPLE_SIZE(destFormat), destFormat, destStride,
+                source + i * SAMPLE_SIZE(sourceFormat), sourceFormat, sourceStride,
+                len - i);
             break;
+        }
         case DitherType::rectangle:
-            DITHER(RectangleDither, mState, dest, destFormat, destStride, source, sourceFormat, sourceStride, len);
+            DITHER<RectangleDither>(mState, dest, destFormat, destStride, source, sourceFormat, sourceStride, len);
             break;
         case DitherType::triangle:
             Reset(); // reset dither filter for this NEW conversion
-            DITHER(TriangleDither, mState, dest, destFormat, destStride, source, sourceFormat, sourceStride, len);
+            DITHER<TriangleDither>(mState, dest, destFormat, destStride, source, sourceFormat, sourceStride, len);
             break;
         case DitherType::shaped:
             Reset(); // reset dither filter for this NEW conversion
-            DITHER(ShapedDither, mState, dest, destFormat, destStride, source, sourceFormat, sourceStride, len);
+            DITHER<ShapedDither>(mState, dest, destFormat, destStride, source, sourceFormat, sourceStride, len);
             break;
         default:
             wxASSERT(false); // unknown dither algorithm
@@ -325,55 +546,6 @@ void Dither::Apply(enum DitherType ditherType,
     }
 }
 
-// Dither implementations
-
-// No dither, just return sample
-inline float NoDither(State &, float sample)
-{
-    return sample;
-}
-
-// Rectangle dithering, apply one-step noise
-inline float RectangleDither(State &, float sample)
-{
-    return sample - DITHER_NOISE();
-}
-
-// Triangle dither - high pass filtered
-inline float TriangleDither(State &state, float sample)
-{
-    float r = DITHER_NOISE();
-    float result = sample + r - state.mTriangleState;
-    state.mTriangleState = r;
-
-    return result;
-}
-
-// Shaped dither
-inline float ShapedDither(State &state, float sample)
-{
-    // Generate triangular dither, +-1 LSB, flat psd
-    float r = DITHER_NOISE() + DITHER_NOISE();
-    if(sample != sample)  // test for NaN
-       sample = 0; // and do the best we can with it
-
-    // Run FIR
-    float xe = sample + state.mBuffer[state.mPhase] * SHAPED_BS[0]
-        + state.mBuffer[(state.mPhase - 1) & BUF_MASK] * SHAPED_BS[1]
-        + state.mBuffer[(state.mPhase - 2) & BUF_MASK] * SHAPED_BS[2]
-        + state.mBuffer[(state.mPhase - 3) & BUF_MASK] * SHAPED_BS[3]
-        + state.mBuffer[(state.mPhase - 4) & BUF_MASK] * SHAPED_BS[4];
-
-    // Accumulate FIR and triangular noise
-    float result = xe + r;
-
-    // Roll buffer and store last error
-    state.mPhase = (state.mPhase + 1) & BUF_MASK;
-    state.mBuffer[state.mPhase] = xe - lrintf(result);
-
-    return result;
-}
-
 static const std::initializer_list<EnumValueSymbol> choicesDither{
    { XO("None") },
    { XO("Rectangle") },
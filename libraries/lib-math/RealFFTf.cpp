@@ -38,12 +38,16 @@
 
 #include "RealFFTf.h"
 
-#include <vector>
+#include <mutex>
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
 
-#include <wx/thread.h>
+#if defined(__SSE2__) || defined(_M_X64) || \
+   (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
 
 #ifndef M_PI
 #define	M_PI		3.14159265358979323846  /* pi */
@@ -94,51 +98,48 @@ HFFT InitializeFFT(size_t fftlen)
    return h;
 }
 
-enum : size_t { MAX_HFFT = 10 };
+// Table of plans, indexed by the base two logarithm of the length; plans
+// are made when first requested, then kept until exit
+enum : size_t { MAX_HFFT = 8 * sizeof(size_t) };
+static std::unique_ptr<FFTParam> hFFTArray[MAX_HFFT];
+static std::mutex getFFTMutex;
 
-// Maintain a pool:
-static std::vector< std::unique_ptr<FFTParam> > hFFTArray(MAX_HFFT);
-wxCriticalSection getFFTMutex;
+//! Index into hFFTArray for a length, or MAX_HFFT if it has none
+static size_t PlanIndex(size_t fftlen)
+{
+   if (fftlen < 2 || (fftlen & (fftlen - 1)))
+      return MAX_HFFT;
+   size_t h = 0;
+   while ((size_t(1) << h) != fftlen)
+      ++h;
+   return h;
+}
 
 /* Get a handle to the FFT tables of the desired length */
 /* This version keeps common tables rather than allocating a NEW table every time */
 HFFT GetFFT(size_t fftlen)
 {
-   // To do:  smarter policy about when to retain in the pool and when to
-   // allocate a unique instance.
-
-   wxCriticalSectionLocker locker{ getFFTMutex };
-   
-   size_t h = 0;
-   auto n = fftlen/2;
-   auto size = hFFTArray.size();
-   for(;
-       (h < size) && hFFTArray[h] && (n != hFFTArray[h]->Points);
-       h++)
-      ;
-   if(h < size) {
-      if(hFFTArray[h] == NULL) {
-         hFFTArray[h].reset( InitializeFFT(fftlen).release() );
-      }
-      return HFFT{ hFFTArray[h].get() };
-   } else {
-      // All buffers used, so fall back to allocating a NEW set of tables
+   const auto h = PlanIndex(fftlen);
+   if (h == MAX_HFFT)
+      // Not a power of two, so nothing to share
       return InitializeFFT(fftlen);
-   }
+
+   std::lock_guard<std::mutex> locker{ getFFTMutex };
+   if (!hFFTArray[h])
+      hFFTArray[h].reset(InitializeFFT(fftlen).release());
+   return HFFT{ hFFTArray[h].get() };
 }
 
 /* Release a previously requested handle to the FFT tables */
 void FFTDeleter::operator() (FFTParam *hFFT) const
 {
-   wxCriticalSectionLocker locker{ getFFTMutex };
-
-   auto it = hFFTArray.begin(), end = hFFTArray.end();
-   while (it != end && it->get() != hFFT)
-      ++it;
-   if ( it != end )
-      ;
-   else
-      delete hFFT;
+   const auto h = PlanIndex(hFFT->Points * 2);
+   if (h < MAX_HFFT) {
+      std::lock_guard<std::mutex> locker{ getFFTMutex };
+      if (hFFTArray[h].get() == hFFT)
+         return;
+   }
+   delete hFFT;
 }
 
 /*
@@ -191,6 +192,26 @@ void RealFFTf(fft_type *buffer, const FFTParam *h)
          sin = *sptr;
          cos = *(sptr+1);
          endptr2 = B;
+#ifdef USE_SSE2
+         if (ButterfliesPerGroup >= 2)
+         {
+            // Two butterflies at once, with the operations of the loop below
+            // in each lane, so that the results are the same bit for bit:
+            // lanes of v hold v1 and -v2
+            const auto c = _mm_set1_ps(cos);
+            const auto s = _mm_setr_ps(sin, -sin, sin, -sin);
+            const auto two = _mm_set1_ps(2);
+            for (; A < endptr2; A += 4, B += 4)
+            {
+               const auto b = _mm_loadu_ps(B);
+               const auto bSwapped = _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 3, 0, 1));
+               const auto v = _mm_add_ps(_mm_mul_ps(b, c), _mm_mul_ps(bSwapped, s));
+               const auto bOut = _mm_add_ps(_mm_loadu_ps(A), v);
+               _mm_storeu_ps(B, bOut);
+               _mm_storeu_ps(A, _mm_sub_ps(bOut, _mm_mul_ps(two, v)));
+            }
+         }
+#endif
          while(A < endptr2)
          {
             v1 = *B * cos + *(B + 1) * sin;
@@ -328,6 +349,24 @@ void InverseRealFFTf(fft_type *buffer, const FFTParam *h)
          sin = *(sptr++);
          cos = *(sptr++);
          endptr2 = B;
+#ifdef USE_SSE2
+         if (ButterfliesPerGroup >= 2)
+         {
+            // As in RealFFTf; here the lanes of v hold v1 and v2
+            const auto c = _mm_set1_ps(cos);
+            const auto s = _mm_setr_ps(-sin, sin, -sin, sin);
+            const auto half = _mm_set1_ps(0.5f);
+            for (; A < endptr2; A += 4, B += 4)
+            {
+               const auto b = _mm_loadu_ps(B);
+               const auto bSwapped = _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 3, 0, 1));
+               const auto v = _mm_add_ps(_mm_mul_ps(b, c), _mm_mul_ps(bSwapped, s));
+               const auto bOut = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(A), v), half);
+               _mm_storeu_ps(B, bOut);
+               _mm_storeu_ps(A, _mm_sub_ps(bOut, v));
+            }
+         }
+#endif
          while(A < endptr2)
          {
             v1 = *B * cos - *(B + 1) * sin;
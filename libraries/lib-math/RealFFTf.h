@@ -21,7 +21,11 @@ using HFFT = std::unique_ptr<
    FFTParam, FFTDeleter
 >;
 
+//! Tables for transforms of the given length; those of each power of two are
+//! made once and shared, so that this is cheap to call again
 MATH_API HFFT GetFFT(size_t);
+//! The transforms are vectorized where the processor allows, giving the same
+//! results bit for bit as the plain loops
 MATH_API void RealFFTf(fft_type *, const FFTParam *);
 MATH_API void InverseRealFFTf(fft_type *, const FFTParam *);
 MATH_API void ReorderToTime(const FFTParam *hFFT, const fft_type *buffer, fft_type *TimeOut);
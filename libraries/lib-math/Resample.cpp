@@ -32,6 +32,17 @@
 Resample::Resample(const bool useBestMethod, const double dMinFactor, const double dMaxFactor)
 {
    this->SetMethod(useBestMethod);
+   Create(dMinFactor, dMaxFactor);
+}
+
+Resample::Resample(int method, double dMinFactor, double dMaxFactor)
+   : mMethod{ method }
+{
+   Create(dMinFactor, dMaxFactor);
+}
+
+void Resample::Create(double dMinFactor, double dMaxFactor)
+{
    soxr_quality_spec_t q_spec;
    if (dMinFactor == dMaxFactor)
    {
@@ -101,7 +112,12 @@ std::pair<size_t, size_t>
    }
    else
    {
-      soxr_set_io_ratio(mHandle.get(), 1/factor, 0);
+      // Setting the ratio makes soxr recompute its step; don't repeat that
+      // while the factor stays the same
+      if (factor != mLastFactor) {
+         soxr_set_io_ratio(mHandle.get(), 1/factor, 0);
+         mLastFactor = factor;
+      }
 
       inBufferLen = lastFlag? ~inBufferLen : inBufferLen;
       soxr_process(mHandle.get(),
@@ -37,6 +37,9 @@ class MATH_API Resample final
    // dMinFactor and dMaxFactor specify the range of factors for variable-rate resampling.
    // For constant-rate, pass the same value for both.
    Resample(const bool useBestMethod, const double dMinFactor, const double dMaxFactor);
+   //! Use the given method, one of the values of FastMethodSetting and
+   //! BestMethodSetting, rather than the preference
+   Resample(int method, double dMinFactor, double dMaxFactor);
    ~Resample();
 
    static EnumSetting< int > FastMethodSetting;
@@ -74,11 +77,14 @@ class MATH_API Resample final
 
  protected:
    void SetMethod(const bool useBestMethod);
+   void Create(double dMinFactor, double dMaxFactor);
 
  protected:
    int   mMethod; // resampler-specific enum for resampling method
    soxrHandle mHandle; // constant-rate or variable-rate resampler (XOR per instance)
    bool mbWantConstRateResampling;
+   //! Factor last given to the variable-rate resampler
+   double mLastFactor{ 0 };
 };
 
 #endif // __AUDACITY_RESAMPLE_H__
@@ -0,0 +1,394 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  @file SampleCodec.cpp
+  @brief Registry of SampleCodec and the built-in predictive codec
+
+**********************************************************************/
+
+#include "SampleCodec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+
+namespace {
+
+using Codecs = std::map<SampleCodec::ID, std::unique_ptr<SampleCodec>>;
+Codecs &GetCodecs()
+{
+   static Codecs codecs;
+   return codecs;
+}
+
+//! Accumulates bits, least significant first, into bytes
+class BitWriter
+{
+public:
+   explicit BitWriter(std::vector<char> &dest) : mDest{ dest } {}
+
+   //! @pre n <= 32
+   void Put(uint64_t bits, unsigned n)
+   {
+      mBuffer |= (bits & ((uint64_t{ 1 } << n) - 1)) << mCount;
+      mCount += n;
+      while (mCount >= 8) {
+         mDest.push_back(static_cast<char>(mBuffer & 0xFF));
+         mBuffer >>= 8;
+         mCount -= 8;
+      }
+   }
+
+   //! Write n one bits and a zero
+   //! @pre n < 32
+   void PutUnary(unsigned n) { Put((uint64_t{ 1 } << n) - 1, n + 1); }
+
+   void Flush()
+   {
+      if (mCount)
+         mDest.push_back(static_cast<char>(mBuffer & 0xFF));
+      mBuffer = 0;
+      mCount = 0;
+   }
+
+private:
+   std::vector<char> &mDest;
+   uint64_t mBuffer{ 0 };
+   unsigned mCount{ 0 };
+};
+
+//! Reads what BitWriter wrote, remembering any attempt to read past the end
+class BitReader
+{
+public:
+   BitReader(const unsigned char *begin, const unsigned char *end)
+      : mPos{ begin }, mEnd{ end }
+   {}
+
+   //! @pre n <= 32
+   uint64_t Get(unsigned n)
+   {
+      if (mCount < n) {
+         Fill();
+         if (mCount < n) {
+            mOverrun = true;
+            return 0;
+         }
+      }
+      const auto result = mBuffer & ((uint64_t{ 1 } << n) - 1);
+      mBuffer >>= n;
+      mCount -= n;
+      return result;
+   }
+
+   //! Count one bits up to a zero, which is consumed, or up to limit ones
+   unsigned GetUnary(unsigned limit)
+   {
+      unsigned n = 0;
+      while (n < limit) {
+         if (mCount == 0) {
+            Fill();
+            if (mCount == 0) {
+               mOverrun = true;
+               break;
+            }
+         }
+         const bool one = mBuffer & 1;
+         mBuffer >>= 1;
+         --mCount;
+         if (!one)
+            break;
+         ++n;
+      }
+      return n;
+   }
+
+   bool Overrun() const { return mOverrun; }
+
+private:
+   void Fill()
+   {
+      while (mCount <= 56 && mPos != mEnd) {
+         mBuffer |= uint64_t{ *mPos++ } << mCount;
+         mCount += 8;
+      }
+   }
+
+   const unsigned char *mPos, *const mEnd;
+   uint64_t mBuffer{ 0 };
+   unsigned mCount{ 0 };
+   bool mOverrun{ false };
+};
+
+//! Order preserving bijection of float bit patterns onto 32 bit integers,
+//! so that nearby values of either sign have nearby images
+int32_t FloatToOrderedInt(float value)
+{
+   uint32_t bits;
+   memcpy(&bits, &value, sizeof(bits));
+   const uint32_t key = (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+   return static_cast<int32_t>(key ^ 0x80000000u);
+}
+
+float OrderedIntToFloat(int32_t value)
+{
+   const uint32_t key = static_cast<uint32_t>(value) ^ 0x80000000u;
+   const uint32_t bits = (key & 0x80000000u) ? (key & 0x7FFFFFFFu) : ~key;
+   float result;
+   memcpy(&result, &bits, sizeof(result));
+   return result;
+}
+
+//! Fixed second order linear prediction, as in FLAC's "fixed" subframes,
+//! with Rice coding of residuals and a Rice parameter for each partition
+class PredictiveCodec final : public SampleCodec
+{
+public:
+   PredictiveCodec() : SampleCodec{ Predictive, "predictive" } {}
+
+   bool Encode(constSamplePtr src, sampleFormat format,
+      size_t count, std::vector<char> &dest) const override;
+   bool Decode(const void *src, size_t bytes,
+      samplePtr dest, sampleFormat format, size_t count) const override;
+
+private:
+   //! How samples map to the integers that are predicted
+   enum Mode : unsigned char {
+      Integers,   //!< int16Sample or int24Sample as they are
+      Scaled16,   //!< floats that are exact multiples of 2^-15 in [-1, 1)
+      Scaled24,   //!< floats that are exact multiples of 2^-23 in [-1, 1)
+      FloatBits,  //!< any other floats, by FloatToOrderedInt()
+   };
+
+   //! Samples sharing one Rice parameter
+   static constexpr size_t PartitionSize = 256;
+   //! Quotients this large are escaped, and the residual follows in full
+   static constexpr unsigned EscapeQuotient = 24;
+   static constexpr unsigned EscapeBits = 40;
+   static constexpr unsigned ParameterBits = 5;
+
+   static bool IsScaled(const float *samples, size_t count, float scale);
+};
+
+bool PredictiveCodec::IsScaled(const float *samples, size_t count, float scale)
+{
+   for (size_t ii = 0; ii < count; ++ii) {
+      const auto value = samples[ii];
+      // Multiplication by a power of two is exact
+      const auto scaled = value * scale;
+      // Fails for NaN too
+      if (!(scaled >= -scale && scaled < scale))
+         return false;
+      const auto integer = static_cast<int32_t>(scaled);
+      if (static_cast<float>(integer) != scaled ||
+          (integer == 0 && std::signbit(value)))
+         return false;
+   }
+   return true;
+}
+
+bool PredictiveCodec::Encode(constSamplePtr src, sampleFormat format,
+   size_t count, std::vector<char> &dest) const
+{
+   const auto rawBytes = count * SAMPLE_SIZE(format);
+   if (count == 0 || count > UINT32_MAX)
+      return false;
+
+   Mode mode = Integers;
+   float scale = 1.0f;
+   const auto floats = reinterpret_cast<const float *>(src);
+   if (format == floatSample) {
+      if (IsScaled(floats, count, 32768.0f))
+         mode = Scaled16, scale = 32768.0f;
+      else if (IsScaled(floats, count, 8388608.0f))
+         mode = Scaled24, scale = 8388608.0f;
+      else
+         mode = FloatBits;
+   }
+
+   auto sample = [&](size_t ii) -> int64_t {
+      switch (mode) {
+      case Integers:
+         if (format == int16Sample)
+            return reinterpret_cast<const short *>(src)[ii];
+         return reinterpret_cast<const int *>(src)[ii];
+      case Scaled16:
+      case Scaled24:
+         return static_cast<int32_t>(floats[ii] * scale);
+      default:
+         return FloatToOrderedInt(floats[ii]);
+      }
+   };
+
+   dest.clear();
+   dest.reserve(rawBytes);
+   PutHeader(dest, count);
+   dest.push_back(static_cast<char>(mode));
+
+   BitWriter writer{ dest };
+   uint64_t residuals[PartitionSize];
+   int64_t x1 = 0, x2 = 0;
+   for (size_t first = 0; first < count; first += PartitionSize) {
+      const auto n = std::min(PartitionSize, count - first);
+      uint64_t sum = 0;
+      for (size_t ii = 0; ii < n; ++ii) {
+         const auto x = sample(first + ii);
+         const auto r = x - (2 * x1 - x2);
+         x2 = x1, x1 = x;
+         // Zigzag, so that small residuals of either sign are small
+         const auto u = (static_cast<uint64_t>(r) << 1) ^
+            static_cast<uint64_t>(r >> 63);
+         residuals[ii] = u;
+         sum += u;
+      }
+
+      // Rice parameter near the log of the mean
+      unsigned k = 0;
+      while (k < 31 && (static_cast<uint64_t>(n) << (k + 1)) <= sum)
+         ++k;
+      writer.Put(k, ParameterBits);
+
+      for (size_t ii = 0; ii < n; ++ii) {
+         const auto u = residuals[ii];
+         const auto q = u >> k;
+         if (q < EscapeQuotient) {
+            writer.PutUnary(static_cast<unsigned>(q));
+            writer.Put(u, k);
+         }
+         else {
+            writer.Put((uint64_t{ 1 } << EscapeQuotient) - 1, EscapeQuotient);
+            writer.Put(u, 32);
+            writer.Put(u >> 32, EscapeBits - 32);
+         }
+      }
+
+      // Give up as soon as it is clear there is no gain
+      if (dest.size() >= rawBytes)
+         return false;
+   }
+   writer.Flush();
+
+   return dest.size() < rawBytes;
+}
+
+bool PredictiveCodec::Decode(const void *src, size_t bytes,
+   samplePtr dest, sampleFormat format, size_t count) const
+{
+   if (GetEncodedCount(src, bytes) != count || bytes < HeaderSize + 1)
+      return false;
+
+   const auto begin = static_cast<const unsigned char *>(src);
+   const auto mode = static_cast<Mode>(begin[HeaderSize]);
+   if (mode > FloatBits || (format == floatSample) == (mode == Integers))
+      return false;
+   const float scale = (mode == Scaled16) ? 32768.0f : 8388608.0f;
+
+   int64_t lowest, highest;
+   switch (mode) {
+   case Integers:
+      if (format == int16Sample)
+         lowest = -32768, highest = 32767;
+      else
+         lowest = -8388608, highest = 8388607;
+      break;
+   case Scaled16:
+   case Scaled24:
+      lowest = -static_cast<int64_t>(scale), highest = scale - 1;
+      break;
+   default:
+      lowest = INT32_MIN, highest = INT32_MAX;
+      break;
+   }
+
+   BitReader reader{ begin + HeaderSize + 1, begin + bytes };
+   int64_t x1 = 0, x2 = 0;
+   for (size_t first = 0; first < count; first += PartitionSize) {
+      const auto n = std::min(PartitionSize, count - first);
+      const auto k = static_cast<unsigned>(reader.Get(ParameterBits));
+      for (size_t ii = first, end = first + n; ii < end; ++ii) {
+         const auto q = reader.GetUnary(EscapeQuotient);
+         uint64_t u;
+         if (q < EscapeQuotient)
+            u = (uint64_t{ q } << k) | reader.Get(k);
+         else {
+            u = reader.Get(32);
+            u |= reader.Get(EscapeBits - 32) << 32;
+         }
+         const auto r = static_cast<int64_t>(u >> 1) ^ -static_cast<int64_t>(u & 1);
+         const auto x = r + (2 * x1 - x2);
+         if (x < lowest || x > highest || reader.Overrun())
+            return false;
+         x2 = x1, x1 = x;
+
+         switch (mode) {
+         case Integers:
+            if (format == int16Sample)
+               reinterpret_cast<short *>(dest)[ii] = static_cast<short>(x);
+            else
+               reinterpret_cast<int *>(dest)[ii] = static_cast<int>(x);
+            break;
+         case Scaled16:
+         case Scaled24:
+            reinterpret_cast<float *>(dest)[ii] = static_cast<float>(x) / scale;
+            break;
+         default:
+            reinterpret_cast<float *>(dest)[ii] =
+               OrderedIntToFloat(static_cast<int32_t>(x));
+            break;
+         }
+      }
+   }
+   return true;
+}
+
+SampleCodec::Registration sPredictive{ std::make_unique<PredictiveCodec>() };
+
+}
+
+SampleCodec::Registration::Registration(std::unique_ptr<SampleCodec> pCodec)
+{
+   if (pCodec && pCodec->GetID() != None) {
+      const auto id = pCodec->GetID();
+      GetCodecs()[id] = std::move(pCodec);
+   }
+}
+
+const SampleCodec *SampleCodec::Find(ID id)
+{
+   auto &codecs = GetCodecs();
+   auto iter = codecs.find(id);
+   return iter == codecs.end() ? nullptr : iter->second.get();
+}
+
+std::vector<const SampleCodec *> SampleCodec::All()
+{
+   std::vector<const SampleCodec *> result;
+   for (auto &pair : GetCodecs())
+      result.push_back(pair.second.get());
+   return result;
+}
+
+size_t SampleCodec::GetEncodedCount(const void *src, size_t bytes)
+{
+   if (!src || bytes < HeaderSize)
+      return 0;
+   const auto p = static_cast<const unsigned char *>(src);
+   return size_t{ p[0] } | size_t{ p[1] } << 8 |
+      size_t{ p[2] } << 16 | size_t{ p[3] } << 24;
+}
+
+SampleCodec::SampleCodec(ID id, std::string name)
+   : mID{ id }, mName{ std::move(name) }
+{
+}
+
+SampleCodec::~SampleCodec() = default;
+
+void SampleCodec::PutHeader(std::vector<char> &dest, size_t count)
+{
+   for (unsigned ii = 0; ii < HeaderSize; ++ii)
+      dest.push_back(static_cast<char>((count >> (8 * ii)) & 0xFF));
+}
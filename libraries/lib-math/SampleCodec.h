@@ -0,0 +1,91 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  @file SampleCodec.h
+  @brief Lossless encodings of blocks of samples for storage
+
+**********************************************************************/
+
+#ifndef __AUDACITY_SAMPLE_CODEC__
+#define __AUDACITY_SAMPLE_CODEC__
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "SampleFormat.h"
+
+//! Abstract base class for lossless encodings of blocks of samples
+/*!
+ Every encoding begins with the number of samples, as four little endian
+ bytes, so that it can be found without decoding the rest.
+
+ Codecs are looked up by an identifier that is stored with each encoded
+ block, so those values persist in saved project files, and must not be
+ changed or reused in later program versions.
+ */
+class MATH_API SampleCodec
+{
+public:
+   using ID = unsigned char;
+
+   //! Identifier of the absence of encoding; no codec is registered with it
+   static constexpr ID None = 0;
+
+   //! Identifier of the built-in codec, which uses fixed second order
+   //! prediction and Rice coding of the residuals
+   static constexpr ID Predictive = 1;
+
+   //! Number of bytes of the header common to all encodings
+   static constexpr size_t HeaderSize = 4;
+
+   //! Make a codec available for lookup by its identifier
+   struct MATH_API Registration final {
+      explicit Registration(std::unique_ptr<SampleCodec> pCodec);
+   };
+
+   //! @return the codec registered with the identifier, or null
+   static const SampleCodec *Find(ID id);
+
+   //! @return all registered codecs, in increasing order of identifier
+   static std::vector<const SampleCodec *> All();
+
+   //! @return the count of samples in an encoding, or 0 if the header is
+   //! incomplete
+   static size_t GetEncodedCount(const void *src, size_t bytes);
+
+   SampleCodec(ID id, std::string name);
+   SampleCodec(const SampleCodec&) = delete;
+   SampleCodec &operator=(const SampleCodec&) = delete;
+   virtual ~SampleCodec();
+
+   ID GetID() const { return mID; }
+   //! A short name, not translated, for diagnostic output
+   const std::string &GetName() const { return mName; }
+
+   //! Encode samples, replacing the contents of dest
+   /*!
+    @return false, leaving dest unspecified, if the encoding would not be
+    smaller than the samples
+    */
+   virtual bool Encode(constSamplePtr src, sampleFormat format,
+      size_t count, std::vector<char> &dest) const = 0;
+
+   //! Decode exactly count samples, which must equal GetEncodedCount()
+   /*!
+    @return false if the encoding is malformed, leaving dest unspecified
+    */
+   virtual bool Decode(const void *src, size_t bytes,
+      samplePtr dest, sampleFormat format, size_t count) const = 0;
+
+protected:
+   //! Append the common header
+   static void PutHeader(std::vector<char> &dest, size_t count);
+
+private:
+   const ID mID;
+   const std::string mName;
+};
+
+#endif
@@ -0,0 +1,123 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  @file VectorOps.cpp
+
+**********************************************************************/
+
+#include "VectorOps.h"
+
+#include <algorithm>
+#include <cfloat>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+   (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define USE_SSE2
+#include <emmintrin.h>
+#endif
+
+void MultiplyByGains(float *dst, const double *gains, size_t len)
+{
+   size_t i = 0;
+#ifdef USE_SSE2
+   // Conversions between float and double are exact, or round to nearest,
+   // as in the scalar code
+   for (; i + 4 <= len; i += 4) {
+      const auto samples = _mm_loadu_ps(dst + i);
+      const auto low = _mm_mul_pd(
+         _mm_cvtps_pd(samples), _mm_loadu_pd(gains + i));
+      const auto high = _mm_mul_pd(
+         _mm_cvtps_pd(_mm_movehl_ps(samples, samples)),
+         _mm_loadu_pd(gains + i + 2));
+      _mm_storeu_ps(dst + i,
+         _mm_movelh_ps(_mm_cvtpd_ps(low), _mm_cvtpd_ps(high)));
+   }
+#endif
+   for (; i < len; ++i)
+      dst[i] *= gains[i];
+}
+
+void AddScaled(float *dst, size_t stride, const float *src, float gain,
+   size_t len)
+{
+   size_t i = 0;
+   if (gain == 1.0f) {
+      if (stride == 1) {
+#ifdef USE_SSE2
+         for (; i + 4 <= len; i += 4)
+            _mm_storeu_ps(dst + i,
+               _mm_add_ps(_mm_loadu_ps(dst + i), _mm_loadu_ps(src + i)));
+#endif
+      }
+      for (; i < len; ++i)
+         dst[i * stride] += src[i];
+      return;
+   }
+
+   if (stride == 1) {
+#ifdef USE_SSE2
+      const auto gains = _mm_set1_ps(gain);
+      for (; i + 4 <= len; i += 4)
+         _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i),
+            _mm_mul_ps(_mm_loadu_ps(src + i), gains)));
+#endif
+   }
+   for (; i < len; ++i)
+      dst[i * stride] += src[i] * gain;
+}
+
+MinMaxSumSq SummarizeSamples(const float *src, size_t len)
+{
+   float min = FLT_MAX, max = -FLT_MAX, sumsq = 0;
+   size_t i = 0;
+#ifdef USE_SSE2
+   if (len >= 8) {
+      // Two vectors of partial results hide the latency of the additions.
+      // The sample is the first operand of min and max, so that, as in
+      // std::min(min, sample), a NaN sample leaves the result unchanged.
+      auto min0 = _mm_set1_ps(FLT_MAX), min1 = min0;
+      auto max0 = _mm_set1_ps(-FLT_MAX), max1 = max0;
+      auto sum0 = _mm_setzero_ps(), sum1 = sum0;
+      for (; i + 8 <= len; i += 8) {
+         const auto v0 = _mm_loadu_ps(src + i);
+         const auto v1 = _mm_loadu_ps(src + i + 4);
+         min0 = _mm_min_ps(v0, min0);
+         min1 = _mm_min_ps(v1, min1);
+         max0 = _mm_max_ps(v0, max0);
+         max1 = _mm_max_ps(v1, max1);
+         sum0 = _mm_add_ps(sum0, _mm_mul_ps(v0, v0));
+         sum1 = _mm_add_ps(sum1, _mm_mul_ps(v1, v1));
+      }
+      alignas(16) float mins[4], maxes[4], sums[4];
+      _mm_store_ps(mins, _mm_min_ps(min0, min1));
+      _mm_store_ps(maxes, _mm_max_ps(max0, max1));
+      _mm_store_ps(sums, _mm_add_ps(sum0, sum1));
+      for (int lane = 0; lane < 4; ++lane) {
+         min = std::min(min, mins[lane]);
+         max = std::max(max, maxes[lane]);
+      }
+      sumsq = (sums[0] + sums[1]) + (sums[2] + sums[3]);
+   }
+#endif
+   for (; i < len; ++i) {
+      const float sample = src[i];
+      min = std::min(min, sample);
+      max = std::max(max, sample);
+      sumsq += sample * sample;
+   }
+   return { min, max, sumsq };
+}
+
+MinMaxSumSq SummarizeTriples(const float *src, size_t count)
+{
+   // There are fewer of these than of samples by a factor of 256 or more,
+   // so a plain loop is enough
+   float min = FLT_MAX, max = -FLT_MAX, sumsq = 0;
+   for (size_t i = 0; i < count; ++i, src += 3) {
+      min = std::min(min, src[0]);
+      max = std::max(max, src[1]);
+      sumsq += src[2] * src[2];
+   }
+   return { min, max, sumsq };
+}
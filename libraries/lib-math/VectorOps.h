@@ -0,0 +1,51 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  @file VectorOps.h
+  @brief Loops over arrays of samples, vectorized where the processor allows
+
+  Each function gives the same results, bit for bit, as the plain loop that
+  its comment describes, so that it can replace such a loop anywhere --
+  except for sums, which are accumulated in several partial sums at once.
+
+**********************************************************************/
+
+#ifndef __AUDACITY_VECTOR_OPS__
+#define __AUDACITY_VECTOR_OPS__
+
+#include <cstddef>
+
+//! For each i < len, dst[i] = dst[i] * gains[i], multiplying in double
+//! precision and rounding the product to float
+MATH_API
+void MultiplyByGains(float *dst, const double *gains, size_t len);
+
+//! For each i < len, dst[i * stride] += src[i] * gain
+/*! If gain is 1, the multiplication is skipped, which changes nothing */
+MATH_API
+void AddScaled(float *dst, size_t stride, const float *src, float gain,
+   size_t len);
+
+//! Least and greatest of some values, and the sum of their squares
+struct MinMaxSumSq {
+   float min;
+   float max;
+   float sumsq;
+};
+
+//! Summarize src[0] up to src[len - 1], as the loop
+//! `min = std::min(min, src[i]); max = std::max(max, src[i]);
+//! sumsq += src[i] * src[i];` would, starting from FLT_MAX, -FLT_MAX and 0
+/*! min and max are exact, and NaNs are skipped as by that loop.  sumsq
+ is accumulated in another order, so it may differ in the last bits. */
+MATH_API
+MinMaxSumSq SummarizeSamples(const float *src, size_t len);
+
+//! Summarize count triples of min, max, and rms, as stored in the summaries
+//! of sample blocks, giving the least min, the greatest max, and the sum of
+//! the squares of the rms values
+MATH_API
+MinMaxSumSq SummarizeTriples(const float *src, size_t count);
+
+#endif
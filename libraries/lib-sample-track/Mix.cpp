@@ -25,13 +25,18 @@
 
 #include <cmath>
 
+#include "Dither.h"
 #include "Envelope.h"
 #include "SampleTrack.h"
 #include "SampleTrackCache.h"
 #include "Prefs.h"
 #include "Resample.h"
+#include "VectorOps.h"
+#include "WorkerPool.h"
 #include "float_cast.h"
 
+BoolSetting MixInParallel{ L"/Quality/MixInParallel", false };
+
 Mixer::WarpOptions::WarpOptions(const TrackList &list)
 : envelope(DefaultWarp::Call(list)), minSpeed(0.0), maxSpeed(0.0)
 {
@@ -67,7 +72,8 @@ Mixer::Mixer(const SampleTrackConstArray &inputTracks,
              double startTime, double stopTime,
              unsigned numOutChannels, size_t outBufferSize, bool outInterleaved,
              double outRate, sampleFormat outFormat,
-             bool highQuality, MixerSpec *mixerSpec, bool applyTrackGains)
+             bool highQuality, MixerSpec *mixerSpec, bool applyTrackGains,
+             bool readAhead)
    : mNumInputTracks { inputTracks.size() }
 
    , mApplyTrackGains{ applyTrackGains }
@@ -80,6 +86,7 @@ Mixer::Mixer(const SampleTrackConstArray &inputTracks,
 
    , mNumChannels{ numOutChannels }
    , mGains{ mNumChannels }
+   , mChannelFlags{ mNumChannels }
 
    , mFormat{ outFormat }
    , mRate{ outRate }
@@ -94,6 +101,9 @@ Mixer::Mixer(const SampleTrackConstArray &inputTracks,
    mSamplePos.reinit(mNumInputTracks);
    for(size_t i=0; i<mNumInputTracks; i++) {
       mInputTrack[i].SetTrack(inputTracks[i]);
+      // Mixing reads each track sequentially
+      if (readAhead)
+         mInputTrack[i].EnableReadAhead();
       mSamplePos[i] = inputTracks[i]->TimeToLongSamples(startTime);
    }
    mEnvelope = warpOptions.envelope;
@@ -168,6 +178,22 @@ Mixer::Mixer(const SampleTrackConstArray &inputTracks,
 
    const auto envLen = std::max(mQueueMaxLen, mInterleavedBufferSize);
    mEnvValues.reinit(envLen);
+
+   // A time track warp envelope is shared by all tracks, and caches its last
+   // search, so it can't be evaluated in several threads
+   mParallel = MixInParallel.Read() && mNumInputTracks > 1 && !mEnvelope;
+   if (mParallel) {
+      const auto nGroups = std::min<size_t>(
+         mNumInputTracks, WorkerPool::Get().GetConcurrency());
+      mGroupEnvValues.resize(nGroups);
+      for (auto &envValues : mGroupEnvValues)
+         envValues.reinit(envLen);
+      mTrackBuffers.reinit(mNumInputTracks);
+      for (size_t i = 0; i < mNumInputTracks; ++i)
+         // PRL:  Bug2536: see other comments below
+         mTrackBuffers[i].reinit(mInterleavedBufferSize + 1);
+      mTrackOut.reinit(mNumInputTracks);
+   }
 }
 
 Mixer::~Mixer()
@@ -206,14 +232,21 @@ static void MixBuffers(unsigned numChannels, int *channelFlags, float *gains,
          skip = 1;
       }
 
-      float gain = gains[c];
-      for (int j = 0; j < len; j++) {
-         *dest += src[j] * gain;   // the actual mixing process
-         dest += skip;
-      }
+      // the actual mixing process
+      AddScaled(dest, skip, src, gains[c], len);
    }
 }
 
+//! Multiply samples by the envelope of the track, unless that changes nothing
+static void ApplyEnvelope(const SampleTrack &track,
+   float *buffer, double *envValues, size_t len, double t0)
+{
+   if (track.HasUnityEnvelope(t0, t0 + len / track.GetRate()))
+      return;
+   track.GetEnvelopeValues(envValues, len, t0);
+   MultiplyByGains(buffer, envValues, len);
+}
+
 namespace {
    //Note: The meaning of this function has changed (December 2012)
    //Previously this function did something that was close to the opposite (but not entirely accurate).
@@ -234,10 +267,11 @@ double ComputeWarpFactor(const Envelope &env, double t0, double t1)
 
 }
 
-size_t Mixer::MixVariableRates(int *channelFlags, SampleTrackCache &cache,
+size_t Mixer::MixVariableRates(SampleTrackCache &cache,
                                     sampleCount *pos, float *queue,
                                     int *queueStart, int *queueLen,
-                                    Resample * pResample)
+                                    Resample * pResample,
+                                    float *floatBuffer, double *envValues)
 {
    const auto track = cache.GetTrack().get();
    const double trackRate = track->GetRate();
@@ -291,9 +325,8 @@ size_t Mixer::MixVariableRates(int *channelFlags, SampleTrackCache &cache,
                else
                   memset(&queue[*queueLen], 0, sizeof(float) * getLen);
 
-               track->GetEnvelopeValues(mEnvValues.get(),
-                                        getLen,
-                                        (*pos - (getLen- 1)).as_double() / trackRate);
+               ApplyEnvelope(*track, &queue[*queueLen], envValues, getLen,
+                  (*pos - (getLen- 1)).as_double() / trackRate);
                *pos -= getLen;
             }
             else {
@@ -303,17 +336,12 @@ size_t Mixer::MixVariableRates(int *channelFlags, SampleTrackCache &cache,
                else
                   memset(&queue[*queueLen], 0, sizeof(float) * getLen);
 
-               track->GetEnvelopeValues(mEnvValues.get(),
-                                        getLen,
-                                        (*pos).as_double() / trackRate);
+               ApplyEnvelope(*track, &queue[*queueLen], envValues, getLen,
+                  (*pos).as_double() / trackRate);
 
                *pos += getLen;
             }
 
-            for (decltype(getLen) i = 0; i < getLen; i++) {
-               queue[(*queueLen) + i] *= mEnvValues[i];
-            }
-
             if (backwards)
                ReverseSamples((samplePtr)&queue[0], floatSample,
                               *queueLen, getLen);
@@ -324,7 +352,9 @@ size_t Mixer::MixVariableRates(int *channelFlags, SampleTrackCache &cache,
 
       auto thisProcessLen = mProcessLen;
       bool last = (*queueLen < (int)mProcessLen);
-      if (last) {
+      // A constant rate needs no short chunks to follow the warp, so give
+      // the resampler all that is queued, and call it less often
+      if (last || !mbVariableRates) {
          thisProcessLen = *queueLen;
       }
 
@@ -349,13 +379,13 @@ size_t Mixer::MixVariableRates(int *channelFlags, SampleTrackCache &cache,
          thisProcessLen,
          last,
          // PRL:  Bug2536: crash in soxr happened on Mac, sometimes, when
-         // mMaxOut - out == 1 and &mFloatBuffer[out + 1] was an unmapped
+         // mMaxOut - out == 1 and &floatBuffer[out + 1] was an unmapped
          // address, because soxr, strangely, fetched an 8-byte (misaligned!)
-         // value from &mFloatBuffer[out], but did nothing with it anyway,
+         // value from &floatBuffer[out], but did nothing with it anyway,
          // in soxr_output_no_callback.
          // Now we make the bug go away by allocating a little more space in
          // the buffer than we need.
-         &mFloatBuffer[out],
+         &floatBuffer[out],
          mMaxOut - out);
 
       const auto input_used = results.first;
@@ -369,28 +399,11 @@ size_t Mixer::MixVariableRates(int *channelFlags, SampleTrackCache &cache,
       }
    }
 
-   for (size_t c = 0; c < mNumChannels; c++) {
-      if (mApplyTrackGains) {
-         mGains[c] = track->GetChannelGain(c);
-      }
-      else {
-         mGains[c] = 1.0;
-      }
-   }
-
-   MixBuffers(mNumChannels,
-              channelFlags,
-              mGains.get(),
-              mFloatBuffer.get(),
-              mTemp.get(),
-              out,
-              mInterleaved);
-
    return out;
 }
 
-size_t Mixer::MixSameRate(int *channelFlags, SampleTrackCache &cache,
-                               sampleCount *pos)
+size_t Mixer::MixSameRate(SampleTrackCache &cache, sampleCount *pos,
+                               float *floatBuffer, double *envValues)
 {
    const auto track = cache.GetTrack().get();
    const double t = ( *pos ).as_double() / track->GetRate();
@@ -416,39 +429,81 @@ size_t Mixer::MixSameRate(int *channelFlags, SampleTrackCache &cache,
    if (backwards) {
       auto results = cache.GetFloats(*pos - (slen - 1), slen, mMayThrow);
       if (results)
-         memcpy(mFloatBuffer.get(), results, sizeof(float) * slen);
+         memcpy(floatBuffer, results, sizeof(float) * slen);
       else
-         memset(mFloatBuffer.get(), 0, sizeof(float) * slen);
-      track->GetEnvelopeValues(mEnvValues.get(), slen, t - (slen - 1) / mRate);
-      for(decltype(slen) i = 0; i < slen; i++)
-         mFloatBuffer[i] *= mEnvValues[i]; // Track gain control will go here?
-      ReverseSamples((samplePtr)mFloatBuffer.get(), floatSample, 0, slen);
+         memset(floatBuffer, 0, sizeof(float) * slen);
+      ApplyEnvelope(*track, floatBuffer, envValues, slen,
+         t - (slen - 1) / mRate);
+      ReverseSamples((samplePtr)floatBuffer, floatSample, 0, slen);
 
       *pos -= slen;
    }
    else {
       auto results = cache.GetFloats(*pos, slen, mMayThrow);
       if (results)
-         memcpy(mFloatBuffer.get(), results, sizeof(float) * slen);
+         memcpy(floatBuffer, results, sizeof(float) * slen);
       else
-         memset(mFloatBuffer.get(), 0, sizeof(float) * slen);
-      track->GetEnvelopeValues(mEnvValues.get(), slen, t);
-      for(decltype(slen) i = 0; i < slen; i++)
-         mFloatBuffer[i] *= mEnvValues[i]; // Track gain control will go here?
+         memset(floatBuffer, 0, sizeof(float) * slen);
+      ApplyEnvelope(*track, floatBuffer, envValues, slen, t);
 
       *pos += slen;
    }
 
+   return slen;
+}
+
+size_t Mixer::MixTrack(size_t i, float *floatBuffer, double *envValues)
+{
+   const auto track = mInputTrack[i].GetTrack().get();
+   if (mbVariableRates || track->GetRate() != mRate)
+      return MixVariableRates(mInputTrack[i],
+         &mSamplePos[i], mSampleQueue[i].get(),
+         &mQueueStart[i], &mQueueLen[i], mResample[i].get(),
+         floatBuffer, envValues);
+   else
+      return MixSameRate(mInputTrack[i], &mSamplePos[i],
+         floatBuffer, envValues);
+}
+
+void Mixer::AccumulateTrack(size_t i, const float *floatBuffer, size_t len)
+{
+   const auto track = mInputTrack[i].GetTrack().get();
+   auto &channelFlags = mChannelFlags;
+   for(size_t j=0; j<mNumChannels; j++)
+      channelFlags[j] = 0;
+
+   if( mMixerSpec ) {
+      //ignore left and right when downmixing is not required
+      for(size_t j = 0; j < mNumChannels; j++ )
+         channelFlags[ j ] = mMixerSpec->mMap[ i ][ j ] ? 1 : 0;
+   }
+   else {
+      switch(track->GetChannel()) {
+      case Track::MonoChannel:
+      default:
+         for(size_t j=0; j<mNumChannels; j++)
+            channelFlags[j] = 1;
+         break;
+      case Track::LeftChannel:
+         channelFlags[0] = 1;
+         break;
+      case Track::RightChannel:
+         if (mNumChannels >= 2)
+            channelFlags[1] = 1;
+         else
+            channelFlags[0] = 1;
+         break;
+      }
+   }
+
    for(size_t c=0; c<mNumChannels; c++)
       if (mApplyTrackGains)
          mGains[c] = track->GetChannelGain(c);
       else
          mGains[c] = 1.0;
 
-   MixBuffers(mNumChannels, channelFlags, mGains.get(),
-              mFloatBuffer.get(), mTemp.get(), slen, mInterleaved);
-
-   return slen;
+   MixBuffers(mNumChannels, channelFlags.get(), mGains.get(),
+              floatBuffer, mTemp.get(), len, mInterleaved);
 }
 
 size_t Mixer::Process(size_t maxToProcess)
@@ -459,47 +514,35 @@ size_t Mixer::Process(size_t maxToProcess)
    //   return 0;
 
    decltype(Process(0)) maxOut = 0;
-   ArrayOf<int> channelFlags{ mNumChannels };
 
    mMaxOut = maxToProcess;
 
+   if (mParallel) {
+      // Each group of tracks has its own envelope buffer; the groups are
+      // interleaved, so that they take similar time
+      const auto nGroups = mGroupEnvValues.size();
+      WorkerPool::Get().ParallelFor(nGroups, [&](size_t g){
+         for (auto i = g; i < mNumInputTracks; i += nGroups)
+            mTrackOut[i] = MixTrack(
+               i, mTrackBuffers[i].get(), mGroupEnvValues[g].get());
+      });
+   }
+
    Clear();
    for(size_t i=0; i<mNumInputTracks; i++) {
       const auto track = mInputTrack[i].GetTrack().get();
-      for(size_t j=0; j<mNumChannels; j++)
-         channelFlags[j] = 0;
-
-      if( mMixerSpec ) {
-         //ignore left and right when downmixing is not required
-         for(size_t j = 0; j < mNumChannels; j++ )
-            channelFlags[ j ] = mMixerSpec->mMap[ i ][ j ] ? 1 : 0;
+      // Sum in track order, whether or not the tracks were mixed in
+      // parallel, because float addition is not associative
+      size_t out;
+      if (mParallel) {
+         out = mTrackOut[i];
+         AccumulateTrack(i, mTrackBuffers[i].get(), out);
       }
       else {
-         switch(track->GetChannel()) {
-         case Track::MonoChannel:
-         default:
-            for(size_t j=0; j<mNumChannels; j++)
-               channelFlags[j] = 1;
-            break;
-         case Track::LeftChannel:
-            channelFlags[0] = 1;
-            break;
-         case Track::RightChannel:
-            if (mNumChannels >= 2)
-               channelFlags[1] = 1;
-            else
-               channelFlags[0] = 1;
-            break;
-         }
+         out = MixTrack(i, mFloatBuffer.get(), mEnvValues.get());
+         AccumulateTrack(i, mFloatBuffer.get(), out);
       }
-      if (mbVariableRates || track->GetRate() != mRate)
-         maxOut = std::max(maxOut,
-            MixVariableRates(channelFlags.get(), mInputTrack[i],
-               &mSamplePos[i], mSampleQueue[i].get(),
-               &mQueueStart[i], &mQueueLen[i], mResample[i].get()));
-      else
-         maxOut = std::max(maxOut,
-            MixSameRate(channelFlags.get(), mInputTrack[i], &mSamplePos[i]));
+      maxOut = std::max(maxOut, out);
 
       double t = mSamplePos[i].as_double() / (double)track->GetRate();
       if (mT0 > mT1)
@@ -509,14 +552,27 @@ size_t Mixer::Process(size_t maxToProcess)
          // forwards (the usual)
          mTime = std::min(std::max(t, mTime), mT1);
    }
-   if(mInterleaved) {
+   const auto ditherType =
+      mHighQuality ? gHighQualityDither : gLowQualityDither;
+   if(mInterleaved &&
+      (mFormat == floatSample || ditherType == DitherType::none)) {
+      // Each sample converts independently of the others, so all channels
+      // can convert at once, contiguously
+      CopySamples((constSamplePtr)mTemp[0].get(),
+         floatSample,
+         mBuffer[0].ptr(),
+         mFormat,
+         maxOut * mNumChannels,
+         ditherType);
+   }
+   else if(mInterleaved) {
       for(size_t c=0; c<mNumChannels; c++) {
          CopySamples((constSamplePtr)(mTemp[0].get() + c),
             floatSample,
             mBuffer[0].ptr() + (c * SAMPLE_SIZE(mFormat)),
             mFormat,
             maxOut,
-            mHighQuality ? gHighQualityDither : gLowQualityDither,
+            ditherType,
             mNumChannels,
             mNumChannels);
       }
@@ -528,7 +584,7 @@ size_t Mixer::Process(size_t maxToProcess)
             mBuffer[c].ptr(),
             mFormat,
             maxOut,
-            mHighQuality ? gHighQualityDither : gLowQualityDither);
+            ditherType);
       }
    }
    // MB: this doesn't take warping into account, replaced with code based on mSamplePos
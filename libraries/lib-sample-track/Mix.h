@@ -25,6 +25,7 @@
 #include <functional>
 #include <vector>
 
+class BoolSetting;
 class sampleCount;
 class Resample;
 class BoundedEnvelope;
@@ -33,6 +34,10 @@ class SampleTrack;
 using SampleTrackConstArray = std::vector < std::shared_ptr < const SampleTrack > >;
 class SampleTrackCache;
 
+//! Whether a Mixer of several tracks, without time warp, reads and resamples
+//! them at once in worker threads; the mix is the same either way
+extern SAMPLE_TRACK_API BoolSetting MixInParallel;
+
 class SAMPLE_TRACK_API MixerSpec
 {
    unsigned mNumTracks, mNumChannels, mMaxNumChannels;
@@ -93,7 +98,10 @@ class SAMPLE_TRACK_API Mixer {
          unsigned numOutChannels, size_t outBufferSize, bool outInterleaved,
          double outRate, sampleFormat outFormat,
          bool highQuality = true, MixerSpec *mixerSpec = nullptr,
-         bool applytTrackGains = true);
+         bool applytTrackGains = true,
+         //! Read each track's next samples in a worker thread while mixing;
+         //! pass false when something else already fetches them ahead
+         bool readAhead = true);
 
    virtual ~ Mixer();
 
@@ -133,13 +141,25 @@ class SAMPLE_TRACK_API Mixer {
  private:
 
    void Clear();
-   size_t MixSameRate(int *channelFlags, SampleTrackCache &cache,
-                           sampleCount *pos);
 
-   size_t MixVariableRates(int *channelFlags, SampleTrackCache &cache,
+   //! Fill floatBuffer with the next samples of track i, with its envelope
+   //! applied and resampled, but not yet its gains; return how many
+   /*! Uses no members that another track's call changes, so tracks may be
+    done in different threads, if each has its own buffers */
+   size_t MixTrack(size_t i, float *floatBuffer, double *envValues);
+
+   //! Add samples that MixTrack() made for track i, times the track's
+   //! channel gains, into the output channels of the track
+   void AccumulateTrack(size_t i, const float *floatBuffer, size_t len);
+
+   size_t MixSameRate(SampleTrackCache &cache, sampleCount *pos,
+                           float *floatBuffer, double *envValues);
+
+   size_t MixVariableRates(SampleTrackCache &cache,
                                 sampleCount *pos, float *queue,
                                 int *queueStart, int *queueLen,
-                                Resample * pResample);
+                                Resample * pResample,
+                                float *floatBuffer, double *envValues);
 
    void MakeResamplers();
 
@@ -168,6 +188,8 @@ class SAMPLE_TRACK_API Mixer {
    size_t              mMaxOut;
    const unsigned   mNumChannels;
    Floats           mGains;
+   //! Which output channels AccumulateTrack() mixes the track into
+   ArrayOf<int>     mChannelFlags;
    unsigned         mNumBuffers;
    size_t              mBufferSize;
    size_t              mInterleavedBufferSize;
@@ -182,6 +204,14 @@ class SAMPLE_TRACK_API Mixer {
    std::vector<double> mMinFactor, mMaxFactor;
 
    const bool       mMayThrow;
+
+   //! Whether Process() mixes tracks at once on the WorkerPool
+   bool             mParallel{ false };
+   //! In parallel mode, the output of MixTrack() for each track
+   ArrayOf<Floats>  mTrackBuffers;
+   ArrayOf<size_t>  mTrackOut;
+   //! In parallel mode, envelope values for each group of tracks
+   std::vector<Doubles> mGroupEnvValues;
 };
 
 #endif
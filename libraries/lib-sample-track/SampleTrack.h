@@ -40,6 +40,10 @@ public:
    virtual void GetEnvelopeValues(double *buffer, size_t bufferLen,
                          double t0) const = 0;
 
+   //! Whether GetEnvelopeValues() for times from t0 to t1 would give 1 or so
+   //! nearly 1 that multiplying float samples by the values changes nothing
+   virtual bool HasUnityEnvelope(double t0, double t1) const = 0;
+
    //! Takes gain and pan into account
    virtual float GetChannelGain(int channel) const = 0;
 
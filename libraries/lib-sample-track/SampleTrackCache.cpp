@@ -10,14 +10,34 @@ Paul Licameli split from WaveTrack.cpp
 
 #include "SampleTrackCache.h"
 #include "SampleTrack.h"
+#include "WorkerPool.h"
+
+#include <atomic>
+#include <future>
+
+//! A read that a worker thread or the reader does, whichever claims it first
+/*!
+ So the reader never waits for a read that is still queued behind other work
+ in the pool, and the read is not lost if the pool drops it
+ */
+struct SampleTrackCache::ReadAhead {
+   //! @return whether the caller should run the task
+   bool Claim() { return !claimed.test_and_set(); }
+
+   std::atomic_flag claimed = ATOMIC_FLAG_INIT;
+   std::packaged_task<bool()> task;
+   std::future<bool> result;
+};
 
 SampleTrackCache::~SampleTrackCache()
 {
+   CancelReadAhead();
 }
 
 void SampleTrackCache::SetTrack(const std::shared_ptr<const SampleTrack> &pTrack)
 {
    if (mPTrack != pTrack) {
+      CancelReadAhead();
       if (pTrack) {
          mBufferSize = pTrack->GetMaxBlockSize();
          if (!mPTrack ||
@@ -25,6 +45,8 @@ void SampleTrackCache::SetTrack(const std::shared_ptr<const SampleTrack> &pTrack
             Free();
             mBuffers[0].data = Floats{ mBufferSize };
             mBuffers[1].data = Floats{ mBufferSize };
+            if (mReadAhead)
+               mAhead.data = Floats{ mBufferSize };
          }
       }
       else
@@ -36,10 +58,23 @@ void SampleTrackCache::SetTrack(const std::shared_ptr<const SampleTrack> &pTrack
 
 const float *SampleTrackCache::GetFloats(
    sampleCount start, size_t len, bool mayThrow)
+{
+   const auto result = DoGetFloats(start, len, mayThrow);
+   // Read ahead when this request is done, even if it returned failure;
+   // but not if it threw
+   if (mReadAhead && len > 0)
+      StartReadAhead(mayThrow);
+   return result;
+}
+
+const float *SampleTrackCache::DoGetFloats(
+   sampleCount start, size_t len, bool mayThrow)
 {
    constexpr auto format = floatSample;
    if (format == floatSample && len > 0) {
       const auto end = start + len;
+      mBackwards = start < mLastStart;
+      mLastStart = start;
 
       bool fillFirst = (mNValidBuffers < 1);
       bool fillSecond = (mNValidBuffers < 2);
@@ -86,9 +121,7 @@ const float *SampleTrackCache::GetFloats(
          if (start0 >= 0) {
             const auto len0 = mPTrack->GetBestBlockSize(start0);
             wxASSERT(len0 <= mBufferSize);
-            if (!mPTrack->GetFloats(
-                  mBuffers[0].data.get(), start0, len0,
-                  fillZero, mayThrow))
+            if (!Fill(mBuffers[0], start0, len0, mayThrow))
                return nullptr;
             mBuffers[0].start = start0;
             mBuffers[0].len = len0;
@@ -114,7 +147,7 @@ const float *SampleTrackCache::GetFloats(
             if (start1 == end0) {
                const auto len1 = mPTrack->GetBestBlockSize(start1);
                wxASSERT(len1 <= mBufferSize);
-               if (!mPTrack->GetFloats(mBuffers[1].data.get(), start1, len1, fillZero, mayThrow))
+               if (!Fill(mBuffers[1], start1, len1, mayThrow))
                   return nullptr;
                mBuffers[1].start = start1;
                mBuffers[1].len = len1;
@@ -214,10 +247,100 @@ const float *SampleTrackCache::GetFloats(
    }
 }
 
+void SampleTrackCache::EnableReadAhead()
+{
+   if (mReadAhead)
+      return;
+   mReadAhead = true;
+   if (mPTrack)
+      mAhead.data = Floats{ mBufferSize };
+}
+
+bool SampleTrackCache::Fill(
+   Buffer &buffer, sampleCount start, size_t len, bool mayThrow)
+{
+   if (mpPending && mAhead.start == start && mAhead.len == len) {
+      const auto pPending = move(mpPending);
+      // Don't wait for a worker that has not started the read
+      if (pPending->Claim())
+         pPending->task();
+      // get() rethrows any exception of the read
+      const auto result = pPending->result.get();
+      if (!result)
+         return false;
+      // Take the samples without copying
+      buffer.swap(mAhead);
+      mAhead.start = mAhead.len = 0;
+      return true;
+   }
+   // A read-ahead of some other block is stale after a jump
+   CancelReadAhead();
+   return mPTrack->GetFloats(buffer.data.get(), start, len, fillZero, mayThrow);
+}
+
+void SampleTrackCache::StartReadAhead(bool mayThrow)
+{
+   if (mpPending || mNValidBuffers < 1 || !mAhead.data)
+      return;
+
+   // Find the block next to the buffers, in the direction of access, if
+   // that block is within a clip
+   sampleCount start0 = -1;
+   if (!mBackwards) {
+      const auto end = mBuffers[mNValidBuffers - 1].end();
+      if (mPTrack->GetBlockStart(end) == end)
+         start0 = end;
+   }
+   else if (mBuffers[0].start > 0) {
+      const auto end = mBuffers[0].start;
+      const auto start = mPTrack->GetBlockStart(end - 1);
+      if (start >= 0 && start + mPTrack->GetBestBlockSize(start) == end)
+         start0 = start;
+   }
+   if (start0 < 0)
+      return;
+   const auto len0 = mPTrack->GetBestBlockSize(start0);
+   if (len0 == 0 || len0 > mBufferSize)
+      return;
+
+   auto pPending = std::make_shared<ReadAhead>();
+   pPending->task = std::packaged_task<bool()>{
+      [pTrack = mPTrack, buffer = mAhead.data.get(), start0, len0, mayThrow]{
+         return pTrack->GetFloats(buffer, start0, len0, fillZero, mayThrow);
+      } };
+   pPending->result = pPending->task.get_future();
+   // The task captures exceptions of the read for the future
+   if (!WorkerPool::Get().Post([pPending]{
+      if (pPending->Claim())
+         pPending->task();
+   }))
+      // No other thread to read ahead
+      return;
+   mAhead.start = start0;
+   mAhead.len = len0;
+   mpPending = move(pPending);
+}
+
+void SampleTrackCache::CancelReadAhead()
+{
+   // If no worker has started the read, it never will; else wait for it
+   if (const auto pPending = move(mpPending); pPending && !pPending->Claim()) {
+      try {
+         pPending->result.get();
+      }
+      catch (...) {
+         // The read was not wanted after all
+      }
+   }
+   mAhead.start = mAhead.len = 0;
+}
+
 void SampleTrackCache::Free()
 {
+   CancelReadAhead();
    mBuffers[0].Free();
    mBuffers[1].Free();
+   mAhead.Free();
    mOverlapBuffer.Free();
    mNValidBuffers = 0;
 }
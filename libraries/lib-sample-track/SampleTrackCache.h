@@ -42,6 +42,15 @@ public:
    const std::shared_ptr<const SampleTrack>& GetTrack() const { return mPTrack; }
    void SetTrack(const std::shared_ptr<const SampleTrack> &pTrack);
 
+   //! After each GetFloats(), read the next block in the direction of access
+   //! in a WorkerPool thread, while the caller works on the samples
+   /*!
+    Only for sequential readers, such as mixers, that use the cache from one
+    thread at a time.  The track is read by the other thread too, so it must
+    not change while this object exists, as is assumed anyway.
+    */
+   void EnableReadAhead();
+
    //! Retrieve samples as floats from the track or from the memory cache
    /*! Uses fillZero always
     @return null on failure; this object owns the memory; may be invalidated if GetFloats() is called again
@@ -49,6 +58,7 @@ public:
    const float *GetFloats(sampleCount start, size_t len, bool mayThrow);
 
 private:
+   const float *DoGetFloats(sampleCount start, size_t len, bool mayThrow);
    void Free();
 
    struct Buffer {
@@ -68,11 +78,28 @@ private:
       }
    };
 
+   //! Fill buffer with a block, from the read-ahead if it has that block
+   bool Fill(Buffer &buffer, sampleCount start, size_t len, bool mayThrow);
+   //! Start reading the block adjacent to the buffers, if not pending already
+   void StartReadAhead(bool mayThrow);
+   //! Wait for any read-ahead and discard it
+   void CancelReadAhead();
+
    std::shared_ptr<const SampleTrack> mPTrack;
    size_t mBufferSize;
    Buffer mBuffers[2];
    GrowableSampleBuffer mOverlapBuffer;
    int mNValidBuffers;
+
+   bool mReadAhead{ false };
+   //! Whether the last request started before the one preceding it
+   bool mBackwards{ false };
+   sampleCount mLastStart{ 0 };
+   //! Destination of the read-ahead, not to be touched while it is pending
+   Buffer mAhead;
+   struct ReadAhead;
+   //! The read of mAhead, if started; may be null
+   std::shared_ptr<ReadAhead> mpPending;
 };
 
 #endif
@@ -30,6 +30,7 @@ a draggable point type.
 #include "Envelope.h"
 
 #include <math.h>
+#include <algorithm>
 
 #include <wx/wxcrtvararg.h>
 #include <wx/brush.h>
@@ -928,6 +929,28 @@ void Envelope::GetValues( double *buffer, int bufferLen,
    GetValuesRelative( buffer, bufferLen, t0, tstep);
 }
 
+bool Envelope::IsConstant(double t0, double t1, double value) const
+{
+   if (mEnv.empty())
+      return mDefaultValue == value;
+
+   // Convert from absolute to clip-relative time
+   t0 -= mOffset;
+   t1 -= mOffset;
+   auto compare = [](const EnvPoint &point, double t){ return point.GetT() < t; };
+   // The last point before t0, or else the first point
+   auto first = std::lower_bound(mEnv.begin(), mEnv.end(), t0, compare);
+   if (first != mEnv.begin())
+      --first;
+   // The first point after t1, or else the last point
+   auto last = std::upper_bound(first, mEnv.end(), t1,
+      [](double t, const EnvPoint &point){ return t < point.GetT(); });
+   if (last == mEnv.end())
+      --last;
+   return std::all_of(first, last + 1,
+      [value](const EnvPoint &point){ return point.GetVal() == value; });
+}
+
 void Envelope::GetValuesRelative
    (double *buffer, int bufferLen, double t0, double tstep, bool leftLimit)
    const
@@ -938,6 +961,12 @@ void Envelope::GetValuesRelative
    const auto epsilon = tstep / 2;
    int len = mEnv.size();
 
+   // IF empty envelope THEN default value, everywhere
+   if (len <= 0) {
+      std::fill(buffer, buffer + std::max(0, bufferLen), mDefaultValue);
+      return;
+   }
+
    double t = t0;
    double increment = 0;
    if ( len > 1 && t <= mEnv[0].GetT() && mEnv[0].GetT() == mEnv[1].GetT() )
@@ -948,13 +977,6 @@ void Envelope::GetValuesRelative
    for (int b = 0; b < bufferLen; b++) {
 
       // Get easiest cases out the way first...
-      // IF empty envelope THEN default value
-      if (len <= 0) {
-         buffer[b] = mDefaultValue;
-         t += tstep;
-         continue;
-      }
-
       auto tplus = t + increment;
 
       // IF before envelope THEN first value
@@ -966,6 +988,11 @@ void Envelope::GetValuesRelative
       // IF after envelope THEN last value
       if ( leftLimit
             ? tplus > mEnv[len - 1].GetT() : tplus >= mEnv[len - 1].GetT() ) {
+         if (tstep >= 0) {
+            // Time can't come back, so fill the rest of the buffer
+            std::fill(buffer + b, buffer + bufferLen, mEnv[len - 1].GetVal());
+            return;
+         }
          buffer[b] = mEnv[len - 1].GetVal();
          t += tstep;
          continue;
@@ -1032,6 +1059,26 @@ void Envelope::GetValuesRelative
          }
 
          buffer[b] = v;
+
+         if (tstep >= 0) {
+            // Generate the ramp in bulk while time is before tnext; none of
+            // the tests above can succeed until then.  Time accumulates just
+            // as in the outer loop.
+            auto inInterval = [&](double tt){
+               const auto tplus = tt + increment;
+               return leftLimit ? tplus <= tnext : tplus < tnext;
+            };
+            if (mDB)
+               for (; b + 1 < bufferLen && inInterval(t + tstep); ++b) {
+                  t += tstep;
+                  buffer[b + 1] = buffer[b] * vstep;
+               }
+            else
+               for (; b + 1 < bufferLen && inInterval(t + tstep); ++b) {
+                  t += tstep;
+                  buffer[b + 1] = buffer[b] + vstep;
+               }
+         }
       } else {
          if (mDB){
             buffer[b] = buffer[b - 1] * vstep;
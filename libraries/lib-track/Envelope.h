@@ -136,6 +136,14 @@ public:
     * more than one value in a row. */
    void GetValues(double *buffer, int len, double t0, double tstep) const;
 
+   /** \brief Whether the envelope has the given value at all times from t0
+    * to t1, as when all points that bound that interval or lie in it have the
+    * value.
+    *
+    * Then GetValues() over the interval may give values that differ from the
+    * given value only by rounding of interpolation in double precision. */
+   bool IsConstant(double t0, double t1, double value) const;
+
    // Guarantee an envelope point at the end of the domain.
    void Cap( double sampleDur );
 
@@ -0,0 +1,147 @@
+/*!********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  @file WorkerPool.cpp
+
+**********************************************************************/
+
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+struct WorkerPool::Job
+{
+   Job(size_t count, const std::function<void(size_t)> &body)
+      : count{ count }, body{ body }
+   {}
+
+   //! Claim and run indices until none remain
+   void Work();
+   bool Exhausted() const { return next.load() >= count; }
+
+   const size_t count;
+   //! Called only while indices remain, so only while the caller waits
+   const std::function<void(size_t)> &body;
+   std::atomic<size_t> next{ 0 };
+
+   std::mutex mutex;
+   std::condition_variable condition;
+   size_t finished{ 0 };
+   std::exception_ptr pException;
+};
+
+void WorkerPool::Job::Work()
+{
+   size_t completed = 0;
+   for (size_t ii; (ii = next++) < count; ++completed) {
+      try {
+         body(ii);
+      }
+      catch (...) {
+         std::lock_guard<std::mutex> guard{ mutex };
+         if (!pException)
+            pException = std::current_exception();
+      }
+   }
+   if (completed) {
+      std::lock_guard<std::mutex> guard{ mutex };
+      finished += completed;
+      if (finished == count)
+         condition.notify_all();
+   }
+}
+
+WorkerPool &WorkerPool::Get()
+{
+   static WorkerPool instance;
+   return instance;
+}
+
+WorkerPool::WorkerPool()
+{
+   const auto hardware = std::max(1u, std::thread::hardware_concurrency());
+   for (unsigned ii = 1; ii < hardware; ++ii)
+      mThreads.emplace_back([this]{ Run(); });
+}
+
+WorkerPool::~WorkerPool()
+{
+   {
+      std::lock_guard<std::mutex> guard{ mMutex };
+      mStop = true;
+   }
+   mCondition.notify_all();
+   for (auto &thread : mThreads)
+      thread.join();
+}
+
+void WorkerPool::ParallelFor(
+   size_t count, const std::function<void(size_t)> &body)
+{
+   if (count == 0)
+      return;
+   if (count == 1 || mThreads.empty()) {
+      for (size_t ii = 0; ii < count; ++ii)
+         body(ii);
+      return;
+   }
+
+   const auto pJob = std::make_shared<Job>(count, body);
+   {
+      std::lock_guard<std::mutex> guard{ mMutex };
+      mJobs.push_back(pJob);
+   }
+   mCondition.notify_all();
+
+   pJob->Work();
+
+   std::unique_lock<std::mutex> lock{ pJob->mutex };
+   pJob->condition.wait(lock, [&]{ return pJob->finished == count; });
+   if (pJob->pException)
+      std::rethrow_exception(pJob->pException);
+}
+
+bool WorkerPool::Post(std::function<void()> task)
+{
+   if (mThreads.empty())
+      return false;
+   {
+      std::lock_guard<std::mutex> guard{ mMutex };
+      mTasks.push_back(move(task));
+   }
+   mCondition.notify_one();
+   return true;
+}
+
+void WorkerPool::Run()
+{
+   while (true) {
+      std::shared_ptr<Job> pJob;
+      std::function<void()> task;
+      {
+         std::unique_lock<std::mutex> lock{ mMutex };
+         mCondition.wait(lock, [this]{
+            // Forget jobs whose indices are all claimed
+            while (!mJobs.empty() && mJobs.front()->Exhausted())
+               mJobs.pop_front();
+            return mStop || !mJobs.empty() || !mTasks.empty();
+         });
+         if (mStop)
+            break;
+         // Callers of ParallelFor() are waiting, so serve them first
+         if (!mJobs.empty())
+            pJob = mJobs.front();
+         else {
+            task = move(mTasks.front());
+            mTasks.pop_front();
+         }
+      }
+      if (pJob)
+         pJob->Work();
+      else
+         task();
+   }
+}
@@ -0,0 +1,71 @@
+/*!********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  @file WorkerPool.h
+  @brief A process-wide pool of threads for data parallel loops
+
+**********************************************************************/
+
+#ifndef __AUDACITY_WORKER_POOL__
+#define __AUDACITY_WORKER_POOL__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//! A process-wide pool of threads for data parallel loops
+/*!
+ The pool has one thread fewer than the hardware supports, because the thread
+ that calls ParallelFor() works too.  Therefore nested calls can't deadlock,
+ and with a single processor, ParallelFor() is simply a serial loop.
+ */
+class UTILITY_API WorkerPool final
+{
+public:
+   static WorkerPool &Get();
+
+   WorkerPool(const WorkerPool&) = delete;
+   WorkerPool &operator=(const WorkerPool&) = delete;
+   ~WorkerPool();
+
+   //! How many threads, counting the caller, can run ParallelFor() bodies
+   size_t GetConcurrency() const { return mThreads.size() + 1; }
+
+   //! Call body for each index from 0 to count - 1, in no particular order
+   //! and possibly at once in several threads, returning when all are done
+   /*!
+    If any calls throw, the others still run, then the first exception
+    caught is rethrown
+    */
+   void ParallelFor(size_t count, const std::function<void(size_t)> &body);
+
+   //! Call task later in one of the threads, after any waiting ParallelFor()
+   /*!
+    The pool does not report completion; task must not throw.  Tasks not yet
+    started when the pool is destroyed are destroyed without being called.
+    @return false, without calling task, if the pool has no threads
+    */
+   bool Post(std::function<void()> task);
+
+private:
+   struct Job;
+
+   WorkerPool();
+   void Run();
+
+   std::vector<std::thread> mThreads;
+   std::mutex mMutex;
+   std::condition_variable mCondition;
+   //! Jobs that may still have unclaimed indices
+   std::deque<std::shared_ptr<Job>> mJobs;
+   //! Posted tasks not yet started
+   std::deque<std::function<void()>> mTasks;
+   bool mStop{ false };
+};
+
+#endif
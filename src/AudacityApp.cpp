@@ -79,6 +79,7 @@ It handles initialization and termination by subclassing wxApp.
 #include "Benchmark.h"
 #include "Clipboard.h"
 #include "CrashReport.h" // for HAS_CRASH_REPORT
+#include "DspBenchmark.h"
 #include "commands/CommandHandler.h"
 #include "commands/AppCommandEvent.h"
 #include "widgets/ASlider.h"
@@ -95,12 +96,14 @@ It handles initialization and termination by subclassing wxApp.
 #include "ProjectFileManager.h"
 #include "ProjectHistory.h"
 #include "ProjectManager.h"
+#include "ProjectRenderer.h"
 #include "ProjectSettings.h"
 #include "ProjectWindow.h"
 #include "ProjectWindows.h"
 #include "Screenshot.h"
 #include "Sequence.h"
 #include "SelectFile.h"
+#include "StorageBenchmark.h"
 #include "TempDirectory.h"
 #include "LoadThemeResources.h"
 #include "Track.h"
@@ -1463,6 +1466,63 @@ bool AudacityApp::InitPart2()
    if (parser->Found(wxT("j"), &fileName))
       Journal::SetInputFileName( fileName );
 
+   // The storage benchmark needs no windows, so it can run on build servers
+   if (parser->Found(wxT("benchmark"), &fileName))
+   {
+      StorageBenchmarkSettings settings;
+      settings.blockBytes = Sequence::GetMaxDiskBlockSize();
+      if (parser->Found(wxT("benchmark-size"), &lval))
+      {
+         if (lval < 1 || lval > 2000)
+         {
+            wxPrintf(_("Benchmark data size must be within 1 to 2000 MB\n"));
+            exit(1);
+         }
+         settings.dataBytes = lval * 1048576ull;
+      }
+      if (parser->Found(wxT("benchmark-edits"), &lval))
+      {
+         if (lval < 1 || lval > 10000)
+         {
+            wxPrintf(_("Benchmark edits must be within 1 to 10000\n"));
+            exit(1);
+         }
+         settings.edits = lval;
+      }
+      exit(RunStorageBenchmark(fileName, settings) ? 0 : 1);
+   }
+
+   if (parser->Found(wxT("benchmark-dsp"), &fileName))
+      exit(RunDspBenchmark(fileName, {}) ? 0 : 1);
+
+   // Rendering a project file needs no windows either
+   if (parser->Found(wxT("render"), &fileName))
+   {
+      if (parser->GetParamCount() != 1)
+      {
+         wxPrintf(_("Give exactly one project file to render\n"));
+         exit(1);
+      }
+      ProjectRenderSettings settings;
+      if (parser->Found(wxT("render-rate"), &lval))
+      {
+         if (lval < 1000 || lval > 1000000)
+         {
+            wxPrintf(_("Render rate must be within 1000 to 1000000\n"));
+            exit(1);
+         }
+         settings.rate = lval;
+      }
+      TranslatableString error;
+      if (!RenderProjectToFile(
+         parser->GetParam(0), fileName, settings, &error))
+      {
+         wxPrintf("%s\n", error.Translation());
+         exit(1);
+      }
+      exit(0);
+   }
+
    // BG: Create a temporary window to set as the top window
    wxImage logoimage((const char **)AudacityLogoWithName_xpm);
    logoimage.Rescale(logoimage.GetWidth() / 2, logoimage.GetHeight() / 2);
@@ -2264,6 +2324,36 @@ std::unique_ptr<wxCmdLineParser> AudacityApp::ParseCommandLine()
 
    parser->AddOption(wxT("j"), wxT("journal"), journalOptionDescription);
 
+   /*i18n-hint: This runs timings of how Audacity stores audio, and
+    *           writes the results to the named file */
+   parser->AddLongOption(wxT("benchmark"),
+      _("time the storage of audio, writing results as JSON to a file"));
+
+   /*i18n-hint: Amount of audio for the storage benchmark */
+   parser->AddLongOption(wxT("benchmark-size"),
+      _("megabytes of audio for the storage benchmark"),
+      wxCMD_LINE_VAL_NUMBER);
+
+   /*i18n-hint: Number of random edits for the storage benchmark */
+   parser->AddLongOption(wxT("benchmark-edits"),
+      _("number of each kind of edit for the storage benchmark"),
+      wxCMD_LINE_VAL_NUMBER);
+
+   /*i18n-hint: This runs timings of signal processing, such as resampling,
+    *           and writes the results to the named file */
+   parser->AddLongOption(wxT("benchmark-dsp"),
+      _("time signal processing, writing results as JSON to a file"));
+
+   /*i18n-hint: This mixes the given project, as it would play, into the
+    *           named file, without opening any window */
+   parser->AddLongOption(wxT("render"),
+      _("mix the project to a stereo WAV file and exit"));
+
+   /*i18n-hint: Sample rate of the file made by --render */
+   parser->AddLongOption(wxT("render-rate"),
+      _("sample rate for --render, if not the project's"),
+      wxCMD_LINE_VAL_NUMBER);
+
    /*i18n-hint: This displays a list of available options */
    parser->AddSwitch(wxT("h"), wxT("help"), _("this help message"),
                      wxCMD_LINE_OPTION_HELP);
@@ -113,14 +113,18 @@ time warp info and AudioIOListener and whether the playback is looped.
 
 #include "Meter.h"
 #include "Mix.h"
+#include "PlaybackPrefetcher.h"
 #include "Resample.h"
 #include "RingBuffer.h"
+#include "SampleBlock.h"
+#include "SampleBlockCache.h"
 #include "Decibels.h"
 #include "Prefs.h"
 #include "Project.h"
 #include "ProjectWindows.h"
 #include "WaveTrack.h"
 #include "TransactionScope.h"
+#include "WorkerPool.h"
 
 #include "effects/RealtimeEffectManager.h"
 #include "QualitySettings.h"
@@ -137,6 +141,9 @@ time warp info and AudioIOListener and whether the playback is looped.
 using std::max;
 using std::min;
 
+BoolSetting AudioIORealtimeInParallel{
+   L"/AudioIO/RealtimeInParallel", false };
+
 AudioIO *AudioIO::Get()
 {
    return static_cast< AudioIO* >( AudioIOBase::Get() );
@@ -799,6 +806,12 @@ int AudioIO::StartStream(const TransportTracks &tracks,
 
    mLostSamples = 0;
    mLostCaptureIntervals.clear();
+   mStatistics.Reset();
+   mPlaybackLowWater.store(
+      std::numeric_limits<size_t>::max(), std::memory_order_relaxed);
+   mPlaybackUnderruns.store(0, std::memory_order_relaxed);
+   mCallbackJitter.store(0, std::memory_order_relaxed);
+   mLastCallbackTime = -1;
    mDetectDropouts =
       gPrefs->Read( WarningDialogKey(wxT("DropoutDetected")), true ) != 0;
    auto cleanup = finally ( [this] { ClearRecordingException(); } );
@@ -891,6 +904,7 @@ int AudioIO::StartStream(const TransportTracks &tracks,
    mPlaybackBuffers.reset();
    mScratchBuffers.clear();
    mScratchPointers.clear();
+   mpPrefetcher.reset();
    mPlaybackMixers.clear();
    mCaptureBuffers.reset();
    mResample.reset();
@@ -1078,6 +1092,12 @@ int AudioIO::StartStream(const TransportTracks &tracks,
    if (mNumCaptureChannels > 0)
       Publish({ pOwningProject.get(), AudioIOEvent::CAPTURE, true });
 
+   // Spare the audio thread the waiting for the database while it appends
+   // captured samples; blocks are stored in the background
+   for (auto &pFactory : CaptureFactories(mCaptureTracks))
+      pFactory->SetDeferredCommits(true);
+   mNewBlocksPending = false;
+
    commit = true;
    return mStreamToken;
 }
@@ -1178,9 +1198,18 @@ bool AudioIO::AllocateBuffers(
             // Always make at least one playback buffer
             mPlaybackBuffers.reinit(
                std::max<size_t>(1, mPlaybackTracks.size()));
-            // Number of scratch buffers depends on device playback channels
+            // Number of scratch buffers depends on device playback channels,
+            // and on how many groups of tracks can be transformed at once
             if (mNumPlaybackChannels > 0) {
-               mScratchBuffers.resize(mNumPlaybackChannels * 2);
+               const size_t nLeaders = std::count_if(
+                  mPlaybackTracks.begin(), mPlaybackTracks.end(),
+                  [](const auto &pTrack){ return pTrack->IsLeader(); });
+               mNumScratchSets = !AudioIORealtimeInParallel.Read()
+                  ? 1
+                  : std::max<size_t>(1, std::min(
+                     nLeaders, WorkerPool::Get().GetConcurrency()));
+               mScratchBuffers.resize(
+                  mNumScratchSets * mNumPlaybackChannels * 2);
                mScratchPointers.clear();
                for (auto &buffer : mScratchBuffers) {
                   buffer.Allocate(playbackBufferSize, floatSample);
@@ -1188,21 +1217,34 @@ bool AudioIO::AllocateBuffers(
                      reinterpret_cast<float*>(buffer.ptr()));
                }
             }
+            mpPrefetcher.reset();
             mPlaybackMixers.clear();
             mPlaybackMixers.resize(mPlaybackTracks.size());
 
             const auto &warpOptions =
                policy.MixerWarpOptions(mPlaybackSchedule);
 
+            mPlaybackLatency = times.latency;
             mPlaybackQueueMinimum = lrint( mRate * times.latency.count() );
             mPlaybackQueueMinimum =
                std::min( mPlaybackQueueMinimum, playbackBufferSize );
+            // The mixers must be able to produce the greatest amount that
+            // the policy may later want in the queue
+            mPlaybackQueueMaximum = std::min<size_t>( playbackBufferSize,
+               lrint( mRate * times.maxLatency.count() ) );
+            mPlaybackQueueMaximum =
+               std::max( mPlaybackQueueMaximum, mPlaybackQueueMinimum );
 
             if (mPlaybackTracks.empty())
                // Make at least one playback buffer
                mPlaybackBuffers[0] =
                   std::make_unique<RingBuffer>(floatSample, playbackBufferSize);
 
+            // With the cache enabled, a PlaybackPrefetcher fetches the blocks
+            // ahead of the mixers, which then need not read ahead themselves
+            auto &cache = SampleBlockCache::Get();
+            const bool prefetch = !mPlaybackTracks.empty() && cache.IsEnabled();
+
             for (unsigned int i = 0; i < mPlaybackTracks.size(); i++)
             {
                // Bug 1763 - We must fade in from zero to avoid a click on starting.
@@ -1239,15 +1281,31 @@ bool AudioIO::AllocateBuffers(
                   startTime,
                   endTime,
                   1,
-                  std::max( mPlaybackSamplesToCopy, mPlaybackQueueMinimum ),
+                  std::max( mPlaybackSamplesToCopy, mPlaybackQueueMaximum ),
                   false,
                   mRate, floatSample,
                   false, // low quality dithering and resampling
                   nullptr,
-                  false // don't apply track gains
+                  false, // don't apply track gains
+                  !prefetch
                );
             }
 
+            if (prefetch) {
+               // Read two ring buffers' worth ahead, but let the blocks of
+               // all tracks fill no more than half of the cache
+               const auto budget =
+                  0.5 * SampleBlockCacheSize.Read() * 1024 * 1024;
+               const auto lookahead = std::min(
+                  2 * mPlaybackRingBufferSecs.count(),
+                  budget / (mPlaybackTracks.size() * mRate * sizeof(float)));
+               mpPrefetcher = std::make_unique<PlaybackPrefetcher>(
+                  PlaybackPrefetcher::Tracks{
+                     mPlaybackTracks.begin(), mPlaybackTracks.end() },
+                  lookahead);
+               mPrefetchTimes.resize(mPlaybackTracks.size());
+            }
+
             const auto timeQueueSize = 1 +
                (playbackBufferSize + TimeQueueGrainSize - 1)
                   / TimeQueueGrainSize;
@@ -1317,6 +1375,7 @@ void AudioIO::StartStreamCleanup(bool bOnlyBuffers)
    mPlaybackBuffers.reset();
    mScratchBuffers.clear();
    mScratchPointers.clear();
+   mpPrefetcher.reset();
    mPlaybackMixers.clear();
    mCaptureBuffers.reset();
    mResample.reset();
@@ -1486,6 +1545,7 @@ void AudioIO::StopStream()
          mPlaybackBuffers.reset();
          mScratchBuffers.clear();
          mScratchPointers.clear();
+         mpPrefetcher.reset();
          mPlaybackMixers.clear();
          mPlaybackSchedule.mTimeQueue.Clear();
       }
@@ -1528,6 +1588,10 @@ void AudioIO::StopStream()
             } );
          }
 
+         // Wait for the background storage of the recorded blocks
+         for (auto &pFactory : CaptureFactories(mCaptureTracks))
+            GuardedCall( [&] { pFactory->SetDeferredCommits(false); } );
+
          
          if (!mLostCaptureIntervals.empty())
          {
@@ -1784,6 +1848,17 @@ size_t AudioIoCallback::GetCommonlyReadyPlayback()
    return commonlyAvail;
 }
 
+size_t AudioIoCallback::GetCommonlyFreeCapture()
+{
+   if (mNumCaptureChannels == 0 || mCaptureTracks.empty())
+      return 0;
+   auto commonlyAvail = mCaptureBuffers[0]->AvailForPut();
+   for (unsigned i = 1; i < mCaptureTracks.size(); ++i)
+      commonlyAvail = std::min(commonlyAvail,
+         mCaptureBuffers[i]->AvailForPut());
+   return commonlyAvail;
+}
+
 size_t AudioIO::GetCommonlyAvailCapture()
 {
    auto commonlyAvail = mCaptureBuffers[0]->AvailForGet();
@@ -1798,8 +1873,21 @@ size_t AudioIO::GetCommonlyAvailCapture()
 // (which communicates with the audio device).
 void AudioIO::TrackBufferExchange()
 {
+   const auto start = AudioIOStatistics::Clock::now();
+   mEffectsDuration = {};
+
    FillPlayBuffers();
    DrainRecordBuffers();
+
+   AudioIOStatistics::ExchangeRecord record;
+   record.time = mStatistics.Elapsed(start);
+   record.duration = std::chrono::duration<double>(
+      AudioIOStatistics::Clock::now() - start).count();
+   record.effectsDuration = mEffectsDuration.count();
+   record.playbackReady = mNumPlaybackChannels > 0
+      ? GetCommonlyReadyPlayback() : 0;
+   record.captureFree = GetCommonlyFreeCapture();
+   mStatistics.Record(record);
 }
 
 void AudioIO::FillPlayBuffers()
@@ -1823,6 +1911,25 @@ void AudioIO::FillPlayBuffers()
 
    auto &policy = mPlaybackSchedule.GetPolicy();
 
+   // Let the policy revise the occupancy of the queue, from what the
+   // callbacks saw since the last filling
+   {
+      const PlaybackPolicy::BufferStatistics statistics{
+         mPlaybackLowWater.exchange(
+            std::numeric_limits<size_t>::max(), std::memory_order_relaxed),
+         mPlaybackUnderruns.exchange(0, std::memory_order_relaxed),
+         PlaybackPolicy::Duration{
+            mCallbackJitter.exchange(0, std::memory_order_relaxed) }
+      };
+      const auto latency =
+         policy.AdaptLatency(mPlaybackSchedule, mPlaybackLatency, statistics);
+      if (latency != mPlaybackLatency) {
+         mPlaybackLatency = latency;
+         mPlaybackQueueMinimum = std::min<size_t>( mPlaybackQueueMaximum,
+            lrint( mRate * std::max(0.0, latency.count()) ) );
+      }
+   }
+
    // More than mPlaybackSamplesToCopy might be copied:
    // May produce a larger amount when initially priming the buffer, or
    // perhaps again later in play to avoid underfilling the queue and falling
@@ -1889,7 +1996,9 @@ void AudioIO::FillPlayBuffers()
 
    // Do any realtime effect processing, more efficiently in at most
    // two buffers per track, after all the little slices have been written.
+   const auto effectsStart = AudioIOStatistics::Clock::now();
    TransformPlayBuffers();
+   mEffectsDuration = AudioIOStatistics::Clock::now() - effectsStart;
 
    /* The flushing of all the Puts to the RingBuffers is lifted out of the
    do-loop above, and also after transformation of the stream for realtime
@@ -1901,61 +2010,129 @@ void AudioIO::FillPlayBuffers()
    */
    for (size_t i = 0; i < std::max(size_t{1}, mPlaybackTracks.size()); ++i)
       mPlaybackBuffers[i]->Flush();
+
+   // Let the readers warm the cache for the next filling
+   if (mpPrefetcher) {
+      for (size_t i = 0; i < mPlaybackMixers.size(); ++i)
+         mPrefetchTimes[i] = mPlaybackMixers[i]->MixGetCurrentTime();
+      mpPrefetcher->Request(
+         mPrefetchTimes, mPlaybackSchedule.ReversedTime());
+   }
 }
 
 void AudioIO::TransformPlayBuffers()
 {
    // Transform written but un-flushed samples in the RingBuffers in-place.
 
-   // Avoiding std::vector
-   auto pointers =
-      static_cast<float**>(alloca(mNumPlaybackChannels * sizeof(float*)));
-
    std::optional<RealtimeEffects::ProcessingScope> pScope;
    if (mpTransportState && mpTransportState->mpRealtimeInitialization)
       pScope.emplace(
          *mpTransportState->mpRealtimeInitialization, mOwningProject);
+   if (!pScope)
+      return;
+   auto &scope = *pScope;
    const auto numPlaybackTracks = mPlaybackTracks.size();
-   for (unsigned t = 0; t < numPlaybackTracks; ++t) {
-      const auto vt = mPlaybackTracks[t].get();
-      if ( vt->IsLeader() ) {
-         // vt is mono, or is the first of its group of channels
-         const auto nChannels = std::min<size_t>(
-            mNumPlaybackChannels, TrackList::Channels(vt).size());
-
-         // Loop over the blocks of unflushed data, at most two
-         for (unsigned iBlock : {0, 1}) {
-            size_t len = 0;
-            size_t iChannel = 0;
-            for (; iChannel < nChannels; ++iChannel) {
-               const auto pair =
-                  mPlaybackBuffers[t + iChannel]->GetUnflushed(iBlock);
-               // Playback RingBuffers have float format: see AllocateBuffers
-               pointers[iChannel] = reinterpret_cast<float*>(pair.first);
-               // The lengths of corresponding unflushed blocks should be
-               // the same for all channels
-               if (len == 0)
-                  len = pair.second;
-               else
-                  assert(len == pair.second);
-            }
 
-            // Are there more output device channels than channels of vt?
-            // Such as when a mono track is processed for stereo play?
-            // Then supply some non-null fake input buffers, because the
-            // various ProcessBlock overrides of effects may crash without it.
-            // But it would be good to find the fixes to make this unnecessary.
-            float **scratch = &mScratchPointers[mNumPlaybackChannels + 1];
-            while (iChannel < mNumPlaybackChannels)
-               pointers[iChannel++] = *scratch++;
-
-            if (len && pScope)
-               pScope->Process(vt, &pointers[0], mScratchPointers.data(), len);
-         }
+   if (mNumScratchSets == 1) {
+      for (unsigned t = 0; t < numPlaybackTracks; ++t)
+         if (mPlaybackTracks[t]->IsLeader())
+            TransformTrackBuffers(scope,
+               &RealtimeEffects::ProcessingScope::Process, t, 0);
+      return;
+   }
+
+   // The per-project effects are shared by all tracks, so they process the
+   // tracks in turn, in this thread
+   for (unsigned t = 0; t < numPlaybackTracks; ++t)
+      if (mPlaybackTracks[t]->IsLeader())
+         TransformTrackBuffers(scope,
+            &RealtimeEffects::ProcessingScope::ProcessProjectEffects, t, 0);
+
+   // But the effects of different tracks are independent.  Each group of
+   // leaders, interleaved so that the groups are of similar size, has its own
+   // scratch buffers, and the effects of each leader run in one thread, in
+   // the order of the blocks
+   WorkerPool::Get().ParallelFor(mNumScratchSets, [&](size_t iSet){
+      size_t iLeader = 0;
+      for (unsigned t = 0; t < numPlaybackTracks; ++t)
+         if (mPlaybackTracks[t]->IsLeader() &&
+             iLeader++ % mNumScratchSets == iSet)
+            TransformTrackBuffers(scope,
+               &RealtimeEffects::ProcessingScope::ProcessTrackEffects,
+               t, iSet);
+   });
+}
+
+void AudioIO::TransformTrackBuffers(RealtimeEffects::ProcessingScope &scope,
+   size_t (RealtimeEffects::ProcessingScope::*process)(
+      Track *, float *const *, float *const *, size_t),
+   unsigned t, size_t iScratchSet)
+{
+   // Avoiding std::vector
+   auto pointers =
+      static_cast<float**>(alloca(mNumPlaybackChannels * sizeof(float*)));
+   const auto scratchPointers =
+      &mScratchPointers[iScratchSet * mNumPlaybackChannels * 2];
+
+   const auto vt = mPlaybackTracks[t].get();
+   // vt is mono, or is the first of its group of channels
+   const auto nChannels = std::min<size_t>(
+      mNumPlaybackChannels, TrackList::Channels(vt).size());
+
+   // Loop over the blocks of unflushed data, at most two
+   for (unsigned iBlock : {0, 1}) {
+      size_t len = 0;
+      size_t iChannel = 0;
+      for (; iChannel < nChannels; ++iChannel) {
+         const auto pair =
+            mPlaybackBuffers[t + iChannel]->GetUnflushed(iBlock);
+         // Playback RingBuffers have float format: see AllocateBuffers
+         pointers[iChannel] = reinterpret_cast<float*>(pair.first);
+         // The lengths of corresponding unflushed blocks should be
+         // the same for all channels
+         if (len == 0)
+            len = pair.second;
+         else
+            assert(len == pair.second);
       }
+
+      // Are there more output device channels than channels of vt?
+      // Such as when a mono track is processed for stereo play?
+      // Then supply some non-null fake input buffers, because the
+      // various ProcessBlock overrides of effects may crash without it.
+      // But it would be good to find the fixes to make this unnecessary.
+      float **scratch = &scratchPointers[mNumPlaybackChannels + 1];
+      while (iChannel < mNumPlaybackChannels)
+         pointers[iChannel++] = *scratch++;
+
+      if (len)
+         (scope.*process)(vt, &pointers[0], scratchPointers, len);
    }
 }
 
+std::vector<SampleBlockFactoryPtr>
+AudioIO::CaptureFactories(const WaveTrackArray &tracks)
+{
+   std::vector<SampleBlockFactoryPtr> result;
+   for (auto &pTrack : tracks) {
+      auto &pFactory = pTrack->GetSampleBlockFactory();
+      if (pFactory &&
+          std::find(result.begin(), result.end(), pFactory) == result.end())
+         result.push_back(pFactory);
+   }
+   return result;
+}
+
+bool AudioIO::CaptureCommitsBacklogged() const
+{
+   // Backlogged if more than a second of captured audio awaits storage
+   const size_t limit = mRate * mCaptureTracks.size() * sizeof(float);
+   size_t pending = 0;
+   for (auto &pFactory : CaptureFactories(mCaptureTracks))
+      pending += pFactory->GetPendingCommitBytes();
+   return pending > limit;
+}
+
 void AudioIO::DrainRecordBuffers()
 {
    if (mRecordingException || mCaptureTracks.empty())
@@ -2133,9 +2310,15 @@ void AudioIO::DrainRecordBuffers()
          mRecordingSchedule.mPosition += avail / mRate;
          mRecordingSchedule.mLatencyCorrected = latencyCorrected;
 
+         // While the background storage of blocks lags behind a slow disk,
+         // postpone the listener's autosave, which would compete with it for
+         // the database
+         mNewBlocksPending = mNewBlocksPending || newBlocks;
          auto pListener = GetListener();
-         if (pListener && newBlocks)
+         if (pListener && mNewBlocksPending && !CaptureCommitsBacklogged()) {
+            mNewBlocksPending = false;
             pListener->OnAudioIONewBlocks(&mCaptureTracks);
+         }
 
          if (pScope)
             pScope->Commit();
@@ -2981,6 +3164,48 @@ int AudioIoCallback::AudioCallback(
    const PaStreamCallbackTimeInfo *timeInfo,
    const PaStreamCallbackFlags statusFlags, void * WXUNUSED(userData) )
 {
+   // Measure how close each callback comes to its deadline
+   const auto start = AudioIOStatistics::Clock::now();
+   AudioIOStatistics::CallbackRecord record;
+   record.time = mStatistics.Elapsed(start);
+   record.deadline = mRate > 0 ? framesPerBuffer / mRate : 0;
+   // Buffers may be missing only while the stream is not yet or no longer
+   // active
+   if (mStreamToken > 0) {
+      record.playbackReady = (outputBuffer && mNumPlaybackChannels > 0)
+         ? GetCommonlyReadyPlayback() : 0;
+      record.captureFree = GetCommonlyFreeCapture();
+   }
+   record.xrun = (statusFlags &
+      (paOutputUnderflow | paInputOverflow | paOutputOverflow)) != 0;
+
+   // Measurements for PlaybackPolicy::AdaptLatency()
+   if (mLastCallbackTime >= 0) {
+      const auto jitter =
+         fabs(record.time - mLastCallbackTime - mLastCallbackDeadline);
+      auto previous = mCallbackJitter.load(std::memory_order_relaxed);
+      while (jitter > previous && !mCallbackJitter.compare_exchange_weak(
+         previous, jitter, std::memory_order_relaxed))
+         ;
+   }
+   mLastCallbackTime = record.time;
+   mLastCallbackDeadline = record.deadline;
+   if (mStreamToken > 0 && outputBuffer && mNumPlaybackChannels > 0) {
+      auto previous = mPlaybackLowWater.load(std::memory_order_relaxed);
+      while (record.playbackReady < previous &&
+         !mPlaybackLowWater.compare_exchange_weak(
+            previous, record.playbackReady, std::memory_order_relaxed))
+         ;
+      if ((statusFlags & paOutputUnderflow) ||
+          record.playbackReady < framesPerBuffer)
+         mPlaybackUnderruns.fetch_add(1, std::memory_order_relaxed);
+   }
+   auto recordTiming = finally([&]{
+      record.duration = std::chrono::duration<double>(
+         AudioIOStatistics::Clock::now() - start).count();
+      mStatistics.Record(record);
+   });
+
    // Poll tracks for change of state.  User might click mute and solo buttons.
    mbHasSoloTracks = CountSoloingTracks() > 0 ;
    mCallbackReturn = paContinue;
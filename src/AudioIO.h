@@ -19,11 +19,13 @@
 #include "PlaybackSchedule.h" // member variable
 
 #include <functional>
+#include <limits>
 #include <memory>
 #include <mutex>
 #include <utility>
 #include <wx/atomic.h> // member variable
 
+#include "AudioIOStatistics.h" // member variable
 #include "ModuleInterface.h" // for PluginID
 #include "Observer.h"
 #include "SampleCount.h"
@@ -34,6 +36,7 @@ class AudioIOBase;
 class AudioIO;
 class RingBuffer;
 class Mixer;
+class PlaybackPrefetcher;
 class RealtimeEffectState;
 class Resample;
 class AudioThread;
@@ -46,6 +49,8 @@ using PlayableTrackConstArray =
 
 class Track;
 class WaveTrack;
+class SampleBlockFactory;
+using SampleBlockFactoryPtr = std::shared_ptr<SampleBlockFactory>;
 using WaveTrackArray = std::vector < std::shared_ptr < WaveTrack > >;
 using WaveTrackConstArray = std::vector < std::shared_ptr < const WaveTrack > >;
 
@@ -53,7 +58,10 @@ struct PaStreamCallbackTimeInfo;
 typedef unsigned long PaStreamCallbackFlags;
 typedef int PaError;
 
-namespace RealtimeEffects { class SuspensionScope; }
+namespace RealtimeEffects {
+   class ProcessingScope;
+   class SuspensionScope;
+}
 
 bool ValidateDeviceNames();
 
@@ -237,6 +245,10 @@ public:
    * they are different. */
    size_t GetCommonlyReadyPlayback();
 
+   /** \brief Get the number of audio samples free in all of the capture
+   * buffers, or zero if not capturing */
+   size_t GetCommonlyFreeCapture();
+
    /// How many frames of zeros were output due to pauses?
    long    mNumPauseFrames;
 
@@ -265,11 +277,19 @@ public:
    /*! Read by worker threads but unchanging during playback */
    ArrayOf<std::unique_ptr<RingBuffer>> mPlaybackBuffers;
    WaveTrackArray      mPlaybackTracks;
-   // Temporary buffers, each as large as the playback buffers
+   // Temporary buffers, each as large as the playback buffers, in sets of
+   // twice the number of playback channels
    std::vector<SampleBuffer> mScratchBuffers;
    std::vector<float *> mScratchPointers; //!< pointing into mScratchBuffers
+   //! One set of scratch buffers for each group of tracks whose realtime
+   //! effects are processed at once
+   size_t mNumScratchSets{ 1 };
 
    std::vector<std::unique_ptr<Mixer>> mPlaybackMixers;
+   //! Reads the playback tracks ahead of the mixers; may be null
+   std::unique_ptr<PlaybackPrefetcher> mpPrefetcher;
+   //! Positions of the mixers, passed to mpPrefetcher by the audio thread
+   std::vector<double> mPrefetchTimes;
 
    std::atomic<float>  mMixerOutputVol{ 1.0 };
    static int          mNextStreamToken;
@@ -286,6 +306,10 @@ public:
    size_t              mPlaybackSamplesToCopy;
    /// Occupancy of the queue we try to maintain, with bigger batches if needed
    size_t              mPlaybackQueueMinimum;
+   /// Upper bound of mPlaybackQueueMinimum when the policy adapts it
+   size_t              mPlaybackQueueMaximum;
+   /// Latency that mPlaybackQueueMinimum was last computed from
+   PlaybackPolicy::Duration mPlaybackLatency;
 
    double              mMinCaptureSecsToCopy;
    /*! Read by a worker thread but unchanging during playback */
@@ -346,7 +370,21 @@ protected:
    void ClearRecordingException()
       { if (mRecordingException) wxAtomicDec( mRecordingException ); }
 
+   AudioIOStatistics mStatistics;
+
+   //! Measured by the callback for PlaybackPolicy::AdaptLatency(), and
+   //! exchanged for initial values by the audio thread before each filling
+   std::atomic<size_t> mPlaybackLowWater{
+      std::numeric_limits<size_t>::max() };
+   std::atomic<size_t> mPlaybackUnderruns{ 0 };
+   std::atomic<double> mCallbackJitter{ 0 };
+   //! Used only by the callback to measure jitter; negative before the first
+   double mLastCallbackTime{ -1 };
+   double mLastCallbackDeadline{ 0 };
+
    std::vector< std::pair<double, double> > mLostCaptureIntervals;
+   //! Whether appends made new blocks since the listener was last told
+   bool mNewBlocksPending{ false };
    /*! Read by a worker thread but unchanging during playback */
    bool mDetectDropouts{ true };
 
@@ -362,6 +400,9 @@ public:
    // detect more dropouts
    std::atomic<bool> mDetectUpstreamDropouts{ true };
 
+   //! Timings of the latest callbacks and buffer exchanges of the stream
+   const AudioIOStatistics &GetStatistics() const { return mStatistics; }
+
 protected:
    RecordingSchedule mRecordingSchedule{};
    PlaybackSchedule mPlaybackSchedule;
@@ -566,10 +607,30 @@ private:
    //! First part of TrackBufferExchange
    void FillPlayBuffers();
    void TransformPlayBuffers();
+   //! Realtime effect processing of the unflushed samples of one leader
+   /*!
+    @param process a member function of RealtimeEffects::ProcessingScope
+    @param t index of the leader in mPlaybackTracks
+    @param iScratchSet which set of scratch buffers to use
+    */
+   void TransformTrackBuffers(RealtimeEffects::ProcessingScope &scope,
+      size_t (RealtimeEffects::ProcessingScope::*process)(
+         Track *, float *const *, float *const *, size_t),
+      unsigned t, size_t iScratchSet);
 
    //! Second part of TrackBufferExchange
    void DrainRecordBuffers();
 
+   //! Time spent in TransformPlayBuffers() by the latest TrackBufferExchange
+   std::chrono::duration<double> mEffectsDuration{};
+
+   //! Distinct factories of sample blocks used by some tracks
+   static std::vector<SampleBlockFactoryPtr>
+      CaptureFactories(const WaveTrackArray &tracks);
+
+   //! Whether storage of recorded blocks lags behind capture
+   bool CaptureCommitsBacklogged() const;
+
    /** \brief Get the number of audio samples free in all of the playback
    * buffers.
    *
@@ -605,4 +666,8 @@ private:
    bool mDelayingActions{ false };
 };
 
+//! Whether the realtime effects of different tracks are processed at once
+//! in worker threads during playback; the project's own effects never are
+extern AUDACITY_DLL_API BoolSetting AudioIORealtimeInParallel;
+
 #endif
@@ -0,0 +1,107 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file AudioIOStatistics.cpp
+
+**********************************************************************/
+
+#include "AudioIOStatistics.h"
+
+#include <wx/string.h>
+
+template<typename Record>
+void AudioIOStatistics::Ring<Record>::Reset()
+{
+   for (auto &slot : mSlots)
+      slot.sequence.store(0, std::memory_order_relaxed);
+   mCount.store(0, std::memory_order_release);
+}
+
+template<typename Record>
+void AudioIOStatistics::Ring<Record>::Push(const Record &record)
+{
+   const auto count = mCount.load(std::memory_order_relaxed);
+   auto &slot = mSlots[count % Capacity];
+   const auto sequence = slot.sequence.load(std::memory_order_relaxed);
+   slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+   std::atomic_thread_fence(std::memory_order_release);
+   slot.record = record;
+   slot.sequence.store(sequence + 2, std::memory_order_release);
+   mCount.store(count + 1, std::memory_order_release);
+}
+
+template<typename Record>
+uint64_t AudioIOStatistics::Ring<Record>::Copy(
+   std::vector<Record> &records) const
+{
+   const auto count = mCount.load(std::memory_order_acquire);
+   const auto first = count > Capacity ? count - Capacity : 0;
+   records.clear();
+   records.reserve(count - first);
+   for (auto ii = first; ii < count; ++ii) {
+      const auto &slot = mSlots[ii % Capacity];
+      // The sequence a slot has after the writing of record ii into it
+      const uint64_t expected = 2 * (ii / Capacity + 1);
+      if (slot.sequence.load(std::memory_order_acquire) != expected)
+         continue;
+      const Record record = slot.record;
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.sequence.load(std::memory_order_relaxed) != expected)
+         // The producer has lapped the reader
+         continue;
+      records.push_back(record);
+   }
+   return count;
+}
+
+void AudioIOStatistics::Reset()
+{
+   mCallbacks.Reset();
+   mExchanges.Reset();
+   mStart = Clock::now();
+}
+
+double AudioIOStatistics::Elapsed(Clock::time_point when) const
+{
+   return std::chrono::duration<double>(when - mStart).count();
+}
+
+void AudioIOStatistics::Record(const CallbackRecord &record)
+{
+   mCallbacks.Push(record);
+}
+
+void AudioIOStatistics::Record(const ExchangeRecord &record)
+{
+   mExchanges.Push(record);
+}
+
+auto AudioIOStatistics::GetSnapshot() const -> Snapshot
+{
+   Snapshot result;
+   result.nCallbacks = mCallbacks.Copy(result.callbacks);
+   result.nExchanges = mExchanges.Copy(result.exchanges);
+   return result;
+}
+
+wxString AudioIOStatistics::ToCSV(const Snapshot &snapshot)
+{
+   // Both kinds of record in one table, distinguished by the first column,
+   // with the columns that don't apply left empty
+   wxString result = wxT("kind,time,duration,deadline,effects,"
+      "playback_ready,capture_free,xrun\n");
+   for (const auto &record : snapshot.callbacks)
+      result += wxString::Format(
+         wxT("callback,%.6f,%.6f,%.6f,,%llu,%llu,%d\n"),
+         record.time, record.duration, record.deadline,
+         (unsigned long long)record.playbackReady,
+         (unsigned long long)record.captureFree, record.xrun ? 1 : 0);
+   for (const auto &record : snapshot.exchanges)
+      result += wxString::Format(
+         wxT("exchange,%.6f,%.6f,,%.6f,%llu,%llu,\n"),
+         record.time, record.duration, record.effectsDuration,
+         (unsigned long long)record.playbackReady,
+         (unsigned long long)record.captureFree);
+   return result;
+}
@@ -0,0 +1,111 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file AudioIOStatistics.h
+@brief Timings of the audio callback and of the audio thread, for tuning
+
+**********************************************************************/
+
+#ifndef __AUDACITY_AUDIO_IO_STATISTICS__
+#define __AUDACITY_AUDIO_IO_STATISTICS__
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+class wxString;
+
+//! Keeps the most recent timings of each call of the PortAudio callback and
+//! of TrackBufferExchange(), without locks or allocations in those threads
+/*!
+ Each kind of record has exactly one producing thread.  Other threads may
+ take a Snapshot() at any time; records overwritten while being copied are
+ left out of it.
+ */
+class AUDACITY_DLL_API AudioIOStatistics final
+{
+public:
+   using Clock = std::chrono::steady_clock;
+
+   //! How many of the latest records of each kind are kept
+   static constexpr size_t Capacity = 4096;
+
+   //! Written by the PortAudio callback
+   struct CallbackRecord {
+      //! Seconds from the start of the stream to the start of the callback
+      double time{};
+      //! Seconds spent in the callback
+      double duration{};
+      //! Seconds of audio the callback handled, so its deadline
+      double deadline{};
+      //! Samples per channel ready for playback when the callback began
+      size_t playbackReady{};
+      //! Samples per channel of room for capture when the callback began
+      size_t captureFree{};
+      //! Whether PortAudio reported an underflow or overflow
+      bool xrun{};
+   };
+
+   //! Written by the audio thread
+   struct ExchangeRecord {
+      //! Seconds from the start of the stream to the start of the exchange
+      double time{};
+      //! Seconds spent in TrackBufferExchange()
+      double duration{};
+      //! Seconds of that spent in realtime effects
+      double effectsDuration{};
+      //! Samples per channel ready for playback after the exchange
+      size_t playbackReady{};
+      //! Samples per channel of room for capture after the exchange
+      size_t captureFree{};
+   };
+
+   struct Snapshot {
+      std::vector<CallbackRecord> callbacks;
+      std::vector<ExchangeRecord> exchanges;
+      //! Counts of records made since Reset(), including those overwritten
+      uint64_t nCallbacks{}, nExchanges{};
+   };
+
+   //! Forget all records; call before the stream starts
+   void Reset();
+
+   //! Seconds since Reset()
+   double Elapsed(Clock::time_point when) const;
+
+   void Record(const CallbackRecord &record);
+   void Record(const ExchangeRecord &record);
+
+   Snapshot GetSnapshot() const;
+
+   //! Comma separated values, with a header line, one line per record
+   static wxString ToCSV(const Snapshot &snapshot);
+
+private:
+   //! Single producer ring, read by sequence numbers as a seqlock
+   template<typename Record> class Ring {
+   public:
+      void Reset();
+      void Push(const Record &record);
+      //! @return total count of records ever pushed
+      uint64_t Copy(std::vector<Record> &records) const;
+
+   private:
+      struct Slot {
+         //! Odd while the record is being written
+         std::atomic<uint64_t> sequence{ 0 };
+         Record record;
+      };
+      std::array<Slot, Capacity> mSlots;
+      std::atomic<uint64_t> mCount{ 0 };
+   };
+
+   Clock::time_point mStart{ Clock::now() };
+   Ring<CallbackRecord> mCallbacks;
+   Ring<ExchangeRecord> mExchanges;
+};
+
+#endif
@@ -33,7 +33,9 @@ of sample block storage.
 #include <wx/valtext.h>
 #include <wx/intl.h>
 
+#include "Dither.h"
 #include "SampleBlock.h"
+#include "SampleCodec.h"
 #include "ShuttleGui.h"
 #include "Project.h"
 #include "WaveClip.h"
@@ -68,6 +70,9 @@ private:
    void OnClear( wxCommandEvent &event );
    void OnClose( wxCommandEvent &event );
 
+   //! Report compression ratio and speed of decoding of each SampleCodec
+   void BenchmarkCodecs( size_t blockBytes, size_t dataBytes );
+
    void Printf(const TranslatableString &str);
    void HoldPrint(bool hold);
    void FlushPrint();
@@ -320,6 +325,63 @@ void BenchmarkDialog::FlushPrint()
    mToPrint = wxT("");
 }
 
+void BenchmarkDialog::BenchmarkCodecs( size_t blockBytes, size_t dataBytes )
+{
+   Printf( XO("Measuring sample block codecs...\n") );
+   wxTheApp->Yield();
+   FlushPrint();
+
+   // A few partials and some noise, at moderate level
+   const size_t count = std::max<size_t>( 1, blockBytes / sizeof(float) );
+   Floats signal{ count };
+   for (size_t i = 0; i < count; i++) {
+      const double t = i / 44100.0;
+      signal[i] = 0.3 * sin(2 * M_PI * 220 * t) +
+         0.1 * sin(2 * M_PI * 661 * t) +
+         0.001 * (rand() / (double)RAND_MAX - 0.5);
+   }
+
+   const sampleFormat formats[] = { int16Sample, int24Sample, floatSample };
+   for (auto pCodec : SampleCodec::All()) {
+      for (auto format : formats) {
+         const auto bytes = count * SAMPLE_SIZE(format);
+         SampleBuffer samples( count, format );
+         SampleBuffer decoded( count, format );
+         CopySamples( (constSamplePtr)signal.get(), floatSample,
+            samples.ptr(), format, count, DitherType::none );
+
+         std::vector<char> encoded;
+         if (!pCodec->Encode( samples.ptr(), format, count, encoded ))
+            encoded.resize( bytes );
+
+         // Decode as many blocks as make up the test data size
+         const size_t repeats = std::max<size_t>( 1, dataBytes / bytes );
+         bool good = true;
+         wxStopWatch timer;
+         for (size_t i = 0; good && i < repeats; i++)
+            good = encoded.size() >= bytes || pCodec->Decode(
+               encoded.data(), encoded.size(), decoded.ptr(), format, count );
+         const long elapsed = std::max( 1L, timer.Time() );
+
+         if (!good ||
+             (encoded.size() < bytes &&
+              memcmp( samples.ptr(), decoded.ptr(), bytes ) != 0)) {
+            Printf( XO("Codec %s failed to reproduce %s samples!\n")
+               .Format( wxString( pCodec->GetName() ),
+                  GetSampleFormatStr( format ).Translation() ) );
+            continue;
+         }
+
+         Printf( XO("Codec %s, %s: %.1f%% of original size, decoding %.1f MB/s\n")
+            .Format( wxString( pCodec->GetName() ),
+               GetSampleFormatStr( format ).Translation(),
+               100.0 * std::min( encoded.size(), bytes ) / bytes,
+               (repeats * bytes / 1048576.0) / (elapsed / 1000.0) ) );
+      }
+   }
+   FlushPrint();
+}
+
 void BenchmarkDialog::OnRun( wxCommandEvent & WXUNUSED(event))
 {
    TransferDataFromWindow();
@@ -572,6 +634,10 @@ void BenchmarkDialog::OnRun( wxCommandEvent & WXUNUSED(event))
    Printf( XO("At 44100 Hz, %d bytes per sample, the estimated number of\n simultaneous tracks that could be played at once: %.1f\n" )
       .Format( SAMPLE_SIZE(SampleFormat), (nChunks*chunkSize/44100.0)/(elapsed/1000.0) ) );
 
+   // The edit test data are constant runs, which compress unrealistically
+   // well, so codecs are measured on a signal of their own
+   BenchmarkCodecs( blockSize * 1024, dataSize * 1048576ull );
+
    goto success;
 
  fail:
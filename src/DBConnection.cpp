@@ -20,6 +20,7 @@ Paul Licameli -- split from ProjectFileIO.cpp
 #include "FileNames.h"
 #include "Internat.h"
 #include "Project.h"
+#include "SampleBlockCache.h"
 #include "FileException.h"
 #include "wxFileNameWrapper.h"
 #include "SentryHelper.h"
@@ -41,6 +42,14 @@ static const char* SafeConfig =
    "PRAGMA <schema>.journal_mode = WAL;"
    "PRAGMA <schema>.wal_autocheckpoint = 0;";
 
+// Configuration to provide "read only" connections, mapping up to 1 GB of
+// the file into memory and caching up to 256 MB of pages
+static const char *ReadOnlyConfig =
+   "PRAGMA <schema>.busy_timeout = 5000;"
+   "PRAGMA <schema>.query_only = ON;"
+   "PRAGMA <schema>.mmap_size = 1073741824;"
+   "PRAGMA <schema>.cache_size = -262144;";
+
 // Configuration to provide "Fast" connections
 static const char *FastConfig =
    "PRAGMA <schema>.busy_timeout = 5000;"
@@ -63,6 +72,8 @@ DBConnection::DBConnection(
 
 DBConnection::~DBConnection()
 {
+   // Wait for any other thread that found this connection, even closed
+   std::unique_lock<std::shared_mutex> readers{ ReadersMutex() };
    wxASSERT(mDB == nullptr);
    if (mDB)
    {
@@ -78,7 +89,29 @@ void DBConnection::SetBypass( bool bypass )
 
 bool DBConnection::ShouldBypass()
 {
-   return mBypass;
+   // Nothing can be deleted through a read-only connection
+   return mBypass || mReadOnly;
+}
+
+bool DBConnection::IsOpen() const
+{
+   return mDB != nullptr;
+}
+
+std::shared_mutex &DBConnection::ReadersMutex()
+{
+   static std::shared_mutex mutex;
+   return mutex;
+}
+
+bool DBConnection::IsReadOnly() const
+{
+   return mReadOnly;
+}
+
+bool DBConnection::InSavepoint() const
+{
+   return mSavepoints.load() > 0;
 }
 
 void DBConnection::SetError(
@@ -139,16 +172,19 @@ void DBConnection::SetDBError(
    }
 }
 
-int DBConnection::Open(const FilePath fileName)
+int DBConnection::Open(const FilePath fileName, bool readOnly)
 {
    wxASSERT(mDB == nullptr);
    int rc;
 
+   std::unique_lock<std::shared_mutex> readers{ ReadersMutex() };
+
    // Initialize checkpoint controls
    mCheckpointStop = false;
    mCheckpointPending = false;
    mCheckpointActive = false;
-   rc = OpenStepByStep( fileName );
+   mReadOnly = readOnly;
+   rc = OpenStepByStep( fileName, readOnly );
    if ( rc != SQLITE_OK)
    {
       if (mCheckpointDB)
@@ -166,12 +202,14 @@ int DBConnection::Open(const FilePath fileName)
    return rc;
 }
 
-int DBConnection::OpenStepByStep(const FilePath fileName)
+int DBConnection::OpenStepByStep(const FilePath fileName, bool readOnly)
 {
    const char *name = fileName.ToUTF8();
 
    bool success = false;
-   int rc = sqlite3_open(name, &mDB);
+   int rc = readOnly
+      ? sqlite3_open_v2(name, &mDB, SQLITE_OPEN_READONLY, nullptr)
+      : sqlite3_open(name, &mDB);
    if (rc != SQLITE_OK) 
    {
       ADD_EXCEPTION_CONTEXT("sqlite3.rc", std::to_string(rc));
@@ -184,6 +222,18 @@ int DBConnection::OpenStepByStep(const FilePath fileName)
       return rc;
    }
 
+   if (readOnly)
+   {
+      // The page size can't be changed, nor the journal mode, and without
+      // writes there is nothing to checkpoint
+      rc = ModeConfig(mDB, "main", ReadOnlyConfig);
+      if (rc != SQLITE_OK)
+      {
+         SetDBError(XO("Failed to set read only mode on primary connection to %s").Format(fileName));
+      }
+      return rc;
+   }
+
    rc = SetPageSize();
 
    if (rc != SQLITE_OK)
@@ -285,6 +335,12 @@ bool DBConnection::Close()
       mCheckpointThread.join();
    }
 
+   // Wait for reads in other threads; later ones find the connection closed
+   std::unique_lock<std::shared_mutex> readers{ ReadersMutex() };
+
+   // Cached block contents are keyed by this connection; forget them
+   SampleBlockCache::Get().Invalidate(*this);
+
    // We're done with the prepared statements
    {
       std::lock_guard<std::mutex> guard(mStatementMutex);
@@ -379,6 +435,39 @@ int DBConnection::SetPageSize(const char* schema)
    return ModeConfig(mDB, schema, PageSizeConfig);
 }
 
+sqlite3 *DBConnection::OpenWriter()
+{
+   if (!mDB || mReadOnly)
+      return nullptr;
+
+   const char *name = sqlite3_db_filename(mDB, "main");
+   sqlite3 *db = nullptr;
+   int rc = sqlite3_open(name, &db);
+   if (rc != SQLITE_OK)
+   {
+      ADD_EXCEPTION_CONTEXT("sqlite3.rc", std::to_string(rc));
+      ADD_EXCEPTION_CONTEXT("sqlite3.context", "DBConnection::OpenWriter::open");
+
+      wxLogMessage("Failed to open writer connection to %s: %d, %s\n",
+         name,
+         rc,
+         sqlite3_errstr(rc));
+      sqlite3_close(db);
+      return nullptr;
+   }
+
+   rc = ModeConfig(db, "main", SafeConfig);
+   if (rc != SQLITE_OK)
+   {
+      sqlite3_close(db);
+      return nullptr;
+   }
+
+   // Checkpoints run only when requested, so request them
+   sqlite3_wal_hook(db, CheckpointHook, this);
+   return db;
+}
+
 int DBConnection::ModeConfig(sqlite3 *db, const char *schema, const char *config)
 {
    // Ensure attached DB connection gets configured
@@ -617,11 +706,15 @@ bool DBConnectionTransactionScopeImpl::TransactionStart(const wxString &name)
 {
    char *errmsg = nullptr;
 
+   // Count the savepoint before its reads can begin
+   ++mConnection.mSavepoints;
    int rc = sqlite3_exec(mConnection.DB(),
                          wxT("SAVEPOINT ") + name + wxT(";"),
                          nullptr,
                          nullptr,
                          &errmsg);
+   if (rc != SQLITE_OK)
+      --mConnection.mSavepoints;
 
    if (errmsg)
    {
@@ -646,6 +739,8 @@ bool DBConnectionTransactionScopeImpl::TransactionCommit(const wxString &name)
                          nullptr,
                          nullptr,
                          &errmsg);
+   if (rc == SQLITE_OK)
+      --mConnection.mSavepoints;
 
    if (errmsg)
    {
@@ -18,6 +18,7 @@ Paul Licameli -- split from ProjectFileIO.h
 #include <map>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <thread>
 
 #include "ClientData.h"
@@ -49,9 +50,39 @@ public:
       CheckpointFailureCallback callback);
    ~DBConnection();
 
-   int Open(const FilePath fileName);
+   //! Open the database, for reading and writing, or else only for reading
+   /*!
+    A read-only connection maps the file into memory, keeps a larger cache
+    of pages, and starts no checkpoint thread, which makes opening and
+    scanning of large projects faster.  It never deletes sample blocks.
+    */
+   int Open(const FilePath fileName, bool readOnly = false);
    bool Close();
 
+   //! Whether Open() succeeded and Close() was not called since
+   bool IsOpen() const;
+   bool IsReadOnly() const;
+
+   //! Whether a TransactionScope holds a savepoint of this connection
+   /*! Safe to call from any thread.  A savepoint held since before another
+    connection's commit may not see its rows */
+   bool InSavepoint() const;
+
+   //! The waveform display worker holds this shared while it reads sample
+   //! blocks, whose connection the project may meanwhile close
+   /*!
+    Open(), Close() and destruction of a connection hold it exclusively, so
+    that closing waits for such a read to finish, and a later read finds the
+    connection closed and fails.  Other background reads (playback prefetch,
+    mixer read-ahead, parallel rendering) don't take it; their owners finish
+    them before the project can close.
+
+    The mutex is process-wide rather than per connection, because it must
+    outlive the connection it guards; so a read for one project can delay
+    opening or closing another.  Keep the reads that hold it short.
+    */
+   static std::shared_mutex &ReadersMutex();
+
    //! throw and show appropriate message box
    [[noreturn]] void ThrowException(
       bool write //!< If true, a database update failed; if false, only a SELECT failed
@@ -61,6 +92,15 @@ public:
    int FastMode(const char* schema = "main");
    int SetPageSize(const char* schema = "main");
 
+   //! Open another connection to the same database, for writing from a
+   //! thread of its own without joining the transactions of this one
+   /*!
+    Its commits request checkpoints as this connection's do.  The caller must
+    close it with sqlite3_close() before this connection is closed.
+    @return null on failure, or if this connection is read-only
+    */
+   sqlite3 *OpenWriter();
+
    bool Assign(sqlite3 *handle);
    sqlite3 *Detach();
 
@@ -71,14 +111,20 @@ public:
 
    enum StatementID
    {
-      GetSamples,
-      GetSummary256,
-      GetSummary64k,
+      GetSamplesBatch,
       LoadSampleBlock,
       InsertSampleBlock,
       DeleteSampleBlock,
       GetSampleBlockSize,
-      GetAllSampleBlocksSize
+      GetAllSampleBlocksSize,
+      CheckSpectrumTiles,
+      LoadSpectrumTile,
+      TouchSpectrumTile,
+      SaveSpectrumTile,
+      GetSpectrumTilesSize,
+      GetSpectrumTilesByUse,
+      GetSpectrumTilesLastUse,
+      DeleteSpectrumTile
    };
    sqlite3_stmt *Prepare(enum StatementID id, const char *sql);
 
@@ -98,7 +144,7 @@ public:
       int errorCode = -1);
 
 private:
-   int OpenStepByStep(const FilePath fileName);
+   int OpenStepByStep(const FilePath fileName, bool readOnly);
    int ModeConfig(sqlite3 *db, const char *schema, const char *config);
 
    void CheckpointThread(sqlite3 *db, const FilePath &fileName);
@@ -125,6 +171,13 @@ private:
 
    // Bypass transactions if database will be deleted after close
    bool mBypass;
+
+   bool mReadOnly{ false };
+
+   friend struct DBConnectionTransactionScopeImpl;
+   //! Count of savepoints of TransactionScope, raised before each begins and
+   //! lowered after each ends, by the thread that uses the connection
+   std::atomic<int> mSavepoints{ 0 };
 };
 
 using Connection = std::unique_ptr<DBConnection>;
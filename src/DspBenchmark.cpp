@@ -0,0 +1,415 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  @file DspBenchmark.cpp
+  @brief Timings of signal processing kernels, without user interface
+
+**********************************************************************/
+
+#include "DspBenchmark.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <wx/ffile.h>
+
+#include "Dither.h"
+#include "FFT.h"
+#include "MemoryX.h"
+#include "RealFFTf.h"
+#include "Resample.h"
+#include "SampleFormat.h"
+#include "VectorOps.h"
+#include "commands/CommandTargets.h"
+
+namespace {
+
+struct Result {
+   wxString name;
+   double seconds;
+   //! Channel-seconds of audio processed
+   double audioSeconds;
+};
+
+class Stopwatch
+{
+public:
+   using Clock = std::chrono::steady_clock;
+   double Seconds() const
+   {
+      return std::chrono::duration<double>(Clock::now() - mStart).count();
+   }
+
+private:
+   const Clock::time_point mStart{ Clock::now() };
+};
+
+//! A tone sweeping through the spectrum, with some noise
+void FillSignal(float *buffer, size_t count, double rate)
+{
+   double phase = 0;
+   for (size_t ii = 0; ii < count; ++ii) {
+      const auto frequency = 50.0 + (rate / 2 - 100.0) * ii / count;
+      phase += 2 * M_PI * frequency / rate;
+      const auto noise = static_cast<uint32_t>(ii * 2654435761u) >> 20;
+      buffer[ii] = 0.5f * static_cast<float>(sin(phase)) +
+         (static_cast<float>(noise) - 2048.0f) / 65536.0f;
+   }
+}
+
+class DspBenchmark
+{
+public:
+   explicit DspBenchmark(const DspBenchmarkSettings &settings)
+      : mSettings{ settings }
+      , mTotal{ std::max<size_t>(1, lrint(settings.seconds * settings.rate)) }
+      , mSignal{ mTotal }
+   {
+      FillSignal(mSignal.get(), mTotal, settings.rate);
+   }
+
+   void RunResample();
+   void RunSummaries();
+   void RunConversions();
+   void RunFFT();
+
+   std::vector<Result> mResults;
+   bool mVerified{ true };
+
+private:
+   //! Resample all of the signal in chunks as Mixer does, and check the
+   //! length of the output
+   void Resample1(const wxString &name, Resample &resample, bool variable);
+   //! The signal in one sample format, contiguous and also interleaved
+   //! with gaps
+   struct Samples {
+      sampleFormat format;
+      SampleBuffer contiguous, strided;
+   };
+   //! Convert all of the signal between two formats as export does, and
+   //! check the vectorized output against the scalar output
+   void Convert1(const Samples &src, sampleFormat dstFormat,
+      DitherType ditherType);
+   //! Transform all of the signal in consecutive windows of one size
+   void FFT1(size_t windowSize);
+
+   const DspBenchmarkSettings mSettings;
+   const size_t mTotal;
+   Floats mSignal;
+};
+
+void DspBenchmark::Resample1(
+   const wxString &name, Resample &resample, bool variable)
+{
+   // Mixer's chunk sizes for variable rates
+   constexpr size_t processLen = 1024, outLen = 4096;
+   const auto factor = mSettings.outputRate / mSettings.rate;
+   // PRL:  Bug2536: see Mixer::MixVariableRates
+   Floats output{ outLen + 1 };
+   size_t produced = 0;
+
+   Stopwatch stopwatch;
+   for (size_t done = 0;;) {
+      const auto len = std::min(processLen, mTotal - done);
+      const bool last = (len < processLen);
+      const auto results = resample.Process(
+         // Vary the factor slightly, as a time track would
+         variable ? factor * (1.0 + 0.01 * ((done / processLen) % 2)) : factor,
+         mSignal.get() + done, len, last, output.get(), outLen);
+      done += results.first;
+      produced += results.second;
+      if (last && results.first == len && results.second == 0)
+         break;
+   }
+   mResults.push_back({ name, stopwatch.Seconds(), mSettings.seconds });
+
+   if (!variable)
+      mVerified = fabs(produced - mTotal * factor) <= 2 && mVerified;
+   else
+      mVerified = produced > 0 && mVerified;
+}
+
+void DspBenchmark::RunResample()
+{
+   const auto factor = mSettings.outputRate / mSettings.rate;
+   // The same choices as Resample::FastMethodSetting
+   static const wxString methods[] = {
+      wxT("low"), wxT("medium"), wxT("high"), wxT("best")
+   };
+   for (int method = 0; method < 4; ++method) {
+      Resample resample{ method, factor, factor };
+      Resample1(wxT("resample_constant_") + methods[method], resample, false);
+   }
+   // Variable rates always use one method
+   Resample resample{ 0, factor, factor * 1.01 };
+   Resample1(wxT("resample_variable"), resample, true);
+}
+
+void DspBenchmark::RunSummaries()
+{
+   // Frames as in the summaries of sample blocks, and passes enough for
+   // a measurable time
+   constexpr size_t frameSamples = 256, passes = 20;
+   const auto frames = (mTotal + frameSamples - 1) / frameSamples;
+   const auto frameLength = [&](size_t frame){
+      return std::min(frameSamples, mTotal - frame * frameSamples);
+   };
+   Floats triples{ 3 * frames }, reference{ 3 * frames };
+
+   {
+      Stopwatch stopwatch;
+      for (size_t pass = 0; pass < passes; ++pass)
+         for (size_t frame = 0; frame < frames; ++frame) {
+            const auto len = frameLength(frame);
+            const auto result =
+               SummarizeSamples(&mSignal[frame * frameSamples], len);
+            triples[3 * frame] = result.min;
+            triples[3 * frame + 1] = result.max;
+            triples[3 * frame + 2] = sqrt(result.sumsq / len);
+         }
+      mResults.push_back({ wxT("summarize_samples"),
+         stopwatch.Seconds(), passes * mSettings.seconds });
+   }
+
+   {
+      // The loop that SummarizeSamples replaced, for comparison
+      Stopwatch stopwatch;
+      for (size_t pass = 0; pass < passes; ++pass)
+         for (size_t frame = 0; frame < frames; ++frame) {
+            const auto len = frameLength(frame);
+            const auto pv = &mSignal[frame * frameSamples];
+            float min = FLT_MAX, max = -FLT_MAX, sumsq = 0;
+            for (size_t ii = 0; ii < len; ++ii) {
+               min = std::min(min, pv[ii]);
+               max = std::max(max, pv[ii]);
+               sumsq += pv[ii] * pv[ii];
+            }
+            reference[3 * frame] = min;
+            reference[3 * frame + 1] = max;
+            reference[3 * frame + 2] = sqrt(sumsq / len);
+         }
+      mResults.push_back({ wxT("summarize_samples_scalar"),
+         stopwatch.Seconds(), passes * mSettings.seconds });
+   }
+
+   // Extremes must agree exactly; sums only to rounding
+   for (size_t ii = 0; ii < 3 * frames; ii += 3)
+      mVerified = triples[ii] == reference[ii] &&
+         triples[ii + 1] == reference[ii + 1] &&
+         fabs(triples[ii + 2] - reference[ii + 2]) <=
+            1e-5f * reference[ii + 2] &&
+         mVerified;
+
+   {
+      // Each triple stands for frameSamples samples; summarize all many
+      // times over, as for 64k summaries and for zoomed-out waveforms
+      constexpr size_t triplePasses = passes * frameSamples;
+      float min = FLT_MAX, max = -FLT_MAX;
+      Stopwatch stopwatch;
+      for (size_t pass = 0; pass < triplePasses; ++pass) {
+         const auto result = SummarizeTriples(triples.get(), frames);
+         min = std::min(min, result.min);
+         max = std::max(max, result.max);
+      }
+      mResults.push_back({ wxT("summarize_triples"),
+         stopwatch.Seconds(), triplePasses * mSettings.seconds });
+      const auto whole = SummarizeSamples(mSignal.get(), mTotal);
+      mVerified = min == whole.min && max == whole.max && mVerified;
+   }
+}
+
+void DspBenchmark::Convert1(
+   const Samples &src, sampleFormat dstFormat, DitherType ditherType)
+{
+   static const wxString ditherNames[] = {
+      wxT("none"), wxT("rectangle"), wxT("triangle"), wxT("shaped")
+   };
+   const auto formatName = [](sampleFormat format) -> wxString {
+      switch (format) {
+      case int16Sample: return wxT("int16");
+      case int24Sample: return wxT("int24");
+      default: return wxT("float");
+      }
+   };
+   const auto name = wxT("convert_") + formatName(src.format) + wxT("_") +
+      formatName(dstFormat) + wxT("_") + ditherNames[ditherType];
+   const auto dstSize = SAMPLE_SIZE(dstFormat);
+   SampleBuffer output{ mTotal, dstFormat }, reference{ 2 * mTotal, dstFormat };
+   Dither dither;
+
+   {
+      // Contiguous buffers take the vectorized paths where there are any
+      srand(1);
+      Stopwatch stopwatch;
+      dither.Apply(ditherType, src.contiguous.ptr(), src.format,
+         output.ptr(), dstFormat, mTotal);
+      mResults.push_back({ name, stopwatch.Seconds(), mSettings.seconds });
+   }
+
+   {
+      // Strides force the scalar loops, for comparison; the same seed
+      // gives the same noise
+      srand(1);
+      Stopwatch stopwatch;
+      dither.Apply(ditherType, src.strided.ptr(), src.format,
+         reference.ptr(), dstFormat, mTotal, 2, 2);
+      mResults.push_back({ name + wxT("_scalar"),
+         stopwatch.Seconds(), mSettings.seconds });
+   }
+
+   // The paths must agree exactly
+   bool same = true;
+   for (size_t ii = 0; same && ii < mTotal; ++ii)
+      same = memcmp(output.ptr() + ii * dstSize,
+         reference.ptr() + 2 * ii * dstSize, dstSize) == 0;
+   mVerified = same && mVerified;
+}
+
+void DspBenchmark::RunConversions()
+{
+   // Go slightly past full scale, so that clipping is exercised too
+   Floats loud{ mTotal };
+   std::transform(mSignal.get(), mSignal.get() + mTotal, loud.get(),
+      [](float sample){ return 2.2f * sample; });
+   Dither dither;
+   const auto makeSamples = [&](sampleFormat format){
+      Samples samples{ format, { mTotal, format }, { 2 * mTotal, format } };
+      dither.Apply(DitherType::none, (constSamplePtr)loud.get(), floatSample,
+         samples.contiguous.ptr(), format, mTotal);
+      dither.Apply(DitherType::none, (constSamplePtr)loud.get(), floatSample,
+         samples.strided.ptr(), format, mTotal, 1, 2);
+      return samples;
+   };
+   const auto int16 = makeSamples(int16Sample),
+      int24 = makeSamples(int24Sample), floats = makeSamples(floatSample);
+
+   // Conversions to wider formats never dither
+   Convert1(int16, floatSample, DitherType::none);
+   Convert1(int24, floatSample, DitherType::none);
+   Convert1(int16, int24Sample, DitherType::none);
+
+   // Each choice of Dither::FastSetting and Dither::BestSetting for the
+   // conversions to narrower formats
+   for (auto ditherType : { DitherType::none, DitherType::rectangle,
+      DitherType::triangle, DitherType::shaped }) {
+      Convert1(int24, int16Sample, ditherType);
+      Convert1(floats, int16Sample, ditherType);
+      Convert1(floats, int24Sample, ditherType);
+   }
+}
+
+void DspBenchmark::FFT1(size_t windowSize)
+{
+   const auto windows = mTotal / windowSize;
+   if (windows == 0)
+      return;
+   const auto seconds = windows * windowSize / mSettings.rate;
+   const auto suffix = wxString::Format(wxT("_%d"), (int)windowSize);
+   const auto hFFT = GetFFT(windowSize);
+   const auto half = windowSize / 2;
+   Floats buffer{ windowSize };
+   Floats real{ windowSize }, imag{ windowSize };
+   Floats complexReal{ windowSize }, complexImag{ windowSize };
+
+   {
+      Stopwatch stopwatch;
+      for (size_t ii = 0; ii < windows; ++ii) {
+         std::copy_n(&mSignal[ii * windowSize], windowSize, buffer.get());
+         RealFFTf(buffer.get(), hFFT.get());
+      }
+      mResults.push_back(
+         { wxT("fft_real") + suffix, stopwatch.Seconds(), seconds });
+   }
+
+   {
+      Stopwatch stopwatch;
+      for (size_t ii = 0; ii < windows; ++ii) {
+         std::copy_n(&mSignal[ii * windowSize], windowSize, buffer.get());
+         InverseRealFFTf(buffer.get(), hFFT.get());
+      }
+      mResults.push_back(
+         { wxT("fft_real_inverse") + suffix, stopwatch.Seconds(), seconds });
+   }
+
+   {
+      // The plain complex transform, for comparison
+      Stopwatch stopwatch;
+      for (size_t ii = 0; ii < windows; ++ii)
+         FFT(windowSize, false, &mSignal[ii * windowSize], nullptr,
+            complexReal.get(), complexImag.get());
+      mResults.push_back(
+         { wxT("fft_complex") + suffix, stopwatch.Seconds(), seconds });
+   }
+
+   // The last window transformed both ways must agree, to rounding
+   std::copy_n(&mSignal[(windows - 1) * windowSize], windowSize, buffer.get());
+   RealFFTf(buffer.get(), hFFT.get());
+   ReorderToFreq(hFFT.get(), buffer.get(), real.get(), imag.get());
+   float peak = 0, error = 0;
+   for (size_t ii = 0; ii <= half; ++ii) {
+      peak = std::max(peak, std::hypot(complexReal[ii], complexImag[ii]));
+      error = std::max(error, std::hypot(
+         real[ii] - complexReal[ii], imag[ii] - complexImag[ii]));
+   }
+   mVerified = error <= 1e-4f * peak && mVerified;
+}
+
+void DspBenchmark::RunFFT()
+{
+   // Sizes about those of spectrograms, the spectrum analyst, and
+   // noise reduction
+   for (size_t windowSize : { 512, 2048, 8192 })
+      FFT1(windowSize);
+}
+
+}
+
+bool RunDspBenchmark(
+   const FilePath &resultPath, const DspBenchmarkSettings &settings)
+{
+   DspBenchmark benchmark{ settings };
+   benchmark.RunResample();
+   benchmark.RunSummaries();
+   benchmark.RunConversions();
+   benchmark.RunFFT();
+
+   StringMessageTarget target;
+   target.StartStruct();
+   target.StartField(wxT("settings"));
+   target.StartStruct();
+   target.AddItem(settings.seconds, wxT("seconds"));
+   target.AddItem(settings.rate, wxT("rate"));
+   target.AddItem(settings.outputRate, wxT("output_rate"));
+   target.EndStruct();
+   target.EndField();
+   target.StartField(wxT("results"));
+   target.StartArray();
+   for (const auto &result : benchmark.mResults) {
+      target.StartStruct();
+      target.AddItem(result.name, wxT("name"));
+      target.AddItem(result.seconds, wxT("seconds"));
+      target.AddItem(result.audioSeconds, wxT("channel_seconds"));
+      target.AddItem(result.audioSeconds > 0
+         ? result.seconds / result.audioSeconds : 0.0,
+         wxT("seconds_per_channel_second"));
+      target.AddItem(result.seconds > 0
+         ? result.audioSeconds * settings.rate / result.seconds : 0.0,
+         wxT("samples_per_second"));
+      target.EndStruct();
+   }
+   target.EndArray();
+   target.EndField();
+   target.AddBool(benchmark.mVerified, wxT("verified"));
+   target.EndStruct();
+
+   wxFFile file{ resultPath, wxT("w") };
+   const bool written = file.IsOpened() &&
+      file.Write(target.GetText() + wxT("\n")) && file.Close();
+   return written && benchmark.mVerified;
+}
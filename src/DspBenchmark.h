@@ -0,0 +1,34 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  @file DspBenchmark.h
+  @brief Timings of signal processing kernels, without user interface
+
+**********************************************************************/
+
+#ifndef __AUDACITY_DSP_BENCHMARK__
+#define __AUDACITY_DSP_BENCHMARK__
+
+#include "Identifier.h"
+
+//! Sizes for RunDspBenchmark()
+struct DspBenchmarkSettings {
+   //! Seconds of mono audio given to each kernel
+   double seconds{ 60.0 };
+   double rate{ 44100.0 };
+   //! Rate to which the audio is resampled
+   double outputRate{ 48000.0 };
+};
+
+//! Time each kernel over the same synthetic signal, and write the results to
+//! a file as JSON, with the processor time per channel-second of audio
+/*!
+ @return false if the results could not be written, or if any kernel gave
+ wrong output, which the results also report
+ */
+AUDACITY_DLL_API
+bool RunDspBenchmark(
+   const FilePath &resultPath, const DspBenchmarkSettings &settings);
+
+#endif
@@ -0,0 +1,142 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file PlaybackPrefetcher.cpp
+@brief Implements PlaybackPrefetcher
+
+**********************************************************************/
+
+#include "PlaybackPrefetcher.h"
+
+#include <algorithm>
+
+#include "MemoryX.h"
+#include "SampleTrack.h"
+
+PlaybackPrefetcher::PlaybackPrefetcher(Tracks tracks, double lookahead)
+   : mTracks{ move(tracks) }
+   , mLookahead{ std::max(0.0, lookahead) }
+   , mNumReaders{ std::min(MaxReaders, mTracks.size()) }
+   , mRanges(mTracks.size())
+{
+   for (size_t iReader = 0; iReader < mNumReaders; ++iReader)
+      mThreads.emplace_back([this, iReader]{ Run(iReader); });
+}
+
+PlaybackPrefetcher::~PlaybackPrefetcher()
+{
+   {
+      std::lock_guard<std::mutex> guard(mMutex);
+      mStop = true;
+      // Make readers abandon their work between blocks
+      ++mGeneration;
+   }
+   mCondition.notify_all();
+   for (auto &thread : mThreads)
+      thread.join();
+}
+
+void PlaybackPrefetcher::Request(
+   const std::vector<double> &times, bool backwards)
+{
+   {
+      std::lock_guard<std::mutex> guard(mMutex);
+      mTimes = times;
+      mBackwards = backwards;
+      ++mGeneration;
+   }
+   mCondition.notify_all();
+}
+
+void PlaybackPrefetcher::Run(size_t iReader)
+{
+   const auto nReaders = mNumReaders;
+   size_t bufferSize = 0;
+   for (auto ii = iReader; ii < mTracks.size(); ii += nReaders)
+      bufferSize = std::max(bufferSize, mTracks[ii]->GetMaxBlockSize());
+   Floats buffer{ bufferSize };
+
+   unsigned generation = 0;
+   std::vector<double> times;
+   bool backwards = false;
+   while (true) {
+      {
+         std::unique_lock<std::mutex> lock(mMutex);
+         mCondition.wait(lock, [&]{
+            return mStop || mGeneration.load() != generation;
+         });
+         if (mStop)
+            return;
+         generation = mGeneration.load();
+         times = mTimes;
+         backwards = mBackwards;
+      }
+      for (auto ii = iReader; ii < mTracks.size() && ii < times.size();
+           ii += nReaders)
+         if (!Prefetch(ii, times[ii], backwards, generation, buffer.get()))
+            break;
+   }
+}
+
+bool PlaybackPrefetcher::Prefetch(size_t iTrack, double t, bool backwards,
+   unsigned generation, float *buffer)
+{
+   const auto &track = *mTracks[iTrack];
+   auto &range = mRanges[iTrack];
+   const auto trackStart = track.TimeToLongSamples(track.GetStartTime());
+   const auto trackEnd = track.TimeToLongSamples(track.GetEndTime());
+   const auto position =
+      std::max(trackStart, std::min(trackEnd, track.TimeToLongSamples(t)));
+   auto read = [&](sampleCount start, size_t len){
+      // Reading puts the blocks in the cache; the samples themselves are
+      // not needed here.  A failure will recur, and be handled, in the mixer.
+      try {
+         track.GetFloats(buffer, start, len, fillZero, false);
+      }
+      catch (...) {
+      }
+   };
+
+   if (!backwards) {
+      const auto end = std::min(trackEnd,
+         track.TimeToLongSamples(t + mLookahead));
+      // Continue from where reading stopped, if the mixer is still there
+      auto start = position;
+      if (range.start <= position && position <= range.end)
+         start = range.end;
+      else
+         range = { position, position };
+      while (start < end) {
+         if (mGeneration.load() != generation)
+            return false;
+         const auto len = limitSampleBufferSize(
+            track.GetBestBlockSize(start), end - start);
+         read(start, len);
+         start += len;
+         range.end = start;
+      }
+   }
+   else {
+      const auto start = std::max(trackStart,
+         track.TimeToLongSamples(t - mLookahead));
+      auto end = position;
+      if (range.start <= position && position <= range.end)
+         end = range.start;
+      else
+         range = { position, position };
+      while (start < end) {
+         if (mGeneration.load() != generation)
+            return false;
+         // Read back to the start of the block before end
+         const auto blockStart = track.GetBlockStart(end - 1);
+         const auto first = std::max(start,
+            blockStart >= 0 ? blockStart : end - track.GetMaxBlockSize());
+         const auto len = (end - first).as_size_t();
+         read(first, len);
+         end = first;
+         range.start = end;
+      }
+   }
+   return true;
+}
@@ -0,0 +1,89 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file PlaybackPrefetcher.h
+@brief Declare PlaybackPrefetcher, which reads sample blocks ahead of playback
+
+**********************************************************************/
+
+#ifndef __AUDACITY_PLAYBACK_PREFETCHER__
+#define __AUDACITY_PLAYBACK_PREFETCHER__
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "SampleCount.h"
+
+class SampleTrack;
+
+///\brief Reads the tracks of playback a little ahead of their mixers, on
+/// threads of its own, so that the audio thread finds the blocks it needs in
+/// SampleBlockCache and a slow read of one track delays no other
+/*!
+ Each reader thread serves a group of tracks.  Reading only fills the
+ cache, so samples played are the same whether or not a reader keeps up.
+ */
+class AUDACITY_DLL_API PlaybackPrefetcher final
+{
+public:
+   using Tracks = std::vector<std::shared_ptr<const SampleTrack>>;
+
+   //! Most reader threads, each serving one group of tracks
+   static constexpr size_t MaxReaders = 4;
+
+   /*!
+    @param tracks in the order of the times later passed to Request()
+    @param lookahead seconds of track time to read ahead of each mixer
+    */
+   PlaybackPrefetcher(Tracks tracks, double lookahead);
+   PlaybackPrefetcher(const PlaybackPrefetcher&) = delete;
+   PlaybackPrefetcher &operator=(const PlaybackPrefetcher&) = delete;
+   //! Stops the readers, waiting only for reads in progress
+   ~PlaybackPrefetcher();
+
+   //! Give the readers new positions, abandoning reads for older ones
+   /*!
+    Called by the audio thread after each filling of the playback buffers.
+    Does not wait for reads.
+    @param times the track time of each mixer, as from
+    Mixer::MixGetCurrentTime()
+    @param backwards whether play goes toward earlier times
+    */
+   void Request(const std::vector<double> &times, bool backwards);
+
+private:
+   //! Samples already read for one track, since its last change of position
+   struct Range {
+      sampleCount start{ 0 };
+      sampleCount end{ 0 };
+   };
+
+   void Run(size_t iReader);
+   //! @return false if a newer request came before reading was done
+   /*! @param buffer for at least the maximum block size of the track */
+   bool Prefetch(size_t iTrack, double t, bool backwards, unsigned generation,
+      float *buffer);
+
+   const Tracks mTracks;
+   const double mLookahead;
+   const size_t mNumReaders;
+
+   std::mutex mMutex;
+   std::condition_variable mCondition;
+   std::vector<double> mTimes;
+   bool mBackwards{ false };
+   bool mStop{ false };
+   //! Counts requests; written with mMutex held, but read by readers without
+   std::atomic<unsigned> mGeneration{ 0 };
+
+   //! Each element is used only by the reader of that track
+   std::vector<Range> mRanges;
+   std::vector<std::thread> mThreads;
+};
+
+#endif
@@ -13,11 +13,13 @@
 #include "AudioIOBase.h"
 #include "Envelope.h"
 #include "Mix.h"
+#include "Prefs.h"
 #include "Project.h"
 #include "ProjectAudioIO.h"
 #include "SampleCount.h"
 #include "ViewInfo.h" // for PlayRegionEvent
 
+#include <algorithm>
 #include <cmath>
 
 PlaybackPolicy::~PlaybackPolicy() = default;
@@ -72,6 +74,12 @@ std::chrono::milliseconds PlaybackPolicy::SleepInterval(PlaybackSchedule &)
    return 10ms;
 }
 
+PlaybackPolicy::Duration PlaybackPolicy::AdaptLatency(
+   PlaybackSchedule &, Duration latency, const BufferStatistics &)
+{
+   return latency;
+}
+
 PlaybackSlice
 PlaybackPolicy::GetPlaybackSlice(PlaybackSchedule &schedule, size_t available)
 {
@@ -150,6 +158,74 @@ const PlaybackPolicy &PlaybackSchedule::GetPolicy() const
    return const_cast<PlaybackSchedule&>(*this).GetPolicy();
 }
 
+BoolSetting AdaptivePlaybackBuffers{
+   L"/AudioIO/AdaptivePlaybackBuffers", false };
+
+namespace {
+//! Bounds of the adaptive latency, in seconds
+constexpr PlaybackPolicy::Duration
+   MinAdaptiveLatency{ 0.02 }, MaxAdaptiveLatency{ 2.0 };
+//! Fillings in a row with well filled buffers before the latency shrinks
+constexpr size_t CalmFillsToShrink = 50;
+}
+
+AdaptivePlaybackPolicy::~AdaptivePlaybackPolicy() = default;
+
+void AdaptivePlaybackPolicy::Initialize(
+   PlaybackSchedule &schedule, double rate )
+{
+   PlaybackPolicy::Initialize(schedule, rate);
+   mLatency = SuggestedBufferTimes(schedule).latency;
+   mCalmFills = 0;
+}
+
+PlaybackPolicy::BufferTimes
+AdaptivePlaybackPolicy::SuggestedBufferTimes(PlaybackSchedule &)
+{
+   // Start low, like the new default policy; small batches, so that the
+   // buffers can be kept near a low latency; a ring buffer that can hold the
+   // greatest latency and a batch besides
+   using namespace std::chrono;
+   return { 0.02s, 0.1s, MaxAdaptiveLatency + 0.5s, MaxAdaptiveLatency };
+}
+
+std::chrono::milliseconds
+AdaptivePlaybackPolicy::SleepInterval(PlaybackSchedule &)
+{
+   // Wake several times within the latency, but not too often
+   using namespace std::chrono;
+   const auto interval = duration_cast<milliseconds>(mLatency / 5);
+   return std::clamp<milliseconds>(interval, 2ms, 20ms);
+}
+
+PlaybackPolicy::Duration AdaptivePlaybackPolicy::AdaptLatency(
+   PlaybackSchedule &, Duration latency, const BufferStatistics &statistics)
+{
+   // Never less than what irregular callbacks need
+   const auto floor = std::clamp<Duration>(
+      4 * statistics.jitter, MinAdaptiveLatency, MaxAdaptiveLatency);
+   const bool noCallbacks =
+      (statistics.lowWater == std::numeric_limits<size_t>::max());
+   const auto margin = noCallbacks
+      ? latency : Duration{ statistics.lowWater / mRate };
+
+   if (statistics.underruns > 0 || margin < latency / 4) {
+      // Grow fast when the callbacks nearly ran dry
+      latency *= 2;
+      mCalmFills = 0;
+   }
+   else if (margin > latency / 2 && ++mCalmFills >= CalmFillsToShrink) {
+      // Shrink slowly when they did not come close
+      latency *= 0.9;
+      mCalmFills = 0;
+   }
+   else if (margin <= latency / 2)
+      mCalmFills = 0;
+
+   mLatency = std::clamp<Duration>(latency, floor, MaxAdaptiveLatency);
+   return mLatency;
+}
+
 NewDefaultPlaybackPolicy::NewDefaultPlaybackPolicy( AudacityProject &project,
    double trackEndTime, double loopEndTime,
    bool loopEnabled, bool variableSpeed )
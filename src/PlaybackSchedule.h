@@ -23,6 +23,7 @@
 
 class AudacityProject;
 struct AudioIOStartStreamOptions;
+class BoolSetting;
 class BoundedEnvelope;
 using PRCrossfadeData = std::vector< std::vector < float > >;
 class PlayRegionEvent;
@@ -93,6 +94,8 @@ public:
       Duration batchSize; //!< Try to put at least this much into the ring buffer in each pass
       Duration latency; //!< Try not to let ring buffer contents fall below this
       Duration ringBufferDelay; //!< Length of ring buffer
+      //! Upper bound for values of AdaptLatency(), or zero if it does not change the latency
+      Duration maxLatency{ 0 };
    };
    //! Provide hints for construction of playback RingBuffer objects
    virtual BufferTimes SuggestedBufferTimes(PlaybackSchedule &schedule);
@@ -119,6 +122,24 @@ public:
    virtual std::chrono::milliseconds
       SleepInterval( PlaybackSchedule &schedule );
 
+   //! What the PortAudio callbacks saw since the previous filling of the playback buffers
+   struct BufferStatistics {
+      //! Fewest samples ready for any callback, or the maximum of size_t if there were no callbacks
+      size_t lowWater;
+      //! Callbacks that reported an underflow or found fewer samples than they needed
+      size_t underruns;
+      //! Greatest difference between an interval between callbacks and the audio duration of a callback
+      Duration jitter;
+   };
+
+   //! Called before each filling of the playback buffers, to revise the latency of SuggestedBufferTimes()
+   /*!
+    @param latency the value that the previous call returned, or else the suggested value
+    @return new latency, which AudioIO limits to the maxLatency of SuggestedBufferTimes(); default returns latency unchanged
+    */
+   virtual Duration AdaptLatency( PlaybackSchedule &schedule,
+      Duration latency, const BufferStatistics &statistics );
+
    //! Choose length of one fetch of samples from tracks in a call to AudioIO::FillPlayBuffers
    virtual PlaybackSlice GetPlaybackSlice( PlaybackSchedule &schedule,
       size_t available //!< upper bound for the length of the fetch
@@ -329,6 +350,38 @@ private:
    std::atomic<bool> mPolicyValid{ false };
 };
 
+//! Whether plain playback adapts the filling of its buffers to the load of the machine
+extern AUDACITY_DLL_API BoolSetting AdaptivePlaybackBuffers;
+
+//! Plays once, as the default policy does, but keeps the ring buffers only as full as the callbacks need
+/*!
+ Starts with low latency, doubles it after any underrun or when the callbacks
+ find the buffers nearly empty, and slowly shrinks it again while the
+ callbacks are regular and the buffers stay well filled.  The audio thread
+ wakes more often when the latency is low.
+ */
+class AdaptivePlaybackPolicy final : public PlaybackPolicy
+{
+public:
+   ~AdaptivePlaybackPolicy() override;
+
+   void Initialize( PlaybackSchedule &schedule, double rate ) override;
+
+   BufferTimes SuggestedBufferTimes(PlaybackSchedule &schedule) override;
+
+   std::chrono::milliseconds
+      SleepInterval( PlaybackSchedule &schedule ) override;
+
+   Duration AdaptLatency( PlaybackSchedule &schedule,
+      Duration latency, const BufferStatistics &statistics ) override;
+
+private:
+   //! Latest value of AdaptLatency()
+   Duration mLatency{ 0 };
+   //! How many fillings in a row found the buffers well filled
+   size_t mCalmFills{ 0 };
+};
+
 class NewDefaultPlaybackPolicy final
    : public PlaybackPolicy
    , public NonInterferingBase
@@ -1169,6 +1169,12 @@ DefaultPlayOptions( AudacityProject &project, bool newDefault )
       // Start play from left edge of selection
       options.pStartTime.emplace(ViewInfo::Get(project).selectedRegion.t0());
    }
+   else if (AdaptivePlaybackBuffers.Read())
+      options.policyFactory = [](const AudioIOStartStreamOptions &)
+         -> std::unique_ptr<PlaybackPolicy>
+      {
+         return std::make_unique<AdaptivePlaybackPolicy>();
+      };
 
    return options;
 }
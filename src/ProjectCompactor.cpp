@@ -0,0 +1,184 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file ProjectCompactor.cpp
+@brief Implements ProjectCompactor
+
+**********************************************************************/
+
+#include "ProjectCompactor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <unordered_set>
+
+#include <sqlite3.h>
+#include <wx/log.h>
+
+#include "MemoryX.h"
+
+namespace {
+//! Pause between steps, so that the disk is not monopolized
+constexpr auto StepPause = std::chrono::milliseconds(10);
+}
+
+ProjectCompactor::ProjectCompactor(
+   const FilePath &source, const FilePath &destination)
+   : mSource{ source }
+   , mDestination{ destination }
+{
+}
+
+ProjectCompactor::~ProjectCompactor()
+{
+   Stop();
+}
+
+void ProjectCompactor::AddBlocks(const std::vector<SampleBlockID> &blockids)
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   std::unordered_set<SampleBlockID> known{ mBlockIDs.begin(), mBlockIDs.end() };
+   for (auto blockid : blockids)
+      // Silent blocks are not stored
+      if (blockid > 0 && known.insert(blockid).second)
+         mBlockIDs.push_back(blockid);
+}
+
+void ProjectCompactor::SetReclaimable(long long bytes)
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   mReclaimable = std::max(0LL, bytes);
+}
+
+void ProjectCompactor::Start()
+{
+   Stop();
+   {
+      std::lock_guard<std::mutex> guard(mMutex);
+      if (mFailed || mNext == mBlockIDs.size())
+         return;
+   }
+   mStop.store(false);
+   mThread = std::thread{ [this]{ Run(); } };
+}
+
+void ProjectCompactor::Stop()
+{
+   mStop.store(true);
+   if (mThread.joinable())
+      mThread.join();
+}
+
+bool ProjectCompactor::IsDone() const
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   return !mFailed && mNext == mBlockIDs.size();
+}
+
+auto ProjectCompactor::GetProgress() const -> Progress
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   return { mNext, mBlockIDs.size(), mReclaimable, mFailed };
+}
+
+void ProjectCompactor::Run()
+{
+   sqlite3 *db = nullptr;
+   sqlite3_stmt *stmt = nullptr;
+   auto cleanup = finally([&]
+   {
+      if (stmt)
+         sqlite3_finalize(stmt);
+      if (db)
+         sqlite3_close(db);
+   });
+
+   auto fail = [&](const char *context, int rc)
+   {
+      wxLogDebug(wxT("ProjectCompactor::%s failed: %d %s"),
+         context, rc, db ? sqlite3_errmsg(db) : "");
+      std::lock_guard<std::mutex> guard(mMutex);
+      mFailed = true;
+   };
+
+   auto rc = sqlite3_open_v2(mDestination.ToUTF8(), &db,
+      SQLITE_OPEN_READWRITE | SQLITE_OPEN_NOMUTEX, nullptr);
+   if (rc != SQLITE_OK)
+      return fail("open", rc);
+
+   // The destination is of no use until ProjectFileIO::Compact() finishes
+   // it, so a crash may as well leave it corrupt; but keep the journal in
+   // memory, so that a failed step can still roll back
+   char *sql = sqlite3_mprintf(
+      "PRAGMA busy_timeout = 5000;"
+      "PRAGMA synchronous = OFF;"
+      "PRAGMA journal_mode = MEMORY;"
+      "ATTACH DATABASE %Q AS inbound;",
+      static_cast<const char *>(mSource.ToUTF8()));
+   rc = sqlite3_exec(db, sql, nullptr, nullptr, nullptr);
+   sqlite3_free(sql);
+   if (rc != SQLITE_OK)
+      return fail("attach", rc);
+
+   // Blocks may already be present if an earlier run stopped during a step
+   rc = sqlite3_prepare_v2(db,
+      "INSERT OR IGNORE INTO main.sampleblocks"
+      "  SELECT * FROM inbound.sampleblocks"
+      "  WHERE blockid = ?1;",
+      -1, &stmt, nullptr);
+   if (rc != SQLITE_OK)
+      return fail("prepare", rc);
+
+   while (!mStop.load()) {
+      {
+         std::lock_guard<std::mutex> guard(mMutex);
+         if (mNext == mBlockIDs.size())
+            break;
+      }
+      if (!Step(db, stmt))
+         return fail("step", sqlite3_errcode(db));
+      std::this_thread::sleep_for(StepPause);
+   }
+
+   sqlite3_exec(db, "DETACH DATABASE inbound;", nullptr, nullptr, nullptr);
+}
+
+bool ProjectCompactor::Step(sqlite3 *db, sqlite3_stmt *stmt)
+{
+   // Only this thread changes mNext, but others may append blocks
+   std::vector<SampleBlockID> blockids;
+   {
+      std::lock_guard<std::mutex> guard(mMutex);
+      const auto first = mBlockIDs.begin() + mNext;
+      const auto count = std::min(StepSize, mBlockIDs.size() - mNext);
+      blockids.assign(first, first + count);
+   }
+
+   // One transaction for the step, not a commit for each block
+   if (sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr) != SQLITE_OK)
+      return false;
+   auto rollback = finally([&]
+   {
+      if (!sqlite3_get_autocommit(db))
+         sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+   });
+
+   for (auto blockid : blockids) {
+      sqlite3_bind_int64(stmt, 1, blockid);
+      const auto rc = sqlite3_step(stmt);
+      sqlite3_clear_bindings(stmt);
+      sqlite3_reset(stmt);
+      // The block may have been deleted from the source, because it left the
+      // undo history; that inserts nothing, and is not an error
+      if (rc != SQLITE_DONE)
+         return false;
+   }
+
+   if (sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK)
+      return false;
+
+   std::lock_guard<std::mutex> guard(mMutex);
+   mNext += blockids.size();
+   return true;
+}
@@ -0,0 +1,98 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file ProjectCompactor.h
+@brief Declare ProjectCompactor, which copies live sample blocks of a project
+into a new database on a background thread
+
+**********************************************************************/
+
+#ifndef __AUDACITY_PROJECT_COMPACTOR__
+#define __AUDACITY_PROJECT_COMPACTOR__
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Identifier.h"
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+// From SampleBlock.h
+using SampleBlockID = long long;
+
+///\brief Copies sample blocks from a project file into a new database, a
+/// bounded number in each transaction, on a thread of its own
+/*!
+ Sample blocks are never modified once stored, and their ids are never
+ reused, so a block copied once stays correct however the project changes
+ afterwards.  Therefore copying can be stopped and resumed at any time, and
+ ProjectFileIO::Compact() then needs to copy only the blocks not yet copied,
+ while the user waits, and discard copies of blocks no longer used.
+
+ The destination must already have the schema of a project file.
+ */
+class AUDACITY_DLL_API ProjectCompactor final
+{
+public:
+   struct Progress {
+      size_t copied{}; //!< Blocks copied so far
+      size_t total{}; //!< Blocks to copy
+      long long reclaimable{}; //!< Estimated bytes to be freed at completion
+      bool failed{}; //!< Whether a database error stopped the copying
+   };
+
+   //! Maximum number of blocks copied in one transaction
+   static constexpr size_t StepSize = 64;
+
+   ProjectCompactor(const FilePath &source, const FilePath &destination);
+   ProjectCompactor(const ProjectCompactor&) = delete;
+   ProjectCompactor &operator=(const ProjectCompactor&) = delete;
+   //! Stops the thread, but leaves the destination file
+   ~ProjectCompactor();
+
+   const FilePath &GetSource() const { return mSource; }
+   const FilePath &GetDestination() const { return mDestination; }
+
+   //! Add blocks to be copied, as after another save of the project
+   /*! Blocks already copied or queued are not copied again */
+   void AddBlocks(const std::vector<SampleBlockID> &blockids);
+
+   //! Record the estimate reported by GetProgress()
+   void SetReclaimable(long long bytes);
+
+   //! Begin or resume copying on the background thread
+   void Start();
+
+   //! Stop copying after the current step, and wait for the thread
+   void Stop();
+
+   //! Whether all blocks so far added were copied
+   bool IsDone() const;
+
+   Progress GetProgress() const;
+
+private:
+   void Run();
+   //! Copy the next blocks in one transaction
+   /*! @return false on failure */
+   bool Step(sqlite3 *db, sqlite3_stmt *stmt);
+
+   const FilePath mSource;
+   const FilePath mDestination;
+
+   mutable std::mutex mMutex;
+   //! Blocks in order of copying; those before mNext are copied
+   std::vector<SampleBlockID> mBlockIDs;
+   size_t mNext{ 0 };
+   long long mReclaimable{ 0 };
+   bool mFailed{ false };
+
+   std::thread mThread;
+   std::atomic<bool> mStop{ false };
+};
+
+#endif
@@ -28,6 +28,7 @@ Paul Licameli split from AudacityProject.cpp
 #include "ProjectSerializer.h"
 #include "ProjectWindows.h"
 #include "SampleBlock.h"
+#include "SampleBlockCache.h"
 #include "TempDirectory.h"
 #include "TransactionScope.h"
 #include "WaveTrack.h"
@@ -428,6 +429,12 @@ bool ProjectFileIO::InitializeSQL()
    return sqliteIniter.mRc == SQLITE_OK;
 }
 
+// Where Compact() builds the new file, and background compaction begins it
+static FilePath CompactTempName(const FilePath &fileName)
+{
+   return fileName + "_compact_temp";
+}
+
 static void RefreshAllTitles(bool bShowProjectNumbers )
 {
    for ( auto pProject : AllProjects{} ) {
@@ -521,6 +528,7 @@ ProjectFileIO::ProjectFileIO(AudacityProject &project)
 
 ProjectFileIO::~ProjectFileIO()
 {
+   DiscardBackgroundCompaction();
 }
 
 bool ProjectFileIO::HasConnection() const
@@ -568,7 +576,8 @@ sqlite3 *ProjectFileIO::DB()
  @pre *CurConn() does not exist
  @post *CurConn() exists or return value is false
  */
-bool ProjectFileIO::OpenConnection(FilePath fileName /* = {}  */)
+bool ProjectFileIO::OpenConnection(
+   FilePath fileName /* = {}  */, bool readOnly /* = false */)
 {
    auto &curConn = CurrConn();
    wxASSERT(!curConn);
@@ -599,7 +608,7 @@ bool ProjectFileIO::OpenConnection(FilePath fileName /* = {}  */)
    // Pass weak_ptr to project into DBConnection constructor
    curConn = std::make_unique<DBConnection>(
       mProject.shared_from_this(), mpErrors, [this]{ OnCheckpointFailure(); } );
-   auto rc = curConn->Open(fileName);
+   auto rc = curConn->Open(fileName, readOnly);
    if (rc != SQLITE_OK)
    {
       // Must use SetError() here since we do not have an active DB
@@ -972,6 +981,14 @@ bool ProjectFileIO::DeleteBlocks(const BlockIDs &blockids, bool complement)
       return false;
    }
 
+   // Rows were deleted behind the backs of any cached copies
+   auto &cache = SampleBlockCache::Get();
+   if (complement)
+      cache.Invalidate(*CurrConn());
+   else
+      for (auto blockid : blockids)
+         cache.Invalidate(*CurrConn(), blockid);
+
    // Mark the project recovered if we deleted any rows
    int changes = sqlite3_changes(db);
    if (changes > 0)
@@ -987,7 +1004,8 @@ bool ProjectFileIO::CopyTo(const FilePath &destpath,
    const TranslatableString &msg,
    bool isTemporary,
    bool prune /* = false */,
-   const std::vector<const TrackList *> &tracks /* = {} */)
+   const std::vector<const TrackList *> &tracks /* = {} */,
+   bool resume /* = false */)
 {
    auto pConn = CurrConn().get();
    if (!pConn)
@@ -1101,13 +1119,64 @@ bool ProjectFileIO::CopyTo(const FilePath &destpath,
       return false;
    }
 
-   // Install our schema into the new database
-   if (!InstallSchema(db, "outbound"))
+   // Install our schema into the new database, unless ProjectCompactor
+   // already began to fill it
+   if (!resume && !InstallSchema(db, "outbound"))
    {
       // Message already set
       return false;
    }
 
+   if (resume)
+   {
+      // Blocks already copied need not be copied again, and any that were
+      // copied but since left the tracks must go
+      BlockIDs unused;
+      auto cb = [&blockids, &unused](int cols, char **vals, char **){
+         SampleBlockID blockid;
+         wxString{ vals[0] }.ToLongLong(&blockid);
+         if (blockids.erase(blockid) == 0)
+            unused.insert(blockid);
+         return 0;
+      };
+
+      if (!Query("SELECT blockid FROM outbound.sampleblocks;", cb))
+      {
+         // Error message already captured.
+         return false;
+      }
+
+      sqlite3_stmt *stmt = nullptr;
+      auto cleanup = finally([&]
+      {
+         if (stmt)
+            sqlite3_finalize(stmt);
+      });
+
+      rc = sqlite3_prepare_v2(db,
+         "DELETE FROM outbound.sampleblocks WHERE blockid = ?;",
+         -1, &stmt, nullptr);
+      for (auto iter = unused.begin();
+         rc == SQLITE_OK && iter != unused.end(); ++iter)
+      {
+         sqlite3_bind_int64(stmt, 1, *iter);
+         rc = sqlite3_step(stmt);
+         if (rc == SQLITE_DONE)
+            rc = sqlite3_reset(stmt);
+      }
+      if (rc != SQLITE_OK)
+      {
+         ADD_EXCEPTION_CONTEXT("sqlite3.rc", std::to_string(rc));
+         ADD_EXCEPTION_CONTEXT(
+            "sqlite3.context", "ProjectGileIO::CopyTo.unused");
+
+         SetDBError(
+            XO("Failed to update the project file")
+         );
+         return false;
+      }
+   }
+
    {
       // Ensure statement gets cleaned up
       sqlite3_stmt *stmt = nullptr;
@@ -1478,6 +1547,24 @@ void ProjectFileIO::Compact(
    // Haven't compacted yet
    mWasCompacted = false;
 
+   // Take over from any background compaction; unless resumed below, its
+   // file is of no further use
+   auto pCompactor = std::move(mpCompactor);
+   if (pCompactor)
+      pCompactor->Stop();
+   auto discard = finally([&]
+   {
+      if (pCompactor)
+         wxRemoveFile(pCompactor->GetDestination());
+   });
+
+   // Nothing can be done to a file opened only for reading
+   if (IsReadOnly())
+   {
+      mHadUnused = false;
+      return;
+   }
+
    // Assume we have unused blocks until we find out otherwise. That way cleanup
    // at project close time will still occur.
    mHadUnused = true;
@@ -1508,14 +1595,24 @@ void ProjectFileIO::Compact(
 
    wxString origName = mFileName;
    wxString backName = origName + "_compact_back";
-   wxString tempName = origName + "_compact_temp";
+   wxString tempName = CompactTempName(origName);
+
+   // Finish what background compaction began, if it was not for another file
+   // and did not fail
+   const bool resume = pCompactor &&
+      pCompactor->GetSource() == origName &&
+      pCompactor->GetDestination() == tempName &&
+      !pCompactor->GetProgress().failed;
+   if (resume)
+      pCompactor.reset();
 
    // Copy the original database to a new database. Only prune sample blocks if
    // we have a tracklist.
    // REVIEW: Compact can fail on the CopyTo with no error messages.  That's OK?
    // LLL: We could display an error message or just ignore the failure and allow
    // the file to be compacted the next time it's saved.
-   if (CopyTo(tempName, XO("Compacting project"), IsTemporary(), !tracks.empty(), tracks))
+   if (CopyTo(tempName, XO("Compacting project"), IsTemporary(), !tracks.empty(), tracks,
+      resume))
    {
       // Must close the database to rename it
       if (CloseConnection())
@@ -1605,6 +1702,78 @@ void ProjectFileIO::Compact(
    return;
 }
 
+void ProjectFileIO::StartBackgroundCompaction(
+   const std::vector<const TrackList *> &tracks)
+{
+   if (IsTemporary() || IsReadOnly() || !HasConnection())
+      return;
+
+   // The file may have been saved under another name
+   if (mpCompactor && mpCompactor->GetSource() != mFileName)
+      DiscardBackgroundCompaction();
+
+   if (!mpCompactor)
+   {
+      if (!ShouldCompact(tracks))
+         return;
+
+      // Install the schema now, so that the compactor needs only to copy.
+      // Any file left by a crash could belong to another version of the
+      // project, so start afresh.
+      const auto tempName = CompactTempName(mFileName);
+      if (wxFileExists(tempName))
+         wxRemoveFile(tempName);
+
+      auto db = DB();
+      char *sql = sqlite3_mprintf(
+         "ATTACH DATABASE %Q AS outbound;",
+         static_cast<const char *>(tempName.ToUTF8()));
+      auto rc = sqlite3_exec(db, sql, nullptr, nullptr, nullptr);
+      sqlite3_free(sql);
+      if (rc != SQLITE_OK)
+      {
+         SetDBError(
+            XO("Unable to attach destination database")
+         );
+         return;
+      }
+
+      const bool installed = CurrConn()->FastMode("outbound") == SQLITE_OK &&
+         InstallSchema(db, "outbound");
+      rc = sqlite3_exec(db, "DETACH DATABASE outbound;", nullptr, nullptr, nullptr);
+      if (!installed || rc != SQLITE_OK)
+      {
+         wxRemoveFile(tempName);
+         return;
+      }
+
+      mpCompactor = std::make_unique<ProjectCompactor>(mFileName, tempName);
+   }
+
+   SampleBlockIDSet blockids;
+   for (auto pTracks : tracks)
+      if (pTracks)
+         InspectBlocks(*pTracks, {}, &blockids);
+   mpCompactor->AddBlocks({ blockids.begin(), blockids.end() });
+   mpCompactor->SetReclaimable(GetTotalUsage() - GetCurrentUsage(tracks));
+   mpCompactor->Start();
+}
+
+ProjectCompactor::Progress ProjectFileIO::GetCompactionProgress() const
+{
+   return mpCompactor ? mpCompactor->GetProgress() : ProjectCompactor::Progress{};
+}
+
+void ProjectFileIO::DiscardBackgroundCompaction()
+{
+   if (!mpCompactor)
+      return;
+   mpCompactor->Stop();
+   if (wxFileExists(mpCompactor->GetDestination()))
+      wxRemoveFile(mpCompactor->GetDestination());
+   mpCompactor.reset();
+}
+
 bool ProjectFileIO::WasCompacted()
 {
    return mWasCompacted;
@@ -1850,6 +2019,10 @@ void ProjectFileIO::WriteXML(XMLWriter &xmlFile,
 
 bool ProjectFileIO::AutoSave(bool recording)
 {
+   // There is no recovery of a project that can't be modified
+   if (IsReadOnly())
+      return true;
+
    ProjectSerializer autosave;
    WriteXMLHeader(autosave);
    WriteXML(autosave, recording);
@@ -2054,7 +2227,8 @@ bool ProjectFileIO::WriteDoc(const char *table,
    return transaction.Commit();
 }
 
-bool ProjectFileIO::LoadProject(const FilePath &fileName, bool ignoreAutosave)
+bool ProjectFileIO::LoadProject(
+   const FilePath &fileName, bool ignoreAutosave, bool readOnly)
 {
    auto now = std::chrono::high_resolution_clock::now();
 
@@ -2071,7 +2245,7 @@ bool ProjectFileIO::LoadProject(const FilePath &fileName, bool ignoreAutosave)
    SaveConnection();
 
    // Open the project file
-   if (!OpenConnection(fileName))
+   if (!OpenConnection(fileName, readOnly))
    {
       return false;
    }
@@ -2083,10 +2257,22 @@ bool ProjectFileIO::LoadProject(const FilePath &fileName, bool ignoreAutosave)
       GetValue("SELECT ROWID FROM main.autosave WHERE id = 1;", rowId, true);
 
    int64_t rowsCount = 0;
+   const bool counted = useAutosave ||
+      GetValue("SELECT COUNT(1) FROM main.project;", rowsCount, true);
+
+   // A read-only connection can open, yet fail at the first read, as when
+   // the file has write-ahead log files in a directory that isn't writable.
+   // Don't mistake that for a missing doc; fail, so the caller can open the
+   // file otherwise
+   if (readOnly && !counted)
+   {
+      return false;
+   }
+
    // If we didn't have an autosave doc, load the project doc instead
    if (
       !useAutosave &&
-      (!GetValue("SELECT COUNT(1) FROM main.project;", rowsCount, true) || rowsCount == 0))
+      (!counted || rowsCount == 0))
    {
       // Missing both the autosave and project docs. This can happen if the
       // system were to crash before the first autosave into a temporary file.
@@ -2118,11 +2304,12 @@ bool ProjectFileIO::LoadProject(const FilePath &fileName, bool ignoreAutosave)
       }
 
       // Check for orphans blocks...sets mRecovered if any were deleted
+      // (but they must stay if the file can't be modified)
       
       auto blockids = WaveTrackFactory::Get( mProject )
          .GetSampleBlockFactory()
             ->GetActiveBlockIDs();
-      if (blockids.size() > 0)
+      if (blockids.size() > 0 && !readOnly)
       {
          success = DeleteBlocks(blockids, true);
          if (!success)
@@ -2423,16 +2610,20 @@ bool ProjectFileIO::CloseProject()
       return true;
    }
 
+   // Copying can't resume once the project is reopened
+   DiscardBackgroundCompaction();
+
    // Save the filename since CloseConnection() will clear it
    wxString filename = mFileName;
+   const bool readOnly = IsReadOnly();
 
    // Not much we can do if this fails.  The user will simply get
    // the recovery dialog upon next restart.
    if (CloseConnection())
    {
       // If this is a temporary project, we no longer want to keep the
-      // project file.
-      if (IsTemporary())
+      // project file, unless it was only opened for reading
+      if (IsTemporary() && !readOnly)
       {
          // This is just a safety check.
          wxFileName temp(TempDirectory::TempDir(), wxT(""));
@@ -2449,12 +2640,13 @@ bool ProjectFileIO::CloseProject()
 bool ProjectFileIO::ReopenProject()
 {
    FilePath fileName = mFileName;
+   const bool readOnly = IsReadOnly();
    if (!CloseConnection())
    {
       return false;
    }
 
-   return OpenConnection(fileName);
+   return OpenConnection(fileName, readOnly);
 }
 
 bool ProjectFileIO::IsModified() const
@@ -2467,6 +2659,12 @@ bool ProjectFileIO::IsTemporary() const
    return mTemporary;
 }
 
+bool ProjectFileIO::IsReadOnly() const
+{
+   auto &currConn = ConnectionPtr::Get( mProject ).mpConnection;
+   return currConn && currConn->IsReadOnly();
+}
+
 bool ProjectFileIO::IsRecovered() const
 {
    return mRecovered;
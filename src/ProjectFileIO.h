@@ -18,6 +18,7 @@ Paul Licameli split from AudacityProject.h
 
 #include "ClientData.h" // to inherit
 #include "Prefs.h" // to inherit
+#include "ProjectCompactor.h"
 #include "XMLTagHandler.h" // to inherit
 
 struct sqlite3;
@@ -88,6 +89,8 @@ public:
    bool IsModified() const;
    bool IsTemporary() const;
    bool IsRecovered() const;
+   //! Whether the current connection was opened only for reading
+   bool IsReadOnly() const;
 
    bool AutoSave(bool recording = false);
    bool AutoSaveDelete(sqlite3 *db = nullptr);
@@ -96,7 +99,11 @@ public:
    bool CloseProject();
    bool ReopenProject();
 
-   bool LoadProject(const FilePath &fileName, bool ignoreAutosave);
+   //! @param readOnly if true, open a connection that can't modify the file,
+   //! which is faster for projects opened only to be analyzed or exported;
+   //! such a project can't be saved, and edits can't add sample blocks
+   bool LoadProject(const FilePath &fileName, bool ignoreAutosave,
+      bool readOnly = false);
    bool UpdateSaved(const TrackList *tracks = nullptr);
    bool SaveProject(const FilePath &fileName, const TrackList *lastSaved);
    bool SaveCopy(const FilePath& fileName);
@@ -180,6 +187,20 @@ public:
    void Compact(
       const std::vector<const TrackList *> &tracks, bool force = false);
 
+   //! Begin copying, in the background, the sample blocks of the given tracks
+   //! into the file that Compact() makes, so that it need only finish the job;
+   //! if already begun, also copy any blocks newly used by the tracks
+   /*! Does nothing for temporary or read-only projects, or if Compact()
+    would not find enough unused space */
+   void StartBackgroundCompaction(
+      const std::vector<const TrackList *> &tracks);
+
+   //! All zero if no background compaction was started
+   ProjectCompactor::Progress GetCompactionProgress() const;
+
+   //! Stop any background compaction and remove its incomplete file
+   void DiscardBackgroundCompaction();
+
    // The last compact check did actually compact the project file if true
    bool WasCompacted();
 
@@ -223,7 +244,7 @@ private:
    // if opening fails.
    sqlite3 *DB();
 
-   bool OpenConnection(FilePath fileName = {});
+   bool OpenConnection(FilePath fileName = {}, bool readOnly = false);
    bool CloseConnection();
 
    // Put the current database connection aside, keeping it open, so that
@@ -261,6 +282,10 @@ private:
       const std::vector<const TrackList *> &tracks = {} /*!<
          First track list (or if none, then the project's track list) are tracks to write into document blob;
          That list, plus any others, contain tracks whose sample blocks must be kept
+      */,
+      bool resume = false /*!<
+         Destination already has the schema and some sample blocks, copied by
+         ProjectCompactor; copy only the missing blocks, and delete unused ones
       */
    );
 
@@ -307,6 +332,9 @@ private:
    // Project had unused blocks during last Compact()
    bool mHadUnused;
 
+   // Copies sample blocks for the next Compact() in the background
+   std::unique_ptr<ProjectCompactor> mpCompactor;
+
    Connection mPrevConn;
    FilePath mPrevFileName;
    bool mPrevTemporary;
@@ -58,6 +58,10 @@ Paul Licameli split from AudacityProject.cpp
 
 #include <optional>
 
+//! Whether to begin compaction in the background after each save, so that
+//! less remains to do when the project closes
+BoolSetting CompactInBackground{ L"/Directories/CompactInBackground", true };
+
 static const AudacityProject::AttachedObjects::RegisteredFactory sFileManagerKey{
    []( AudacityProject &parent ){
       auto result = std::make_shared< ProjectFileManager >( parent );
@@ -93,6 +97,16 @@ void ProjectFileManager::DiscardAutosave(const FilePath &filename)
    // closes the temporary project properly
 }
 
+std::unique_ptr<InvisibleTemporaryProject>
+ProjectFileManager::OpenReadOnlyProject(const FilePath &fileName)
+{
+   auto pTemp = std::make_unique<InvisibleTemporaryProject>();
+   auto &projectFileIO = ProjectFileIO::Get(pTemp->Project());
+   if (!projectFileIO.LoadProject(fileName, true, true))
+      return nullptr;
+   return pTemp;
+}
+
 ProjectFileManager::ProjectFileManager( AudacityProject &project )
 : mProject{ project }
 {
@@ -384,6 +398,10 @@ bool ProjectFileManager::DoSave(const FilePath & fileName, const bool fromSaveAs
    if (pBackupProject)
       pBackupProject->Discard();
 
+   // Closing keeps only the blocks of the saved tracks; copy them meanwhile
+   if (CompactInBackground.Read())
+      projectFileIO.StartBackgroundCompaction({ mLastSavedTracks.get() });
+
    return true;
 }
 
@@ -1188,8 +1206,13 @@ bool ImportProject(AudacityProject &dest, const FilePath &fileName)
    InvisibleTemporaryProject temp;
    auto &project = temp.Project();
 
+   // The imported file is only read, so open it the faster way if possible;
+   // that can fail, as when its directory is not writable but it has
+   // write-ahead log files, and then LoadProject() returns false at the
+   // first read
    auto &projectFileIO = ProjectFileIO::Get(project);
-   if (!projectFileIO.LoadProject(fileName, false))
+   if (!projectFileIO.LoadProject(fileName, false, true) &&
+       !projectFileIO.LoadProject(fileName, false))
       return false;
    auto &srcTracks = TrackList::Get(project);
    auto &destTracks = TrackList::Get(dest);
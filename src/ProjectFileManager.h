@@ -21,6 +21,7 @@ Paul Licameli split from AudacityProject.h
 class wxString;
 class wxFileName;
 class AudacityProject;
+class InvisibleTemporaryProject;
 class Track;
 class TrackList;
 class WaveTrack;
@@ -39,6 +40,16 @@ public:
    // Open and close a file, invisibly, removing its Autosave blob
    static void DiscardAutosave(const FilePath &filename);
 
+   //! Load a project file into a project that is not shown, without intent
+   //! to modify it, as for analysis or export of many archived projects
+   /*!
+    The file is opened with a read-only, memory-mapped database connection,
+    and any autosave document in it is ignored.
+    @return null if the file could not be loaded
+    */
+   static std::unique_ptr<InvisibleTemporaryProject>
+      OpenReadOnlyProject(const FilePath &fileName);
+
    explicit ProjectFileManager( AudacityProject &project );
    ProjectFileManager( const ProjectFileManager & ) PROHIBITED;
    ProjectFileManager &operator=( const ProjectFileManager & ) PROHIBITED;
@@ -0,0 +1,243 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  @file ProjectRenderer.cpp
+  @brief Mix a project file to stereo samples, without user interface
+
+**********************************************************************/
+
+#include "ProjectRenderer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <optional>
+#include <vector>
+
+#include <wx/file.h>
+
+#include "AudacityException.h"
+#include "FileFormats.h"
+#include "Mix.h"
+#include "Project.h"
+#include "ProjectFileIO.h"
+#include "ProjectFileManager.h"
+#include "ProjectRate.h"
+#include "Track.h"
+#include "WaveTrack.h"
+#include "WorkerPool.h"
+#include "effects/RealtimeEffectManager.h"
+
+namespace {
+
+//! The channels of one leader track, mixed and processed together
+struct RenderGroup {
+   WaveTrack *pLeader{};
+   std::vector<const WaveTrack*> channels;
+   std::vector<std::unique_ptr<Mixer>> mixers;
+   //! Two channel buffers, and three scratch buffers for effects
+   std::vector<Floats> buffers;
+   size_t len{};
+
+   float *Buffer(size_t ii) { return buffers[ii].get(); }
+};
+
+constexpr unsigned RenderChannels = 2;
+
+}
+
+bool RenderProject(const FilePath &projectPath,
+   const ProjectRenderSettings &settings, const ProjectRenderSink &sink,
+   TranslatableString *pError)
+{
+   auto fail = [&](TranslatableString message){
+      if (pError)
+         *pError = message;
+      return false;
+   };
+
+   // Open for reading only if possible, as when importing a project
+   auto pTemp = ProjectFileManager::OpenReadOnlyProject(projectPath);
+   if (!pTemp) {
+      pTemp = std::make_unique<InvisibleTemporaryProject>();
+      if (!ProjectFileIO::Get(pTemp->Project()).LoadProject(projectPath, true))
+         return fail(XO("Could not open project %s").Format(projectPath));
+   }
+   auto &project = pTemp->Project();
+   auto &tracks = TrackList::Get(project);
+   const auto rate = settings.rate > 0
+      ? settings.rate : ProjectRate::Get(project).GetRate();
+   const auto blockSize = std::max<size_t>(1, settings.blockSize);
+
+   // Which tracks are audible, as in export
+   const bool anySolo =
+      !(tracks.Any<const WaveTrack>() + &WaveTrack::GetSolo).empty();
+   std::vector<RenderGroup> groups;
+   double t1 = 0;
+   for (auto pLeader : tracks.Leaders<WaveTrack>()
+        - (anySolo ? &WaveTrack::GetNotSolo : &WaveTrack::GetMute)) {
+      RenderGroup group;
+      group.pLeader = pLeader;
+      for (auto pChannel : TrackList::Channels(pLeader))
+         // Like AudioIO, process no more channels than the output has
+         if (group.channels.size() < RenderChannels)
+            group.channels.push_back(pChannel);
+      t1 = std::max(t1, pLeader->GetEndTime());
+      groups.push_back(std::move(group));
+   }
+   if (groups.empty())
+      return fail(XO("All audio is muted."));
+
+   // The time track's envelope, if any, is shared by all mixers, and caches
+   // its last search unsynchronized; so then mix the groups in turn, as
+   // Mixer does not mix in parallel with a time warp
+   const auto pWarp = Mixer::WarpOptions::DefaultWarp::Call(tracks);
+   for (auto &group : groups) {
+      for (auto pChannel : group.channels)
+         group.mixers.push_back(std::make_unique<Mixer>(
+            SampleTrackConstArray{
+               pChannel->SharedPointer<const SampleTrack>() },
+            // Throw, to stop rendering, if read fails:
+            true,
+            Mixer::WarpOptions{ pWarp },
+            0.0, t1,
+            1, blockSize, false,
+            rate, floatSample,
+            true, nullptr,
+            // Gains apply after the effects, as in playback
+            false));
+      // PRL:  Bug2536: see Mixer::MixVariableRates about the extra sample
+      for (size_t ii = 0; ii < 2 * RenderChannels + 1; ++ii)
+         group.buffers.emplace_back(blockSize + 1);
+   }
+
+   std::optional<RealtimeEffects::InitializationScope> initialization;
+   if (settings.realtimeEffects) {
+      initialization.emplace(project.shared_from_this(), rate);
+      for (auto &group : groups)
+         initialization->AddTrack(
+            group.pLeader, group.channels.size(), rate);
+   }
+
+   auto &pool = WorkerPool::Get();
+   Floats output{ blockSize * RenderChannels };
+   try {
+      while (true) {
+         // Mix the channels of each group
+         auto mix = [&](size_t iGroup){
+            auto &group = groups[iGroup];
+            group.len = 0;
+            for (size_t iChannel = 0; iChannel < RenderChannels; ++iChannel) {
+               const auto buffer = group.Buffer(iChannel);
+               size_t produced = 0;
+               if (iChannel < group.mixers.size()) {
+                  auto &mixer = *group.mixers[iChannel];
+                  produced = mixer.Process(blockSize);
+                  std::memcpy(buffer, mixer.GetBuffer(),
+                     produced * sizeof(float));
+               }
+               std::fill(buffer + produced, buffer + blockSize, 0.0f);
+               group.len = std::max(group.len, produced);
+            }
+         };
+         if (pWarp)
+            for (size_t iGroup = 0; iGroup < groups.size(); ++iGroup)
+               mix(iGroup);
+         else
+            pool.ParallelFor(groups.size(), mix);
+         size_t len = 0;
+         for (auto &group : groups)
+            len = std::max(len, group.len);
+         if (len == 0)
+            break;
+
+         if (initialization) {
+            // As in AudioIO::TransformPlayBuffers: the per-project effects
+            // visit the tracks in turn, then the effects of different tracks
+            // run at once
+            RealtimeEffects::ProcessingScope scope{
+               *initialization, project.shared_from_this() };
+            auto process = [&](RenderGroup &group, auto member){
+               float *const pointers[RenderChannels]{
+                  group.Buffer(0), group.Buffer(1) };
+               float *const scratch[RenderChannels + 1]{
+                  group.Buffer(2), group.Buffer(3), group.Buffer(4) };
+               (scope.*member)(group.pLeader, pointers, scratch, len);
+            };
+            for (auto &group : groups)
+               process(group,
+                  &RealtimeEffects::ProcessingScope::ProcessProjectEffects);
+            pool.ParallelFor(groups.size(), [&](size_t iGroup){
+               process(groups[iGroup],
+                  &RealtimeEffects::ProcessingScope::ProcessTrackEffects);
+            });
+         }
+
+         // Pan and gain, as AudioIoCallback::AddToOutputChannel does without
+         // the fades and the output volume
+         std::fill(output.get(), output.get() + len * RenderChannels, 0.0f);
+         for (auto &group : groups) {
+            for (size_t iChannel = 0;
+                 iChannel < group.channels.size(); ++iChannel) {
+               const auto pChannel = group.channels[iChannel];
+               const auto buffer = group.Buffer(iChannel);
+               const auto type = pChannel->GetChannelIgnoringPan();
+               for (unsigned chan = 0; chan < RenderChannels; ++chan) {
+                  if (type != Track::MonoChannel &&
+                      type != (chan == 0
+                         ? Track::LeftChannel : Track::RightChannel))
+                     continue;
+                  const auto gain = pChannel->GetChannelGain(chan);
+                  for (size_t ii = 0; ii < len; ++ii)
+                     output[RenderChannels * ii + chan] += gain * buffer[ii];
+               }
+            }
+         }
+
+         if (!sink(output.get(), len, rate))
+            return fail(XO("Rendering was stopped."));
+      }
+   }
+   catch (const AudacityException &) {
+      return fail(XO("Could not read the audio of project %s")
+         .Format(projectPath));
+   }
+   return true;
+}
+
+bool RenderProjectToFile(const FilePath &projectPath,
+   const FilePath &outputPath, const ProjectRenderSettings &settings,
+   TranslatableString *pError)
+{
+   wxFile f; // will be closed when it goes out of scope
+   SFFile sf; // wraps f
+   bool writeFailed = false;
+   const bool rendered = RenderProject(projectPath, settings,
+      [&](const float *samples, size_t frames, double rate){
+         if (!sf) {
+            SF_INFO info{};
+            info.samplerate = static_cast<int>(rate + 0.5);
+            info.channels = RenderChannels;
+            info.format = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+            // Use the file descriptor, as ExportPCM does, for Unicode names
+            if (f.Open(outputPath, wxFile::write))
+               sf.reset(SFCall<SNDFILE*>(
+                  sf_open_fd, f.fd(), SFM_WRITE, &info, FALSE));
+            if (!sf) {
+               writeFailed = true;
+               return false;
+            }
+         }
+         writeFailed = (SFCall<sf_count_t>(sf_writef_float,
+            sf.get(), samples, static_cast<sf_count_t>(frames))
+               != static_cast<sf_count_t>(frames));
+         return !writeFailed;
+      }, pError);
+   // No file at all if nothing was rendered
+   if (!sf ? rendered : sf.close() != 0)
+      writeFailed = true;
+   // A failed write also stopped the render, so say why before that
+   if (writeFailed && pError)
+      *pError = XO("Could not write %s").Format(outputPath);
+   return rendered && !writeFailed;
+}
@@ -0,0 +1,56 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  @file ProjectRenderer.h
+  @brief Mix a project file to stereo samples, without user interface
+
+**********************************************************************/
+
+#ifndef __AUDACITY_PROJECT_RENDERER__
+#define __AUDACITY_PROJECT_RENDERER__
+
+#include <functional>
+
+#include "Identifier.h"
+#include "Internat.h"
+
+//! Options of RenderProject()
+struct ProjectRenderSettings {
+   //! Sample rate of the result; if zero, the rate of the project
+   double rate{ 0 };
+   //! Frames rendered at a time
+   size_t blockSize{ 65536 };
+   //! Whether to apply the realtime effects of the project and of its tracks
+   bool realtimeEffects{ true };
+};
+
+//! Receives each block of a render, as interleaved stereo floats
+/*! @return false to stop the render */
+using ProjectRenderSink =
+   std::function<bool(const float *samples, size_t frames, double rate)>;
+
+//! Mix all audible wave tracks of a project file, from time zero to the end
+//! of the last of them, as playback of all of it would sound in stereo
+/*!
+ Mute and solo, gain and pan, the time track, and realtime effects apply as
+ in playback.  Tracks are mixed in parallel on the worker pool, unless there
+ is a time track, and their effects are applied in parallel.  No windows are made; the file is opened for reading only
+ if possible.
+
+ @param[out] pError says why the render failed, if it did
+ @return false if the project could not be read, had no audible tracks, or
+ the sink stopped the render
+ */
+AUDACITY_DLL_API
+bool RenderProject(const FilePath &projectPath,
+   const ProjectRenderSettings &settings, const ProjectRenderSink &sink,
+   TranslatableString *pError = nullptr);
+
+//! RenderProject() into a 32 bit float WAV file
+AUDACITY_DLL_API
+bool RenderProjectToFile(const FilePath &projectPath,
+   const FilePath &outputPath, const ProjectRenderSettings &settings,
+   TranslatableString *pError = nullptr);
+
+#endif
@@ -53,6 +53,49 @@ SampleBlockPtr SampleBlockFactory::CreateFromXML(
    return result;
 }
 
+bool SampleBlockFactory::GetSamples(const SampleBlockReads &reads,
+   sampleFormat destformat, bool mayThrow)
+{
+   return DoGetSamples(reads, destformat, mayThrow);
+}
+
+bool SampleBlockFactory::DoGetSamples(
+   const SampleBlockReads &reads, sampleFormat destformat, bool mayThrow)
+{
+   bool success = true;
+   for (auto &read : reads)
+      success = GuardRead(read, destformat, mayThrow, [&]{
+         read.pBlock->DoGetSamples(
+            read.dest, destformat, read.sampleoffset, read.numsamples);
+      }) && success;
+   return success;
+}
+
+bool SampleBlockFactory::GuardRead(const SampleBlockRead &read,
+   sampleFormat destformat, bool mayThrow, const std::function<void()> &action)
+{
+   try{ action(); return true; }
+   catch( ... ) {
+      if( mayThrow )
+         throw;
+      ClearSamples( read.dest, destformat, 0, read.numsamples );
+      return false;
+   }
+}
+
+void SampleBlockFactory::SetDeferredCommits(bool)
+{
+}
+
+void SampleBlockFactory::FlushCommits()
+{
+}
+
+size_t SampleBlockFactory::GetPendingCommitBytes() const
+{
+   return 0;
+}
+
 SampleBlock::~SampleBlock() = default;
 
 size_t SampleBlock::GetSamples(samplePtr dest,
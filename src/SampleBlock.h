@@ -15,6 +15,7 @@ SampleBlock.h
 #include <functional>
 #include <memory>
 #include <unordered_set>
+#include <vector>
 
 #include "XMLTagHandler.h"
 
@@ -81,6 +82,8 @@ public:
    virtual void SaveXML(XMLWriter &xmlFile) = 0;
 
 protected:
+   friend SampleBlockFactory;
+
    virtual size_t DoGetSamples(samplePtr dest,
                      sampleFormat destformat,
                      size_t sampleoffset,
@@ -91,6 +94,16 @@ protected:
    virtual MinMaxRMS DoGetMinMaxRMS() const = 0;
 };
 
+//! One part of a vectored read: a subrange of a block and where to put it
+struct SampleBlockRead
+{
+   SampleBlock *pBlock;
+   samplePtr dest;
+   size_t sampleoffset;
+   size_t numsamples;
+};
+using SampleBlockReads = std::vector<SampleBlockRead>;
+
 // Makes a useful function object
 inline std::function< void(const SampleBlock&) >
 BlockSpaceUsageAccumulator (unsigned long long &total)
@@ -129,6 +142,34 @@ public:
       sampleFormat srcformat,
       const AttributesList &attrs);
 
+   //! Fill several buffers from blocks made by this factory, in one pass
+   /*!
+    Each read behaves as SampleBlock::GetSamples, but the implementation
+    may fetch many blocks with one request to the storage.
+    If !mayThrow and there are errors, ignores them, zero-fills the buffers
+    of only the reads that failed, and returns false.
+    */
+   bool GetSamples(const SampleBlockReads &reads,
+      sampleFormat destformat, bool mayThrow = true);
+
+   //! Allow Create() to return before the block reaches storage
+   /*!
+    Meant for recording, so that the thread appending captured samples does
+    not wait for the disk.  Blocks made meanwhile answer reads from memory
+    until they are stored.  Turning it off waits for all pending writes, and
+    may throw if one of them failed.
+    Default implementation ignores the request.
+    */
+   virtual void SetDeferredCommits(bool defer);
+
+   //! Wait until all blocks made by deferred Create() are stored
+   /*! May throw if one of them failed.  Default implementation does nothing */
+   virtual void FlushCommits();
+
+   //! Number of sample bytes made by deferred Create() and not yet stored
+   /*! A measure of back-pressure from slow storage.  Default returns 0 */
+   virtual size_t GetPendingCommitBytes() const;
+
    using SampleBlockIDs = std::unordered_set<SampleBlockID>;
    /*! @return ids of all sample blocks created by this factory and still extant */
    virtual SampleBlockIDs GetActiveBlockIDs() = 0;
@@ -141,6 +182,17 @@ public:
       BlockDeletionCallback callback ) = 0;
 
 protected:
+   //! Default implementation reads the blocks one at a time
+   /*! Contract is that of GetSamples: a failed read either propagates its
+    exception, if mayThrow, or is zero-filled without disturbing the others */
+   virtual bool DoGetSamples(
+      const SampleBlockReads &reads, sampleFormat destformat, bool mayThrow);
+
+   //! Do one read; on error, rethrow if mayThrow, else zero-fill its buffer
+   /*! @return whether the read succeeded */
+   static bool GuardRead(const SampleBlockRead &read, sampleFormat destformat,
+      bool mayThrow, const std::function<void()> &action);
+
    // The override should throw more informative exceptions on error than the
    // default InconsistencyException thrown by Create
    virtual SampleBlockPtr DoCreate(constSamplePtr src,
@@ -0,0 +1,136 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file SampleBlockCache.cpp
+@brief Implements SampleBlockCache
+
+**********************************************************************/
+
+#include "SampleBlockCache.h"
+
+#include <algorithm>
+#include <limits>
+
+IntSetting SampleBlockCacheSize{ L"/Directories/SampleBlockCacheMB", 64 };
+
+SampleBlockCache &SampleBlockCache::Get()
+{
+   static SampleBlockCache instance;
+   return instance;
+}
+
+SampleBlockCache::SampleBlockCache()
+{
+   UpdatePrefs();
+}
+
+SampleBlockCache::~SampleBlockCache() = default;
+
+void SampleBlockCache::UpdatePrefs()
+{
+   const auto megabytes = std::max(0, SampleBlockCacheSize.Read());
+   const auto budget = static_cast<size_t>(megabytes) * 1024 * 1024;
+   mBudget.store(budget, std::memory_order_relaxed);
+
+   std::lock_guard<std::mutex> guard(mMutex);
+   Trim(budget);
+}
+
+auto SampleBlockCache::Lookup(const DBConnection &conn, SampleBlockID id)
+   -> EntryPtr
+{
+   {
+      std::lock_guard<std::mutex> guard(mMutex);
+      auto iter = mMap.find({ &conn, id });
+      if (iter != mMap.end()) {
+         // Move to the front of the recency list
+         mList.splice(mList.begin(), mList, iter->second);
+         ++mHits;
+         return iter->second->pEntry;
+      }
+   }
+   ++mMisses;
+   return {};
+}
+
+void SampleBlockCache::Insert(
+   const DBConnection &conn, SampleBlockID id, EntryPtr pEntry)
+{
+   if (!pEntry)
+      return;
+
+   const auto budget = mBudget.load(std::memory_order_relaxed);
+   const auto bytes = pEntry->count * SAMPLE_SIZE(pEntry->format);
+   if (bytes > budget)
+      return;
+
+   std::lock_guard<std::mutex> guard(mMutex);
+   Key key{ &conn, id };
+   auto iter = mMap.find(key);
+   if (iter != mMap.end()) {
+      // Another thread got here first; contents are the same
+      mList.splice(mList.begin(), mList, iter->second);
+      return;
+   }
+
+   Trim(budget - bytes);
+   mList.push_front({ key, std::move(pEntry) });
+   mMap.emplace(key, mList.begin());
+   mBytes += bytes;
+}
+
+void SampleBlockCache::Invalidate(const DBConnection &conn, SampleBlockID id)
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   auto iter = mMap.find({ &conn, id });
+   if (iter == mMap.end())
+      return;
+   auto &pEntry = iter->second->pEntry;
+   mBytes -= pEntry->count * SAMPLE_SIZE(pEntry->format);
+   mList.erase(iter->second);
+   mMap.erase(iter);
+}
+
+void SampleBlockCache::Invalidate(const DBConnection &conn)
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   // Keys are ordered by connection first, so the range is contiguous
+   auto first = mMap.lower_bound({ &conn, std::numeric_limits<SampleBlockID>::min() });
+   auto last = first;
+   for (; last != mMap.end() && last->first.first == &conn; ++last) {
+      auto &pEntry = last->second->pEntry;
+      mBytes -= pEntry->count * SAMPLE_SIZE(pEntry->format);
+      mList.erase(last->second);
+   }
+   mMap.erase(first, last);
+}
+
+void SampleBlockCache::Clear()
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   mMap.clear();
+   mList.clear();
+   mBytes = 0;
+   mHits = mMisses = mEvictions = 0;
+}
+
+auto SampleBlockCache::GetStatistics() const -> Statistics
+{
+   std::lock_guard<std::mutex> guard(mMutex);
+   return {
+      mHits.load(), mMisses.load(), mEvictions.load(),
+      mMap.size(), mBytes, mBudget.load()
+   };
+}
+
+void SampleBlockCache::Trim(size_t budget)
+{
+   while (mBytes > budget && !mList.empty()) {
+      auto &node = mList.back();
+      mBytes -= node.pEntry->count * SAMPLE_SIZE(node.pEntry->format);
+      mMap.erase(node.key);
+      mList.pop_back();
+      ++mEvictions;
+   }
+}
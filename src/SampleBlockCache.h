@@ -0,0 +1,118 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file SampleBlockCache.h
+@brief Declare SampleBlockCache, a process-wide cache of sample block contents
+
+**********************************************************************/
+
+#ifndef __AUDACITY_SAMPLE_BLOCK_CACHE__
+#define __AUDACITY_SAMPLE_BLOCK_CACHE__
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#include "Prefs.h" // to inherit
+#include "SampleFormat.h"
+
+class DBConnection;
+
+// From SampleBlock.h
+using SampleBlockID = long long;
+
+//! Number of megabytes of sample data that SampleBlockCache may retain
+extern AUDACITY_DLL_API IntSetting SampleBlockCacheSize;
+
+///\brief Bounded, thread-safe, least-recently-used cache of the sample data
+/// of blocks, as stored in the database, shared by all open projects
+/*!
+ Blocks in the database are never modified after they are inserted, so an
+ entry stays valid until the block is deleted or its connection is closed.
+ Entries are keyed by the connection too, because block ids are only unique
+ within one database.
+ */
+class AUDACITY_DLL_API SampleBlockCache final : private PrefsListener
+{
+public:
+   //! Contents of one block, in the format the block was stored with
+   struct Entry {
+      Entry(size_t numsamples, sampleFormat format)
+         : samples{ numsamples * SAMPLE_SIZE(format) }
+         , count{ numsamples }
+         , format{ format }
+      {}
+      ArrayOf<char> samples;
+      const size_t count;
+      const sampleFormat format;
+   };
+   using EntryPtr = std::shared_ptr<const Entry>;
+
+   struct Statistics {
+      size_t hits{};
+      size_t misses{};
+      size_t evictions{};
+      size_t entries{};
+      size_t bytes{};
+      size_t budget{};
+   };
+
+   static SampleBlockCache &Get();
+
+   SampleBlockCache(const SampleBlockCache&) = delete;
+   SampleBlockCache &operator=(const SampleBlockCache&) = delete;
+   ~SampleBlockCache() override;
+
+   //! Whether the preferences allow any caching at all
+   bool IsEnabled() const { return mBudget.load(std::memory_order_relaxed) > 0; }
+
+   //! Return the cached contents, or null (counted as a miss) if absent
+   EntryPtr Lookup(const DBConnection &conn, SampleBlockID id);
+
+   //! Remember contents of a block, evicting the least recently used as needed
+   /*! Does nothing if the entry alone exceeds the budget */
+   void Insert(const DBConnection &conn, SampleBlockID id, EntryPtr pEntry);
+
+   //! Forget one block, as when its row is deleted
+   void Invalidate(const DBConnection &conn, SampleBlockID id);
+
+   //! Forget all blocks of one connection, as when it closes
+   void Invalidate(const DBConnection &conn);
+
+   //! Forget everything and reset the counters
+   void Clear();
+
+   Statistics GetStatistics() const;
+
+private:
+   SampleBlockCache();
+
+   void UpdatePrefs() override;
+
+   //! @pre mMutex is locked
+   void Trim(size_t budget);
+
+   using Key = std::pair<const DBConnection *, SampleBlockID>;
+   struct Node {
+      Key key;
+      EntryPtr pEntry;
+   };
+   using List = std::list<Node>;
+
+   mutable std::mutex mMutex;
+   //! Most recently used at the front
+   List mList;
+   std::map<Key, List::iterator> mMap;
+   size_t mBytes{ 0 };
+
+   std::atomic<size_t> mBudget{ 0 };
+   std::atomic<size_t> mHits{ 0 };
+   std::atomic<size_t> mMisses{ 0 };
+   std::atomic<size_t> mEvictions{ 0 };
+};
+
+#endif
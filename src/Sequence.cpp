@@ -1080,7 +1080,9 @@ bool Sequence::Get(samplePtr buffer, sampleFormat format,
 bool Sequence::Get(int b, samplePtr buffer, sampleFormat format,
    sampleCount start, size_t len, bool mayThrow) const
 {
-   bool result = true;
+   // Describe all of the block reads first, so that the factory can
+   // fetch them together
+   SampleBlockReads reads;
    while (len) {
       const SeqBlock &block = mBlock[b];
       // start is in block
@@ -1088,15 +1090,21 @@ bool Sequence::Get(int b, samplePtr buffer, sampleFormat format,
       // bstart is not more than block length
       const auto blen = std::min(len, block.sb->GetSampleCount() - bstart);
 
-      if (! Read(buffer, format, block, bstart, blen, mayThrow) )
-         result = false;
+      reads.push_back({ block.sb.get(), buffer, bstart, blen });
 
       len -= blen;
       buffer += (blen * SAMPLE_SIZE(format));
       b++;
       start += blen;
    }
-   return result;
+
+   if (reads.size() == 1) {
+      auto &read = reads.front();
+      return Read(read.dest, format, mBlock[b - 1],
+         read.sampleoffset, read.numsamples, mayThrow);
+   }
+
+   return mpFactory->GetSamples(reads, format, mayThrow);
 }
 
 // Pass NULL to set silence
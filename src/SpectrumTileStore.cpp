@@ -0,0 +1,301 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file SpectrumTileStore.cpp
+
+**********************************************************************/
+
+#include "SpectrumTileStore.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sqlite3.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "AudacityException.h"
+#include "BasicUI.h"
+#include "DBConnection.h"
+#include "MemoryX.h"
+#include "Project.h"
+
+IntSetting SpectrumTileStoreSize{ L"/Spectrum/TileStoreMB", 32 };
+
+namespace {
+
+// CREATE SQL spectrumtiles
+// tilekey is a hash of all that the tile depends on.
+// used orders the tiles from least to most recently used.
+// bytes is the length of freq, kept apart so that it can be summed
+// without reading the blobs.
+std::string TileSchema(const char *schema)
+{
+   return std::string{ "CREATE TABLE IF NOT EXISTS " } + schema +
+      ".spectrumtiles"
+      "("
+      "  tilekey              INTEGER PRIMARY KEY,"
+      "  used                 INTEGER,"
+      "  bytes                INTEGER,"
+      "  freq                 BLOB"
+      ");";
+}
+
+constexpr auto TableExistsSQL =
+   "SELECT EXISTS(SELECT 1 FROM sqlite_master"
+   "  WHERE type = 'table' AND name = 'spectrumtiles');";
+
+size_t Budget()
+{
+   const auto megabytes = std::max(0, SpectrumTileStoreSize.Read());
+   return static_cast<size_t>(megabytes) * 1024 * 1024;
+}
+
+//! Run a prepared statement to completion, return the result code, and
+//! rewind the statement for its next use
+int StepAndReset(sqlite3_stmt *stmt)
+{
+   auto rc = sqlite3_step(stmt);
+   sqlite3_clear_bindings(stmt);
+   sqlite3_reset(stmt);
+   return rc;
+}
+
+bool TableExists(DBConnection &conn)
+{
+   // Prepare and cache statement...automatically finalized at DB close
+   auto stmt = conn.Prepare(DBConnection::CheckSpectrumTiles, TableExistsSQL);
+   bool exists = false;
+   if (sqlite3_step(stmt) == SQLITE_ROW)
+      exists = sqlite3_column_int(stmt, 0) != 0;
+   sqlite3_reset(stmt);
+   return exists;
+}
+
+DBConnection *GetConnection(AudacityProject &project)
+{
+   return ConnectionPtr::Get(project).mpConnection.get();
+}
+
+//! Tiles and uses of tiles not yet written to the project database
+/*!
+ Drawing only fills this; the writes happen later, all in one transaction
+ */
+struct PendingTiles final : ClientData::Base
+{
+   static PendingTiles &Get(AudacityProject &project);
+
+   void Clear()
+   {
+      uses.clear();
+      tiles.clear();
+      bytes = 0;
+   }
+
+   //! Keys of loaded and saved tiles, from least to most recently used
+   std::vector<uint64_t> uses;
+   //! Saved tiles
+   std::unordered_map<uint64_t, std::vector<float>> tiles;
+   size_t bytes{ 0 };
+   bool scheduled{ false };
+};
+
+const AudacityProject::AttachedObjects::RegisteredFactory sPendingTilesKey{
+   []( AudacityProject & ){ return std::make_shared<PendingTiles>(); }
+};
+
+PendingTiles &PendingTiles::Get(AudacityProject &project)
+{
+   return project.AttachedObjects::Get<PendingTiles>(sPendingTilesKey);
+}
+
+void Flush(AudacityProject &project);
+
+//! Flush when the event loop is next idle, not while drawing
+void Schedule(AudacityProject &project)
+{
+   auto &pending = PendingTiles::Get(project);
+   if (pending.scheduled)
+      return;
+   pending.scheduled = true;
+   BasicUI::CallAfter([wProject = project.weak_from_this()]{
+      if (const auto pProject = wProject.lock())
+         Flush(*pProject);
+   });
+}
+
+//! Delete the least recently used tiles until the rest fit in budget
+void Trim(DBConnection &conn, size_t budget)
+{
+   auto stmt = conn.Prepare(DBConnection::GetSpectrumTilesSize,
+      "SELECT TOTAL(bytes) FROM spectrumtiles;");
+   double total = 0;
+   if (sqlite3_step(stmt) == SQLITE_ROW)
+      total = sqlite3_column_double(stmt, 0);
+   sqlite3_reset(stmt);
+   if (total <= budget)
+      return;
+
+   std::vector<sqlite3_int64> victims;
+   stmt = conn.Prepare(DBConnection::GetSpectrumTilesByUse,
+      "SELECT tilekey, bytes FROM spectrumtiles ORDER BY used;");
+   while (total > budget && sqlite3_step(stmt) == SQLITE_ROW) {
+      victims.push_back(sqlite3_column_int64(stmt, 0));
+      total -= sqlite3_column_int64(stmt, 1);
+   }
+   sqlite3_reset(stmt);
+
+   stmt = conn.Prepare(DBConnection::DeleteSpectrumTile,
+      "DELETE FROM spectrumtiles WHERE tilekey = ?1;");
+   for (auto key : victims) {
+      sqlite3_bind_int64(stmt, 1, key);
+      if (StepAndReset(stmt) != SQLITE_DONE)
+         break;
+   }
+}
+
+//! Write the pending tiles and uses, and trim to the budget
+void Flush(AudacityProject &project)
+{
+   auto &pending = PendingTiles::Get(project);
+   pending.scheduled = false;
+   const auto pConn = GetConnection(project);
+   if (!pConn || pConn->IsReadOnly()) {
+      pending.Clear();
+      return;
+   }
+   auto &conn = *pConn;
+   const auto db = conn.DB();
+
+   // Don't join the transaction of an edit or a recording; the next Load()
+   // or Save() tries again
+   if (!sqlite3_get_autocommit(db))
+      return;
+
+   const auto uses = move(pending.uses);
+   auto tiles = move(pending.tiles);
+   pending.Clear();
+
+   try {
+      if (!TableExists(conn) &&
+          sqlite3_exec(db, TileSchema("main").c_str(),
+             nullptr, nullptr, nullptr) != SQLITE_OK)
+         return;
+
+      if (sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr) != SQLITE_OK)
+         return;
+      // The tiles can be computed again, so give up on any failure
+      auto rollback = finally([db]{
+         if (!sqlite3_get_autocommit(db))
+            sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+      });
+
+      auto stmt = conn.Prepare(DBConnection::GetSpectrumTilesLastUse,
+         "SELECT IFNULL(MAX(used), 0) FROM spectrumtiles;");
+      sqlite3_int64 used = 0;
+      if (sqlite3_step(stmt) == SQLITE_ROW)
+         used = sqlite3_column_int64(stmt, 0);
+      sqlite3_reset(stmt);
+
+      for (auto key : uses) {
+         ++used;
+         if (const auto iter = tiles.find(key); iter != tiles.end()) {
+            const auto &tile = iter->second;
+            const auto bytes = tile.size() * sizeof(float);
+            stmt = conn.Prepare(DBConnection::SaveSpectrumTile,
+               "INSERT OR REPLACE INTO spectrumtiles"
+               "  (tilekey, used, bytes, freq) VALUES (?1, ?2, ?3, ?4);");
+            sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(key));
+            sqlite3_bind_int64(stmt, 2, used);
+            sqlite3_bind_int64(stmt, 3, bytes);
+            sqlite3_bind_blob(stmt, 4, tile.data(), bytes, SQLITE_STATIC);
+            if (StepAndReset(stmt) != SQLITE_DONE)
+               return;
+            tiles.erase(iter);
+         }
+         else {
+            // Make it the most recently used
+            stmt = conn.Prepare(DBConnection::TouchSpectrumTile,
+               "UPDATE spectrumtiles SET used = ?2 WHERE tilekey = ?1;");
+            sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(key));
+            sqlite3_bind_int64(stmt, 2, used);
+            if (StepAndReset(stmt) != SQLITE_DONE)
+               return;
+         }
+      }
+
+      Trim(conn, Budget());
+      sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+   }
+   catch (const AudacityException &) {
+   }
+}
+
+}
+
+bool SpectrumTileStore::IsEnabled()
+{
+   return Budget() > 0;
+}
+
+bool SpectrumTileStore::Load(
+   AudacityProject &project, uint64_t key, float *dest, size_t count)
+{
+   const auto pConn = GetConnection(project);
+   if (!pConn || !IsEnabled())
+      return false;
+   auto &conn = *pConn;
+
+   auto &pending = PendingTiles::Get(project);
+   bool found = false;
+   if (const auto iter = pending.tiles.find(key);
+       iter != pending.tiles.end() && iter->second.size() == count) {
+      std::copy(iter->second.begin(), iter->second.end(), dest);
+      found = true;
+   }
+   else {
+      try {
+         if (!TableExists(conn))
+            return false;
+
+         auto stmt = conn.Prepare(DBConnection::LoadSpectrumTile,
+            "SELECT freq FROM spectrumtiles WHERE tilekey = ?1;");
+         sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(key));
+         if (sqlite3_step(stmt) == SQLITE_ROW &&
+             sqlite3_column_bytes(stmt, 0) == (int)(count * sizeof(float))) {
+            memcpy(dest, sqlite3_column_blob(stmt, 0), count * sizeof(float));
+            found = true;
+         }
+         sqlite3_clear_bindings(stmt);
+         sqlite3_reset(stmt);
+      }
+      catch (const AudacityException &) {
+         return false;
+      }
+   }
+
+   if (found && !conn.IsReadOnly()) {
+      // Remember the use, to write later
+      pending.uses.push_back(key);
+      Schedule(project);
+   }
+   return found;
+}
+
+void SpectrumTileStore::Save(
+   AudacityProject &project, uint64_t key, const float *src, size_t count)
+{
+   const auto pConn = GetConnection(project);
+   const auto budget = Budget();
+   const auto bytes = count * sizeof(float);
+   auto &pending = PendingTiles::Get(project);
+   if (!pConn || pConn->IsReadOnly() || pending.bytes + bytes > budget)
+      return;
+
+   auto &tile = pending.tiles[key];
+   pending.bytes += bytes - tile.size() * sizeof(float);
+   tile.assign(src, src + count);
+   pending.uses.push_back(key);
+   Schedule(project);
+}
@@ -0,0 +1,54 @@
+/*!********************************************************************
+
+Audacity: A Digital Audio Editor
+
+@file SpectrumTileStore.h
+@brief Persist computed spectrogram columns in the project file
+
+**********************************************************************/
+
+#ifndef __AUDACITY_SPECTRUM_TILE_STORE__
+#define __AUDACITY_SPECTRUM_TILE_STORE__
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Prefs.h"
+
+class AudacityProject;
+
+//! Number of megabytes of spectrogram tiles that one project file may retain
+/*! Zero disables the store */
+extern AUDACITY_DLL_API IntSetting SpectrumTileStoreSize;
+
+///\brief Least-recently-used table of spectrogram tiles in the project
+/// database, so that they outlive the session
+/*!
+ A tile is an opaque array of floats.  The caller's key must identify
+ everything its contents depend on -- the samples, the settings and the zoom.
+ The table is created when first needed, so projects that never show
+ spectrograms are unchanged.  Failures are not errors: a tile is only
+ ever a shortcut for computing it again.
+
+ Saved tiles, and the uses that order them, are kept in memory and written
+ in one transaction when the event loop is idle, so drawing does not write.
+ Tiles are not carried into a copy of the project, because the copy may
+ reuse the ids of dropped sample blocks, which the keys depend on.
+ */
+namespace SpectrumTileStore {
+
+//! Whether the preferences allow the store
+AUDACITY_DLL_API bool IsEnabled();
+
+//! Fill dest with count floats stored under key, and return whether found
+AUDACITY_DLL_API bool Load(
+   AudacityProject &project, uint64_t key, float *dest, size_t count);
+
+//! Store count floats under key, evicting the least recently used tiles to
+//! stay within the budget
+AUDACITY_DLL_API void Save(
+   AudacityProject &project, uint64_t key, const float *src, size_t count);
+
+}
+
+#endif
@@ -8,12 +8,30 @@ Paul Licameli -- split from SampleBlock.cpp and SampleBlock.h
 
 **********************************************************************/
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <deque>
+#include <exception>
 #include <float.h>
+#include <iterator>
+#include <mutex>
 #include <sqlite3.h>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 
 #include "DBConnection.h"
+#include "Prefs.h"
 #include "ProjectFileIO.h"
+#include "ProjectFormatExtensionsRegistry.h"
+#include "SampleBlockCache.h"
+#include "SampleCodec.h"
 #include "SampleFormat.h"
+#include "VectorOps.h"
+#include "WaveTrack.h"
 #include "XMLTagHandler.h"
 
 #include "SampleBlock.h" // to inherit
@@ -22,6 +40,14 @@ Paul Licameli -- split from SampleBlock.cpp and SampleBlock.h
 #include <wx/log.h>
 
 class SqliteSampleBlockFactory;
+class SqliteSampleBlockWriter;
+
+//! Identifies the SampleCodec applied to newly stored blocks, or none
+IntSetting SampleBlockCodec{ L"/Directories/SampleBlockCodec", SampleCodec::None };
+
+//! Whether a new block with the same samples as a live one shares its row
+BoolSetting SampleBlockDeduplication{
+   L"/Directories/SampleBlockDeduplication", false };
 
 ///\brief Implementation of @ref SampleBlock using Sqlite database
 class SqliteSampleBlock final : public SampleBlock
@@ -41,6 +67,18 @@ public:
    using Sizes = std::pair< size_t, size_t >;
    void Commit(Sizes sizes);
 
+   //! Copy the samples and take an id reserved by the factory, but leave
+   //! the summaries and the insertion to CommitDeferred()
+   Sizes SetSamplesDeferred(constSamplePtr src,
+      size_t numsamples, sampleFormat srcformat, SampleBlockID id);
+
+   using DeferredBlocks =
+      std::vector< std::pair< std::shared_ptr<SqliteSampleBlock>, Sizes > >;
+   //! Calculate summaries of blocks made by SetSamplesDeferred() and insert
+   //! their rows with stmt, which takes the parameters of BindDeferred()
+   /*! @return false if an insertion failed */
+   static bool CommitDeferred(sqlite3_stmt *stmt, const DeferredBlocks &blocks);
+
    void Delete();
 
    SampleBlockID GetBlockID() const override;
@@ -70,14 +108,53 @@ public:
 private:
    bool IsSilent() const { return mBlockID <= 0; }
    void Load(SampleBlockID sbid);
+   //! Read all samples from the database, or find them in SampleBlockCache
+   SampleBlockCache::EntryPtr GetCachedSamples();
+   //! Read and decode all samples from the database
+   SampleBlockCache::EntryPtr ReadSamples();
+   //! Decode the stored blob of samples
+   /*! @return null if it is malformed */
+   SampleBlockCache::EntryPtr DecodeSamples(
+      constSamplePtr blob, size_t blobbytes) const;
+   //! Choose the codec for storage of samples, and maybe encode them
+   /*! @return the blob to be stored, which may point into encoded */
+   std::pair<constSamplePtr, size_t> EncodeSamples(
+      constSamplePtr src, std::vector<char> &encoded);
+   //! Value of the sampleformat column, which also identifies the codec
+   int StoredFormat() const { return mSampleFormat | (mCodec << CodecShift); }
    bool GetSummary(float *dest,
                    size_t frameoffset,
                    size_t numframes,
-                   DBConnection::StatementID id,
-                   const char *sql);
+                   size_t framesamples,
+                   const char *column);
+
+   //! Extremes and sum of squares of samples, accumulated over subranges
+   struct RangeSummary {
+      float min{ FLT_MAX };
+      float max{ -FLT_MAX };
+      double sumsq{ 0 };
+   };
+   //! Stored summaries, coarsest first, that AccumulateRange() tries
+   struct SummaryLevel {
+      size_t framesamples;
+      const char *column;
+   };
+   static const SummaryLevel SummaryLevels[2];
+   //! Accumulate samples from start to end, using whole frames of the
+   //! coarsest summaries from SummaryLevels[level] on that fit, and reading
+   //! samples only for the remainders at the edges
+   void AccumulateRange(size_t level, size_t start, size_t end,
+      RangeSummary &summary);
+   //! Open one column of the block's row for incremental reading
+   /*! Throws on failure
+    @post return value is not null
+    */
+   sqlite3_blob *OpenBlob(const char *column);
+   //! Read a byte range of one column directly into dest, converting format
+   //! only if needed, and padding with zeroes past the end of the stored blob
    size_t GetBlob(void *dest,
                   sampleFormat destformat,
-                  sqlite3_stmt *stmt,
+                  const char *column,
                   sampleFormat srcformat,
                   size_t srcoffset,
                   size_t srcbytes);
@@ -87,7 +164,14 @@ private:
       bytesPerFrame = fields * sizeof(float),
    };
    Sizes SetSizes( size_t numsamples, sampleFormat srcformat );
-   void CalcSummary(Sizes sizes);
+   void CalcSummary(Sizes sizes, constSamplePtr src);
+   //! Bind the columns of one row of a deferred insertion, starting at
+   //! parameter number first; return nonzero on failure
+   int BindDeferred(sqlite3_stmt *stmt, int first, Sizes sizes,
+      std::pair<constSamplePtr, size_t> blob);
+
+   //! The sampleformat column keeps the codec in the high byte
+   static constexpr unsigned CodecShift = 24;
 
 private:
    //! This must never be called for silent blocks
@@ -99,6 +183,7 @@ private:
    }
 
    friend SqliteSampleBlockFactory;
+   friend SqliteSampleBlockWriter;
 
    const std::shared_ptr<SqliteSampleBlockFactory> mpFactory;
    bool mValid{ false };
@@ -110,6 +195,8 @@ private:
    size_t mSampleBytes;
    size_t mSampleCount;
    sampleFormat mSampleFormat;
+   //! How the samples are stored in the database
+   SampleCodec::ID mCodec{ SampleCodec::None };
 
    ArrayOf<char> mSummary256;
    ArrayOf<char> mSummary64k;
@@ -117,11 +204,467 @@ private:
    double mSumMax;
    double mSumRms;
 
+   //! Samples of a block made by SetSamplesDeferred(), until its row exists
+   //! and the project's connection can see it
+   /*! Accessed only with std::atomic_load and std::atomic_store */
+   SampleBlockCache::EntryPtr mpPending;
+
 #if defined(WORDS_BIGENDIAN)
 #error All sample block data is little endian...big endian not yet supported
 #endif
 };
 
+//! Copy a subrange of stored samples, padding with zeroes past their end
+static void CopyStoredSamples(constSamplePtr src,
+                              sampleFormat srcformat,
+                              size_t srccount,
+                              samplePtr dest,
+                              sampleFormat destformat,
+                              size_t sampleoffset,
+                              size_t numsamples)
+{
+   const auto offset = std::min(sampleoffset, srccount);
+   const auto copied = std::min(numsamples, srccount - offset);
+   CopySamples(src + offset * SAMPLE_SIZE(srcformat),
+               srcformat,
+               dest,
+               destformat,
+               copied);
+   ClearSamples(dest, destformat, copied, numsamples - copied);
+}
+
+//! Extremes and RMS of some samples; min and max are infinite if none
+static MinMaxRMS ComputeMinMaxRMS(const float *samples, size_t len)
+{
+   const auto result = SummarizeSamples(samples, len);
+   return { result.min, result.max,
+      len ? (float) sqrt(result.sumsq / len) : 0.0f };
+}
+
+//! Compute summary frames, like those stored in the database, directly
+//! from samples not yet stored
+static void CalcPendingSummary(const SampleBlockCache::Entry &entry,
+                               size_t framesamples,
+                               float *dest,
+                               size_t frameoffset,
+                               size_t numframes)
+{
+   Floats buffer{ framesamples };
+   for (size_t i = 0; i < numframes; ++i, dest += 3)
+   {
+      const auto start = (frameoffset + i) * framesamples;
+      if (start >= entry.count)
+      {
+         // As in CalcSummary, values that don't contribute
+         dest[0] = FLT_MAX;
+         dest[1] = -FLT_MAX;
+         dest[2] = 0.0f;
+         continue;
+      }
+      const auto len = std::min(framesamples, entry.count - start);
+      SamplesToFloats(entry.samples.get() + start * SAMPLE_SIZE(entry.format),
+         entry.format, buffer.get(), len);
+      const auto result = ComputeMinMaxRMS(buffer.get(), len);
+      dest[0] = result.min;
+      dest[1] = result.max;
+      dest[2] = result.RMS;
+   }
+}
+
+///\brief Background thread that stores the blocks a SqliteSampleBlockFactory
+/// makes while its commits are deferred
+/*!
+ The thread writes with a database connection of its own, in transactions of
+ its own, so that its rows are never part of the transactions of the
+ project's connection, and can't be lost when one of those rolls back.
+ Shared by the factory and the thread, so that the thread may outlive the
+ factory, which can happen when the thread releases the last block
+ */
+class SqliteSampleBlockWriter final
+   : public std::enable_shared_from_this<SqliteSampleBlockWriter>
+{
+public:
+   using Sizes = SqliteSampleBlock::Sizes;
+
+   //! Limit on memory held by pending blocks, beyond which Enqueue() waits
+   static constexpr size_t MaxPendingBytes = 256 * 1024 * 1024;
+
+   //! Limit on the rows of one transaction, so that the project's connection
+   //! never waits long for the database while the thread catches up
+   static constexpr size_t MaxTransactionBytes = 32 * 1024 * 1024;
+
+   //! How many ids are reserved in the database at once
+   static constexpr SampleBlockID ReservedIDs = 256;
+
+   //! How many times to begin a transaction, each time waiting as long as
+   //! the connection's busy timeout, before failing
+   static constexpr int MaxBeginAttempts = 6;
+
+   //! Open a connection of its own to the database of conn, reserve the
+   //! first ids, and start the thread
+   /*! @return false if that failed; then the thread does not run */
+   bool Start(DBConnection &conn);
+
+   //! Take an id that the database will not assign to any other row,
+   //! waiting if the thread has not yet reserved more
+   /*! Rethrows any failure of an earlier write */
+   SampleBlockID TakeBlockID();
+
+   //! Queue a block for storage, waiting while too much is already queued
+   /*! Rethrows any failure of an earlier write */
+   void Enqueue(const std::shared_ptr<SqliteSampleBlock> &pBlock,
+      Sizes sizes, size_t bytes);
+
+   //! Wait until the queue is empty; rethrow any failure of a write
+   void Flush();
+
+   //! Stop the thread after it empties the queue, not waiting for it if
+   //! called from the thread itself
+   void Shutdown();
+
+   size_t GetPendingBytes() const;
+
+private:
+   void Run();
+
+   //! In one transaction, maybe reserve ids, then insert the rows of blocks
+   /*! Throws on failure, after rolling back
+    @return the first of the reserved ids, or 0 if there are none */
+   SampleBlockID Store(
+      const SqliteSampleBlock::DeferredBlocks &blocks, bool reserve);
+
+   //! Advance the AUTOINCREMENT counter of the table past ReservedIDs ids,
+   //! which no insertion without explicit id will then take
+   /*! Throws on failure
+    @return the first of the ids */
+   SampleBlockID ReserveIDs();
+
+   //! Forget the samples of blocks with committed rows, which are then read
+   //! from the database, unless the project's connection holds a savepoint
+   //! begun before the commit, which can't see the rows
+   void ReleaseCommitted();
+
+   [[noreturn]] void Fail(int rc, const char *context);
+
+   //! Finalize the statements and close the connection
+   void Close();
+
+   struct Item {
+      std::weak_ptr<SqliteSampleBlock> wBlock;
+      Sizes sizes;
+      size_t bytes;
+   };
+
+   //! The project's connection, used to key cached samples, to test for
+   //! its transactions, and to report errors
+   DBConnection *mpConn{};
+   //! The thread's own connection, and its statements
+   sqlite3 *mDB{};
+   sqlite3_stmt *mInsertStatement{};
+   sqlite3_stmt *mGetSequenceStatement{};
+   sqlite3_stmt *mSetSequenceStatement{};
+
+   //! Blocks with committed rows whose samples are still in memory; used
+   //! only by the thread
+   std::vector<std::weak_ptr<SqliteSampleBlock>> mCommitted;
+
+   std::thread mThread;
+   mutable std::mutex mMutex;
+   std::condition_variable mCondition;
+   std::deque<Item> mQueue;
+   //! Half-open ranges of reserved ids not yet taken
+   std::deque<std::pair<SampleBlockID, SampleBlockID>> mIDs;
+   SampleBlockID mIDCount{ 0 };
+   bool mNeedIDs{ false };
+   size_t mPendingBytes{ 0 };
+   bool mBusy{ false };
+   bool mStop{ false };
+   std::exception_ptr mpException;
+};
+
+bool SqliteSampleBlockWriter::Start(DBConnection &conn)
+{
+   mpConn = &conn;
+   mDB = conn.OpenWriter();
+   if (!mDB)
+      return false;
+
+   const auto prepare = [this](const char *sql, sqlite3_stmt *&stmt){
+      return sqlite3_prepare_v2(mDB, sql, -1, &stmt, nullptr) == SQLITE_OK;
+   };
+   bool started =
+      prepare(
+         "INSERT INTO sampleblocks (blockid, sampleformat, summin, summax,"
+         "                          sumrms, summary256, summary64k, samples)"
+         "  VALUES(?1,?2,?3,?4,?5,?6,?7,?8);", mInsertStatement) &&
+      prepare(
+         "SELECT seq FROM sqlite_sequence WHERE name = 'sampleblocks';",
+         mGetSequenceStatement) &&
+      prepare(
+         "UPDATE sqlite_sequence SET seq = ?1 WHERE name = 'sampleblocks';",
+         mSetSequenceStatement);
+   if (started) {
+      try {
+         const auto first = Store({}, true);
+         mIDs.emplace_back(first, first + ReservedIDs);
+         mIDCount = ReservedIDs;
+      }
+      catch (const AudacityException &) {
+         started = false;
+      }
+   }
+   if (!started) {
+      Close();
+      return false;
+   }
+
+   mThread = std::thread(
+      [pThis = shared_from_this()]{ pThis->Run(); });
+   return true;
+}
+
+void SqliteSampleBlockWriter::Close()
+{
+   for (auto stmt : { mInsertStatement,
+      mGetSequenceStatement, mSetSequenceStatement })
+      sqlite3_finalize(stmt);
+   mInsertStatement = mGetSequenceStatement = mSetSequenceStatement = nullptr;
+   sqlite3_close(mDB);
+   mDB = nullptr;
+}
+
+SampleBlockID SqliteSampleBlockWriter::TakeBlockID()
+{
+   std::unique_lock<std::mutex> lock{ mMutex };
+   mCondition.wait(lock, [this]{ return mIDCount > 0 || mpException; });
+   if (mIDCount == 0)
+      std::rethrow_exception(mpException);
+   auto &range = mIDs.front();
+   const auto id = range.first++;
+   if (range.first == range.second)
+      mIDs.pop_front();
+   // Ask for more early, so that the producer rarely waits
+   if (--mIDCount < ReservedIDs / 2 && !mNeedIDs) {
+      mNeedIDs = true;
+      mCondition.notify_all();
+   }
+   return id;
+}
+
+void SqliteSampleBlockWriter::Enqueue(
+   const std::shared_ptr<SqliteSampleBlock> &pBlock, Sizes sizes, size_t bytes)
+{
+   std::unique_lock<std::mutex> lock{ mMutex };
+   // Back-pressure:  bound the memory, and let the producer feel the disk
+   mCondition.wait(lock, [this]{
+      return mPendingBytes < MaxPendingBytes || mpException; });
+   if (mpException)
+      std::rethrow_exception(mpException);
+   mQueue.push_back({ pBlock, sizes, bytes });
+   mPendingBytes += bytes;
+   mCondition.notify_all();
+}
+
+void SqliteSampleBlockWriter::Flush()
+{
+   std::unique_lock<std::mutex> lock{ mMutex };
+   mCondition.wait(lock, [this]{ return mQueue.empty() && !mBusy; });
+   if (mpException)
+      std::rethrow_exception(mpException);
+}
+
+void SqliteSampleBlockWriter::Shutdown()
+{
+   {
+      std::lock_guard<std::mutex> guard{ mMutex };
+      mStop = true;
+      mCondition.notify_all();
+   }
+   if (mThread.get_id() == std::this_thread::get_id())
+      mThread.detach();
+   else if (mThread.joinable())
+      mThread.join();
+}
+
+size_t SqliteSampleBlockWriter::GetPendingBytes() const
+{
+   std::lock_guard<std::mutex> guard{ mMutex };
+   return mPendingBytes;
+}
+
+void SqliteSampleBlockWriter::Fail(int rc, const char *context)
+{
+   ADD_EXCEPTION_CONTEXT("sqlite3.rc", std::to_string(rc));
+   ADD_EXCEPTION_CONTEXT("sqlite3.context", context);
+
+   wxLogDebug(wxT("SqliteSampleBlockWriter - SQLITE error %s"),
+      sqlite3_errmsg(mDB));
+
+   // Just showing the user a simple message, not the library error too
+   // which isn't internationalized
+   mpConn->ThrowException( true );
+}
+
+SampleBlockID SqliteSampleBlockWriter::ReserveIDs()
+{
+   // The transaction keeps other connections from inserting between the
+   // reading and the writing of the counter
+   auto stmt = mGetSequenceStatement;
+   SampleBlockID seq = 0;
+   int rc = sqlite3_step(stmt);
+   const bool found = (rc == SQLITE_ROW);
+   if (found)
+      seq = sqlite3_column_int64(stmt, 0);
+   sqlite3_reset(stmt);
+   if (!found && rc != SQLITE_DONE)
+      Fail(rc, "SqliteSampleBlockWriter::ReserveIDs::select");
+
+   if (!found) {
+      // No row was ever inserted
+      rc = sqlite3_exec(mDB,
+         "INSERT INTO sqlite_sequence (name, seq) VALUES ('sampleblocks', 0);",
+         nullptr, nullptr, nullptr);
+      if (rc != SQLITE_OK)
+         Fail(rc, "SqliteSampleBlockWriter::ReserveIDs::insert");
+   }
+
+   stmt = mSetSequenceStatement;
+   sqlite3_bind_int64(stmt, 1, seq + ReservedIDs);
+   rc = sqlite3_step(stmt);
+   sqlite3_clear_bindings(stmt);
+   sqlite3_reset(stmt);
+   if (rc != SQLITE_DONE)
+      Fail(rc, "SqliteSampleBlockWriter::ReserveIDs::update");
+
+   return seq + 1;
+}
+
+SampleBlockID SqliteSampleBlockWriter::Store(
+   const SqliteSampleBlock::DeferredBlocks &blocks, bool reserve)
+{
+   // Nothing is written yet, so wait a while for the lock while another
+   // connection writes; but fail, rather than stall the producer forever,
+   // if the lock is never released
+   int rc = SQLITE_BUSY;
+   for (int attempt = 0;
+        rc == SQLITE_BUSY && attempt < MaxBeginAttempts; ++attempt)
+      rc = sqlite3_exec(mDB, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr);
+   if (rc != SQLITE_OK)
+      Fail(rc, "SqliteSampleBlockWriter::Store::begin");
+
+   bool committed = false;
+   auto cleanup = finally([&]{
+      if (!committed)
+         sqlite3_exec(mDB, "ROLLBACK;", nullptr, nullptr, nullptr);
+   });
+
+   const auto first = reserve ? ReserveIDs() : 0;
+   if (!SqliteSampleBlock::CommitDeferred(mInsertStatement, blocks))
+      Fail(sqlite3_errcode(mDB), "SqliteSampleBlockWriter::Store::insert");
+
+   rc = sqlite3_exec(mDB, "COMMIT;", nullptr, nullptr, nullptr);
+   if (rc != SQLITE_OK)
+      Fail(rc, "SqliteSampleBlockWriter::Store::commit");
+   committed = true;
+
+   // Rows exist now; reads may find the samples in the cache, and the
+   // samples leave memory when the rows are visible to the project
+   auto &cache = SampleBlockCache::Get();
+   for (auto &[pBlock, sizes] : blocks) {
+      if (cache.IsEnabled())
+         cache.Insert(*mpConn, pBlock->mBlockID,
+            std::atomic_load(&pBlock->mpPending));
+      mCommitted.push_back(pBlock);
+   }
+   return first;
+}
+
+void SqliteSampleBlockWriter::ReleaseCommitted()
+{
+   // A savepoint that begins after this test sees the committed rows
+   if (mCommitted.empty() || mpConn->InSavepoint())
+      return;
+   for (auto &wBlock : mCommitted)
+      if (auto pBlock = wBlock.lock())
+         std::atomic_store(&pBlock->mpPending, SampleBlockCache::EntryPtr{});
+   mCommitted.clear();
+}
+
+void SqliteSampleBlockWriter::Run()
+{
+   while (true)
+   {
+      std::vector<Item> items;
+      bool failed, reserve;
+      {
+         std::unique_lock<std::mutex> lock{ mMutex };
+         const auto ready = [this]{
+            return !mQueue.empty() || mNeedIDs || mStop; };
+         if (mCommitted.empty())
+            mCondition.wait(lock, ready);
+         else
+            // Try again soon to release the committed blocks
+            mCondition.wait_for(lock, std::chrono::milliseconds{ 50 }, ready);
+         if (mQueue.empty() && mStop)
+            break;
+         if (!ready()) {
+            lock.unlock();
+            ReleaseCommitted();
+            continue;
+         }
+         // Take the whole queue into one transaction, within limits
+         size_t count = 0, bytes = 0;
+         while (count < mQueue.size() && (count == 0 ||
+            bytes + mQueue[count].bytes <= MaxTransactionBytes))
+            bytes += mQueue[count++].bytes;
+         items.assign(std::make_move_iterator(mQueue.begin()),
+                      std::make_move_iterator(mQueue.begin() + count));
+         mQueue.erase(mQueue.begin(), mQueue.begin() + count);
+         reserve = mNeedIDs;
+         mBusy = true;
+         failed = !!mpException;
+      }
+
+      size_t bytes = 0;
+      SampleBlockID first = 0;
+      std::exception_ptr pException;
+      {
+         // Blocks discarded while queued are skipped; they never get rows
+         SqliteSampleBlock::DeferredBlocks blocks;
+         for (auto &item : items) {
+            bytes += item.bytes;
+            if (auto pBlock = item.wBlock.lock())
+               blocks.emplace_back(pBlock, item.sizes);
+         }
+         // After one failure, leave the rest in memory
+         if (!failed) {
+            try { first = Store(blocks, reserve); }
+            catch (...) { pException = std::current_exception(); }
+         }
+         ReleaseCommitted();
+         // Release of blocks here may destroy them in this thread, and even
+         // the factory, but not this
+      }
+
+      std::lock_guard<std::mutex> guard{ mMutex };
+      mPendingBytes -= bytes;
+      mBusy = false;
+      if (reserve) {
+         mNeedIDs = false;
+         if (first > 0) {
+            mIDs.emplace_back(first, first + ReservedIDs);
+            mIDCount += ReservedIDs;
+         }
+      }
+      if (pException && !mpException)
+         mpException = pException;
+      mCondition.notify_all();
+   }
+
+   ReleaseCommitted();
+   Close();
+}
+
 // Silent blocks use nonpositive id values to encode a length
 // and don't occupy any rows in the database; share blocks for repeatedly
 // used length values
@@ -132,6 +675,7 @@ static std::map< SampleBlockID, std::shared_ptr<SqliteSampleBlock> >
 class SqliteSampleBlockFactory final
    : public SampleBlockFactory
    , public std::enable_shared_from_this<SqliteSampleBlockFactory>
+   , private PrefsListener
 {
 public:
    explicit SqliteSampleBlockFactory( AudacityProject &project );
@@ -155,9 +699,61 @@ public:
    BlockDeletionCallback SetBlockDeletionCallback(
       BlockDeletionCallback callback ) override;
 
+   void SetDeferredCommits(bool defer) override;
+   void FlushCommits() override;
+   size_t GetPendingCommitBytes() const override;
+
+   bool HasEncodedBlocks() const
+   { return mEncoded.load(std::memory_order_relaxed); }
+
+protected:
+   bool DoGetSamples(const SampleBlockReads &reads,
+      sampleFormat destformat, bool mayThrow) override;
+
 private:
    friend SqliteSampleBlock;
 
+   using Pending = std::pair<const SampleBlockRead *, SqliteSampleBlock *>;
+   using PendingIter = std::vector<Pending>::const_iterator;
+
+   //! Fetch the blocks of reads [first, last), whose distinct ids are given,
+   //! with one query; throws if any of them can't be read
+   void ReadBatch(PendingIter first, PendingIter last,
+      const std::vector<SampleBlockID> &ids, sampleFormat destformat);
+
+   void UpdatePrefs() override;
+
+   //! Codec for newly stored blocks, read from preferences in the main
+   //! thread but used also by the thread that writes deferred blocks
+   std::atomic<SampleCodec::ID> mCodec{ SampleCodec::None };
+
+   //! Whether any block was stored with a codec or loaded with one, so that
+   //! the project must be protected from versions without codecs; set also
+   //! by the thread that writes deferred blocks
+   std::atomic<bool> mEncoded{ false };
+
+   //! Whether DoCreate() looks for a live block with the same samples,
+   //! read from preferences in the main thread but used also by recording
+   std::atomic<bool> mDeduplicate{ false };
+
+   //! Hash of samples, also distinguishing format and count
+   static size_t HashSamples(
+      constSamplePtr src, size_t numsamples, sampleFormat srcformat);
+
+   //! A live block made by DoCreate() with exactly the given samples
+   /*! @return null if there is none */
+   std::shared_ptr<SqliteSampleBlock> FindDuplicate(size_t hash,
+      constSamplePtr src, size_t numsamples, sampleFormat srcformat);
+
+   //! Not null while commits are deferred
+   std::shared_ptr<SqliteSampleBlockWriter> mpWriter;
+
+   //! Number of block ids bound in one statement by DoGetSamples
+   static constexpr size_t BatchSize = 16;
+
+   //! @post return value is not null
+   DBConnection *Conn() const;
+
    const std::shared_ptr<ConnectionPtr> mppConnection;
 
    // Track all blocks that this factory has created, but don't control
@@ -168,24 +764,115 @@ private:
       std::map< SampleBlockID, std::weak_ptr< SqliteSampleBlock > >;
    AllBlocksMap mAllBlocks;
 
+   // Blocks that DoCreate() made while deduplicating, by HashSamples().
+   // Sharing needs no count of references in the database:  the block is
+   // shared by pointer, like copies of it, and its row goes with the last
+   using ContentMap =
+      std::unordered_multimap< size_t, std::weak_ptr< SqliteSampleBlock > >;
+   ContentMap mContentBlocks;
+   //! Size of mContentBlocks after it was last purged of expired pointers
+   size_t mContentBlocksPurged{ 0 };
+
    BlockDeletionCallback mCallback;
 };
 
 SqliteSampleBlockFactory::SqliteSampleBlockFactory( AudacityProject &project )
    : mppConnection{ ConnectionPtr::Get(project).shared_from_this() }
 {
-   
+   UpdatePrefs();
+}
+
+void SqliteSampleBlockFactory::UpdatePrefs()
+{
+   const auto id = SampleBlockCodec.Read();
+   // Ignore unknown codecs, as from a later version sharing preferences
+   const bool known = id >= 0 && id <= UCHAR_MAX &&
+      SampleCodec::Find(static_cast<SampleCodec::ID>(id));
+   mCodec.store(known ? static_cast<SampleCodec::ID>(id) : SampleCodec::None,
+      std::memory_order_relaxed);
+   mDeduplicate.store(SampleBlockDeduplication.Read(),
+      std::memory_order_relaxed);
+}
+
+SqliteSampleBlockFactory::~SqliteSampleBlockFactory()
+{
+   // No blocks remain, so nothing remains to be written
+   if (mpWriter)
+      mpWriter->Shutdown();
+}
+
+size_t SqliteSampleBlockFactory::HashSamples(
+   constSamplePtr src, size_t numsamples, sampleFormat srcformat)
+{
+   const std::string_view bytes{ src, numsamples * SAMPLE_SIZE(srcformat) };
+   auto hash = std::hash<std::string_view>{}(bytes);
+   hash ^= numsamples + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+   hash ^= static_cast<size_t>(srcformat) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+   return hash;
 }
 
-SqliteSampleBlockFactory::~SqliteSampleBlockFactory() = default;
+std::shared_ptr<SqliteSampleBlock> SqliteSampleBlockFactory::FindDuplicate(
+   size_t hash, constSamplePtr src, size_t numsamples, sampleFormat srcformat)
+{
+   const auto bytes = numsamples * SAMPLE_SIZE(srcformat);
+   const auto range = mContentBlocks.equal_range(hash);
+   for (auto iter = range.first; iter != range.second;) {
+      auto pBlock = iter->second.lock();
+      if (!pBlock) {
+         iter = mContentBlocks.erase(iter);
+         continue;
+      }
+      ++iter;
+      if (pBlock->mSampleFormat != srcformat ||
+          pBlock->mSampleCount != numsamples)
+         continue;
+      // A hash collision is unlikely, but must not corrupt audio, so compare
+      // with the samples, which are probably cached, if not pending
+      auto pEntry = std::atomic_load(&pBlock->mpPending);
+      if (!pEntry)
+         pEntry = pBlock->GetCachedSamples();
+      if (pEntry && pEntry->count == numsamples &&
+          memcmp(pEntry->samples.get(), src, bytes) == 0)
+         return pBlock;
+   }
+   return nullptr;
+}
 
 SampleBlockPtr SqliteSampleBlockFactory::DoCreate(
    constSamplePtr src, size_t numsamples, sampleFormat srcformat )
 {
+   const bool deduplicate = mDeduplicate.load(std::memory_order_relaxed);
+   size_t hash = 0;
+   if (deduplicate) {
+      hash = HashSamples(src, numsamples, srcformat);
+      if (auto pBlock = FindDuplicate(hash, src, numsamples, srcformat))
+         return pBlock;
+   }
+
    auto sb = std::make_shared<SqliteSampleBlock>(shared_from_this());
-   sb->SetSamples(src, numsamples, srcformat);
+   if (mpWriter) {
+      const auto sizes = sb->SetSamplesDeferred(
+         src, numsamples, srcformat, mpWriter->TakeBlockID());
+      mpWriter->Enqueue(sb, sizes, sb->mSampleBytes);
+   }
+   else
+      sb->SetSamples(src, numsamples, srcformat);
    // block id has now been assigned
    mAllBlocks[ sb->GetBlockID() ] = sb;
+
+   if (deduplicate) {
+      // Purge expired pointers when the map doubles, so that they can't
+      // accumulate without bound
+      if (mContentBlocks.size() >= 2 * std::max<size_t>(mContentBlocksPurged, 256)) {
+         for (auto iter = mContentBlocks.begin(); iter != mContentBlocks.end();)
+            if (iter->second.expired())
+               iter = mContentBlocks.erase(iter);
+            else
+               ++iter;
+         mContentBlocksPurged = mContentBlocks.size();
+      }
+      mContentBlocks.emplace(hash, sb);
+   }
    return sb;
 }
 
@@ -274,6 +961,201 @@ SampleBlockPtr SqliteSampleBlockFactory::DoCreateFromXML(
    return sb;
 }
 
+bool SqliteSampleBlockFactory::DoGetSamples(
+   const SampleBlockReads &reads, sampleFormat destformat, bool mayThrow)
+{
+   bool success = true;
+
+   // All blocks in the reads were made by this factory (or are silent)
+   std::vector<Pending> pending;
+   pending.reserve(reads.size());
+
+   // Satisfy what is possible without a query:  silent, not yet stored,
+   // and cached blocks
+   auto &cache = SampleBlockCache::Get();
+   const bool useCache = cache.IsEnabled();
+   for (auto &read : reads) {
+      success = GuardRead(read, destformat, mayThrow, [&]{
+         auto &block = static_cast<SqliteSampleBlock&>(*read.pBlock);
+         if (block.IsSilent() || std::atomic_load(&block.mpPending)) {
+            block.DoGetSamples(
+               read.dest, destformat, read.sampleoffset, read.numsamples);
+            return;
+         }
+         if (useCache) {
+            if (auto pEntry = cache.Lookup(*Conn(), block.mBlockID)) {
+               CopyStoredSamples(pEntry->samples.get(), pEntry->format,
+                  pEntry->count, read.dest, destformat,
+                  read.sampleoffset, read.numsamples);
+               return;
+            }
+         }
+         if (!block.mValid)
+            block.Load(block.mBlockID);
+         pending.emplace_back(&read, &block);
+      }) && success;
+   }
+
+   auto first = pending.begin(), end = pending.end();
+   while (first != end) {
+      // Gather up to BatchSize distinct ids; unused parameters bind to 0,
+      // which is never the id of a stored block
+      std::vector<SampleBlockID> ids;
+      auto last = first;
+      for (; last != end; ++last) {
+         const auto id = last->second->mBlockID;
+         if (std::find(ids.begin(), ids.end(), id) == ids.end()) {
+            if (ids.size() == BatchSize)
+               break;
+            ids.push_back(id);
+         }
+      }
+
+      try {
+         ReadBatch(first, last, ids, destformat);
+      }
+      catch (...) {
+         if (mayThrow)
+            throw;
+         // Find the culprits by reading each block of the batch by itself,
+         // so that only their reads are zero-filled
+         for (auto iter = first; iter != last; ++iter) {
+            auto &read = *iter->first;
+            auto &block = *iter->second;
+            success = GuardRead(read, destformat, false, [&]{
+               block.DoGetSamples(
+                  read.dest, destformat, read.sampleoffset, read.numsamples);
+            }) && success;
+         }
+      }
+
+      first = last;
+   }
+
+   return success;
+}
+
+void SqliteSampleBlockFactory::ReadBatch(
+   PendingIter first, PendingIter last,
+   const std::vector<SampleBlockID> &ids, sampleFormat destformat)
+{
+   auto &cache = SampleBlockCache::Get();
+   const bool useCache = cache.IsEnabled();
+
+   auto db = Conn()->DB();
+
+   // Prepare and cache statement...automatically finalized at DB close
+   sqlite3_stmt *stmt = Conn()->Prepare(DBConnection::GetSamplesBatch,
+      "SELECT blockid, samples FROM sampleblocks WHERE blockid IN"
+      " (?1,?2,?3,?4,?5,?6,?7,?8,?9,?10,?11,?12,?13,?14,?15,?16);");
+
+   // Clear statement bindings and rewind statement, however we leave
+   auto cleanup = finally([&]{
+      sqlite3_clear_bindings(stmt);
+      sqlite3_reset(stmt);
+   });
+
+   // Bind statement parameters
+   // Might return SQLITE_MISUSE which means it's our mistake that we violated
+   // preconditions; should return SQL_OK which is 0
+   for (size_t ii = 0; ii < BatchSize; ++ii) {
+      if (sqlite3_bind_int64(stmt, ii + 1, ii < ids.size() ? ids[ii] : 0))
+      {
+         ADD_EXCEPTION_CONTEXT(
+            "sqlite3.rc", std::to_string(sqlite3_errcode(db)));
+         ADD_EXCEPTION_CONTEXT("sqlite3.context",
+            "SqliteSampleBlockFactory::ReadBatch::bind");
+
+         wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
+      }
+   }
+
+   // Execute the statement, distributing each row to its reads
+   size_t found = 0;
+   int rc;
+   while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+   {
+      const SampleBlockID id = sqlite3_column_int64(stmt, 0);
+      auto src = (constSamplePtr) sqlite3_column_blob(stmt, 1);
+      const auto blobbytes = (size_t) sqlite3_column_bytes(stmt, 1);
+      ++found;
+
+      auto iter = std::find_if(first, last,
+         [id](const Pending &pair){ return pair.second->mBlockID == id; });
+      if (iter == last)
+         continue;
+      const auto &block = *iter->second;
+
+      // Encoded blocks are decoded whole, then served like cached blocks
+      SampleBlockCache::EntryPtr pEntry;
+      if (useCache || block.mCodec != SampleCodec::None) {
+         pEntry = block.DecodeSamples(src, blobbytes);
+         if (!pEntry)
+            break;
+      }
+
+      for (; iter != last; ++iter) {
+         if (iter->second->mBlockID != id)
+            continue;
+         auto &read = *iter->first;
+         if (pEntry)
+            CopyStoredSamples(pEntry->samples.get(), pEntry->format,
+               pEntry->count, read.dest, destformat,
+               read.sampleoffset, read.numsamples);
+         else {
+            const auto format = block.mSampleFormat;
+            CopyStoredSamples(src, format, blobbytes / SAMPLE_SIZE(format),
+               read.dest, destformat, read.sampleoffset, read.numsamples);
+         }
+      }
+
+      if (useCache)
+         cache.Insert(*Conn(), id, pEntry);
+   }
+
+   if (rc != SQLITE_DONE || found != ids.size())
+   {
+      ADD_EXCEPTION_CONTEXT("sqlite3.rc", std::to_string(rc));
+      ADD_EXCEPTION_CONTEXT("sqlite3.context",
+         "SqliteSampleBlockFactory::ReadBatch::step");
+
+      wxLogDebug(wxT("SqliteSampleBlockFactory::ReadBatch - SQLITE error %s"),
+         sqlite3_errmsg(db));
+
+      // Just showing the user a simple message, not the library error too
+      // which isn't internationalized
+      Conn()->ThrowException( false );
+   }
+}
+
+void SqliteSampleBlockFactory::SetDeferredCommits(bool defer)
+{
+   if (defer && !mpWriter) {
+      // Without a connection of its own for the writer, store blocks as
+      // they are made
+      auto pWriter = std::make_shared<SqliteSampleBlockWriter>();
+      auto &pConnection = mppConnection->mpConnection;
+      if (pConnection && pWriter->Start(*pConnection))
+         mpWriter = std::move(pWriter);
+   }
+   else if (!defer && mpWriter) {
+      auto pWriter = std::move(mpWriter);
+      auto cleanup = finally([&]{ pWriter->Shutdown(); });
+      pWriter->Flush();
+   }
+}
+
+void SqliteSampleBlockFactory::FlushCommits()
+{
+   if (mpWriter)
+      mpWriter->Flush();
+}
+
+size_t SqliteSampleBlockFactory::GetPendingCommitBytes() const
+{
+   return mpWriter ? mpWriter->GetPendingBytes() : 0;
+}
+
 auto SqliteSampleBlockFactory::SetBlockDeletionCallback(
    BlockDeletionCallback callback ) -> BlockDeletionCallback
 {
@@ -332,8 +1214,14 @@ DBConnection *SqliteSampleBlock::Conn() const
    if (!mpFactory)
       return nullptr;
 
-   auto &pConnection = mpFactory->mppConnection->mpConnection;
-   if (!pConnection) {
+   return mpFactory->Conn();
+}
+
+DBConnection *SqliteSampleBlockFactory::Conn() const
+{
+   auto &pConnection = mppConnection->mpConnection;
+   // Another thread may find a connection closed but not yet destroyed
+   if (!pConnection || !pConnection->IsOpen()) {
       throw SimpleMessageBoxException
       {
          ExceptionType::Internal,
@@ -376,18 +1264,147 @@ size_t SqliteSampleBlock::DoGetSamples(samplePtr dest,
       return numsamples;
    }
 
-   // Prepare and cache statement...automatically finalized at DB close
-   sqlite3_stmt *stmt = Conn()->Prepare(DBConnection::GetSamples,
-      "SELECT samples FROM sampleblocks WHERE blockid = ?1;");
+   if (const auto pPending = std::atomic_load(&mpPending)) {
+      CopyStoredSamples(pPending->samples.get(), pPending->format,
+         pPending->count, dest, destformat, sampleoffset, numsamples);
+      return numsamples;
+   }
+
+   if (!mValid)
+   {
+      Load(mBlockID);
+   }
+
+   // Encoded blocks can only be decoded whole, so cache them even if the
+   // cache is disabled; then insertion is just refused.
+   // Other blocks are cached only when reading at least half of them; short
+   // reads, as for drawing and scrubbing, read just their range.
+   auto &cache = SampleBlockCache::Get();
+   if (cache.IsEnabled() || mCodec != SampleCodec::None) {
+      const bool whole =
+         mCodec != SampleCodec::None || 2 * numsamples >= mSampleCount;
+      auto pEntry = cache.Lookup(*Conn(), mBlockID);
+      if (!pEntry && whole) {
+         pEntry = ReadSamples();
+         cache.Insert(*Conn(), mBlockID, pEntry);
+      }
+      if (pEntry) {
+         CopyStoredSamples(pEntry->samples.get(), pEntry->format,
+            pEntry->count, dest, destformat, sampleoffset, numsamples);
+         return numsamples;
+      }
+   }
 
+   // Read only the requested range, not the whole blob
    return GetBlob(dest,
                   destformat,
-                  stmt,
+                  "samples",
                   mSampleFormat,
                   sampleoffset * SAMPLE_SIZE(mSampleFormat),
                   numsamples * SAMPLE_SIZE(mSampleFormat)) / SAMPLE_SIZE(mSampleFormat);
 }
 
+SampleBlockCache::EntryPtr SqliteSampleBlock::GetCachedSamples()
+{
+   auto &cache = SampleBlockCache::Get();
+   auto &conn = *Conn();
+   if (auto pEntry = cache.Lookup(conn, mBlockID))
+      return pEntry;
+
+   auto pEntry = ReadSamples();
+   cache.Insert(conn, mBlockID, pEntry);
+   return pEntry;
+}
+
+SampleBlockCache::EntryPtr SqliteSampleBlock::ReadSamples()
+{
+   auto db = DB();
+
+   wxASSERT(!IsSilent());
+
+   if (!mValid)
+   {
+      Load(mBlockID);
+   }
+
+   const auto blob = OpenBlob("samples");
+   auto cleanup = finally([&]{ sqlite3_blob_close(blob); });
+   const auto blobbytes = (size_t) sqlite3_blob_bytes(blob);
+
+   int rc;
+   SampleBlockCache::EntryPtr pEntry;
+   if (mCodec == SampleCodec::None)
+   {
+      // Read straight into the entry
+      auto pNewEntry = std::make_shared<SampleBlockCache::Entry>(
+         mSampleCount, mSampleFormat);
+      const auto minbytes = std::min(blobbytes, mSampleBytes);
+      rc = sqlite3_blob_read(blob, pNewEntry->samples.get(), minbytes, 0);
+      memset(pNewEntry->samples.get() + minbytes, 0, mSampleBytes - minbytes);
+      pEntry = std::move(pNewEntry);
+   }
+   else
+   {
+      ArrayOf<char> encoded{ blobbytes };
+      rc = sqlite3_blob_read(blob, encoded.get(), blobbytes, 0);
+      if (rc == SQLITE_OK)
+         pEntry = DecodeSamples(encoded.get(), blobbytes);
+   }
+
+   if (rc != SQLITE_OK || !pEntry)
+   {
+      ADD_EXCEPTION_CONTEXT("sqlite3.rc", std::to_string(rc));
+      ADD_EXCEPTION_CONTEXT("sqlite3.context", "SqliteSampleBlock::ReadSamples::read");
+
+      wxLogDebug(wxT("SqliteSampleBlock::ReadSamples - SQLITE error %s"), sqlite3_errmsg(db));
+
+      // Just showing the user a simple message, not the library error too
+      // which isn't internationalized
+      Conn()->ThrowException( false );
+   }
+
+   return pEntry;
+}
+
+SampleBlockCache::EntryPtr SqliteSampleBlock::DecodeSamples(
+   constSamplePtr blob, size_t blobbytes) const
+{
+   auto pEntry =
+      std::make_shared<SampleBlockCache::Entry>(mSampleCount, mSampleFormat);
+   if (mCodec == SampleCodec::None) {
+      CopyStoredSamples(blob, mSampleFormat, blobbytes / SAMPLE_SIZE(mSampleFormat),
+         pEntry->samples.get(), mSampleFormat, 0, mSampleCount);
+      return pEntry;
+   }
+
+   // The codec may be unknown if a later version wrote the project
+   const auto pCodec = SampleCodec::Find(mCodec);
+   if (!pCodec || !pCodec->Decode(blob, blobbytes,
+         pEntry->samples.get(), mSampleFormat, mSampleCount))
+   {
+      wxLogDebug(wxT("SqliteSampleBlock::DecodeSamples - cannot decode block %lld with codec %d"),
+         mBlockID, (int) mCodec);
+      return {};
+   }
+   return pEntry;
+}
+
+std::pair<constSamplePtr, size_t> SqliteSampleBlock::EncodeSamples(
+   constSamplePtr src, std::vector<char> &encoded)
+{
+   const auto pCodec =
+      SampleCodec::Find(mpFactory->mCodec.load(std::memory_order_relaxed));
+   if (pCodec &&
+       pCodec->Encode(src, mSampleFormat, mSampleCount, encoded)) {
+      mCodec = pCodec->GetID();
+      mpFactory->mEncoded.store(true, std::memory_order_relaxed);
+      return { encoded.data(), encoded.size() };
+   }
+   // Not worth it
+   mCodec = SampleCodec::None;
+   return { src, mSampleBytes };
+}
+
 void SqliteSampleBlock::SetSamples(constSamplePtr src,
                                    size_t numsamples,
                                    sampleFormat srcformat)
@@ -396,45 +1413,126 @@ void SqliteSampleBlock::SetSamples(constSamplePtr src,
    mSamples.reinit(mSampleBytes);
    memcpy(mSamples.get(), src, mSampleBytes);
 
-   CalcSummary( sizes );
+   CalcSummary( sizes, mSamples.get() );
 
    Commit( sizes );
 }
 
+auto SqliteSampleBlock::SetSamplesDeferred(constSamplePtr src,
+   size_t numsamples, sampleFormat srcformat, SampleBlockID id) -> Sizes
+{
+   auto sizes = SetSizes(numsamples, srcformat);
+   auto pEntry =
+      std::make_shared<SampleBlockCache::Entry>(numsamples, srcformat);
+   memcpy(pEntry->samples.get(), src, mSampleBytes);
+   std::atomic_store(&mpPending, SampleBlockCache::EntryPtr{ pEntry });
+
+   mBlockID = id;
+   mValid = true;
+   return sizes;
+}
+
+int SqliteSampleBlock::BindDeferred(sqlite3_stmt *stmt,
+   int first, Sizes sizes, std::pair<constSamplePtr, size_t> blob)
+{
+   return
+      sqlite3_bind_int64(stmt, first, mBlockID) ||
+      sqlite3_bind_int(stmt, first + 1, StoredFormat()) ||
+      sqlite3_bind_double(stmt, first + 2, mSumMin) ||
+      sqlite3_bind_double(stmt, first + 3, mSumMax) ||
+      sqlite3_bind_double(stmt, first + 4, mSumRms) ||
+      sqlite3_bind_blob(stmt, first + 5,
+         mSummary256.get(), sizes.first, SQLITE_STATIC) ||
+      sqlite3_bind_blob(stmt, first + 6,
+         mSummary64k.get(), sizes.second, SQLITE_STATIC) ||
+      sqlite3_bind_blob(stmt, first + 7,
+         blob.first, blob.second, SQLITE_STATIC);
+}
+
+bool SqliteSampleBlock::CommitDeferred(
+   sqlite3_stmt *stmt, const DeferredBlocks &blocks)
+{
+   const auto db = sqlite3_db_handle(stmt);
+   std::vector<char> encoded;
+   for (auto &[pBlock, sizes] : blocks)
+   {
+      // This is the expensive part that the recording thread is spared
+      const auto pEntry = std::atomic_load(&pBlock->mpPending);
+      pBlock->CalcSummary(sizes, pEntry->samples.get());
+      const auto blob = pBlock->EncodeSamples(pEntry->samples.get(), encoded);
+
+      // Bind statement parameters
+      // Might return SQLITE_MISUSE which means it's our mistake that we violated
+      // preconditions; should return SQL_OK which is 0
+      if (pBlock->BindDeferred(stmt, 1, sizes, blob))
+      {
+         ADD_EXCEPTION_CONTEXT(
+            "sqlite3.rc", std::to_string(sqlite3_errcode(db)));
+         ADD_EXCEPTION_CONTEXT("sqlite3.context",
+            "SqliteSampleBlock::CommitDeferred::bind");
+
+         wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
+      }
+
+      // Execute the statement
+      int rc = sqlite3_step(stmt);
+
+      // Clear statement bindings and rewind statement
+      sqlite3_clear_bindings(stmt);
+      sqlite3_reset(stmt);
+
+      // The statement is done with the summaries
+      pBlock->mSummary256.reset();
+      pBlock->mSummary64k.reset();
+
+      if (rc != SQLITE_DONE)
+      {
+         ADD_EXCEPTION_CONTEXT("sqlite3.rc", std::to_string(rc));
+         ADD_EXCEPTION_CONTEXT("sqlite3.context",
+            "SqliteSampleBlock::CommitDeferred::step");
+
+         wxLogDebug(wxT("SqliteSampleBlock::CommitDeferred - SQLITE error %s"),
+            sqlite3_errmsg(db));
+         return false;
+      }
+   }
+   return true;
+}
+
 bool SqliteSampleBlock::GetSummary256(float *dest,
                                       size_t frameoffset,
                                       size_t numframes)
 {
-   return GetSummary(dest, frameoffset, numframes, DBConnection::GetSummary256,
-      "SELECT summary256 FROM sampleblocks WHERE blockid = ?1;");
+   return GetSummary(dest, frameoffset, numframes, 256, "summary256");
 }
 
 bool SqliteSampleBlock::GetSummary64k(float *dest,
                                       size_t frameoffset,
                                       size_t numframes)
 {
-   return GetSummary(dest, frameoffset, numframes, DBConnection::GetSummary64k,
-      "SELECT summary64k FROM sampleblocks WHERE blockid = ?1;");
+   return GetSummary(dest, frameoffset, numframes, 65536, "summary64k");
 }
 
 bool SqliteSampleBlock::GetSummary(float *dest,
                                    size_t frameoffset,
                                    size_t numframes,
-                                   DBConnection::StatementID id,
-                                   const char *sql)
+                                   size_t framesamples,
+                                   const char *column)
 {
    // Non-throwing, it returns true for success
    bool silent = IsSilent();
+   if (const auto pPending = std::atomic_load(&mpPending)) {
+      CalcPendingSummary(*pPending, framesamples, dest, frameoffset, numframes);
+      return true;
+   }
    if (!silent) {
       // Not a silent block
       try {
-         // Prepare and cache statement...automatically finalized at DB close
-         auto stmt = Conn()->Prepare(id, sql);
          // Note GetBlob returns a size_t, not a bool
          // REVIEW: An error in GetBlob() will throw an exception.
          GetBlob(dest,
                      floatSample,
-                     stmt,
+                     column,
                      floatSample,
                      frameoffset * fields * SAMPLE_SIZE(floatSample),
                      numframes * fields * SAMPLE_SIZE(floatSample));
@@ -473,43 +1571,82 @@ MinMaxRMS SqliteSampleBlock::DoGetMinMaxRMS(size_t start, size_t len)
    if (IsSilent())
       return {};
 
-   float min = FLT_MAX;
-   float max = -FLT_MAX;
-   float sumsq = 0;
-
    if (!mValid)
    {
       Load(mBlockID);
    }
 
+   RangeSummary summary;
    if (start < mSampleCount)
    {
       len = std::min(len, mSampleCount - start);
+      AccumulateRange(0, start, start + len, summary);
+   }
 
-      // TODO: actually use summaries
-      SampleBuffer blockData(len, floatSample);
-      float *samples = (float *) blockData.ptr();
+   return { summary.min, summary.max,
+      len ? (float) sqrt(summary.sumsq / len) : 0.0f };
+}
 
-      size_t copied = DoGetSamples((samplePtr) samples, floatSample, start, len);
-      for (size_t i = 0; i < copied; ++i, ++samples)
-      {
-         float sample = *samples;
+const SqliteSampleBlock::SummaryLevel SqliteSampleBlock::SummaryLevels[2] = {
+   { 65536, "summary64k" },
+   { 256, "summary256" },
+};
 
-         if (sample > max)
-         {
-            max = sample;
-         }
+void SqliteSampleBlock::AccumulateRange(size_t level, size_t start, size_t end,
+   RangeSummary &summary)
+{
+   if (start >= end)
+      return;
 
-         if (sample < min)
+   // Summaries of pending blocks would be computed from the samples anyway
+   if (level < std::size(SummaryLevels) && !std::atomic_load(&mpPending))
+   {
+      const auto framesamples = SummaryLevels[level].framesamples;
+      const auto first = (start + framesamples - 1) / framesamples;
+      // A final partial frame summarizes exactly the samples to the end
+      const auto last = (end == mSampleCount)
+         ? (end + framesamples - 1) / framesamples
+         : end / framesamples;
+      if (first < last)
+      {
+         const auto numframes = last - first;
+         Floats frames{ numframes * fields };
+         if (GetSummary(frames.get(), first, numframes, framesamples,
+            SummaryLevels[level].column))
          {
-            min = sample;
+            AccumulateRange(level + 1, start, first * framesamples, summary);
+            for (size_t i = 0; i < numframes; ++i)
+            {
+               const float *frame = &frames[i * fields];
+               const auto count = std::min(framesamples,
+                  mSampleCount - (first + i) * framesamples);
+               summary.min = std::min(summary.min, frame[0]);
+               summary.max = std::max(summary.max, frame[1]);
+               summary.sumsq += (double) frame[2] * frame[2] * count;
+            }
+            AccumulateRange(level + 1,
+               std::min(end, last * framesamples), end, summary);
+            return;
          }
-
-         sumsq += (sample * sample);
       }
+      // Nothing to gain at this level, or it could not be read
+      return AccumulateRange(level + 1, start, end, summary);
    }
 
-   return { min, max, (float) sqrt(sumsq / len) };
+   const auto len = end - start;
+   Floats samples{ len };
+   const auto copied =
+      DoGetSamples((samplePtr) samples.get(), floatSample, start, len);
+   // Add the squares in double precision frame by frame, so that long
+   // ranges lose no more precision than summaries do
+   for (size_t i = 0; i < copied; i += 256)
+   {
+      const auto result =
+         SummarizeSamples(&samples[i], std::min<size_t>(256, copied - i));
+      summary.min = std::min(summary.min, result.min);
+      summary.max = std::max(summary.max, result.max);
+      summary.sumsq += result.sumsq;
+   }
 }
 
 /// Retrieves the minimum, maximum, and maximum RMS of this entire
@@ -517,6 +1654,13 @@ MinMaxRMS SqliteSampleBlock::DoGetMinMaxRMS(size_t start, size_t len)
 /// these values are already computed.
 MinMaxRMS SqliteSampleBlock::DoGetMinMaxRMS() const
 {
+   if (const auto pPending = std::atomic_load(&mpPending)) {
+      // Summaries are not yet computed
+      Floats buffer{ pPending->count };
+      SamplesToFloats(pPending->samples.get(), pPending->format,
+         buffer.get(), pPending->count);
+      return ComputeMinMaxRMS(buffer.get(), pPending->count);
+   }
    return { (float) mSumMin, (float) mSumMax, (float) mSumRms };
 }
 
@@ -524,16 +1668,14 @@ size_t SqliteSampleBlock::GetSpaceUsage() const
 {
    if (IsSilent())
       return 0;
+   else if (std::atomic_load(&mpPending))
+      // Not yet in the database; estimate
+      return mSampleBytes;
    else
       return ProjectFileIO::GetDiskUsage(*Conn(), mBlockID);
 }
 
-size_t SqliteSampleBlock::GetBlob(void *dest,
-                                  sampleFormat destformat,
-                                  sqlite3_stmt *stmt,
-                                  sampleFormat srcformat,
-                                  size_t srcoffset,
-                                  size_t srcbytes)
+sqlite3_blob *SqliteSampleBlock::OpenBlob(const char *column)
 {
    auto db = DB();
 
@@ -544,33 +1686,20 @@ size_t SqliteSampleBlock::GetBlob(void *dest,
       Load(mBlockID);
    }
 
-   int rc;
-   size_t minbytes = 0;
-
-   // Bind statement parameters
-   // Might return SQLITE_MISUSE which means it's our mistake that we violated
-   // preconditions; should return SQL_OK which is 0
-   if (sqlite3_bind_int64(stmt, 1, mBlockID))
+   // Incremental I/O reads only the pages that hold the requested bytes,
+   // where a SELECT would fetch the entire value of the column
+   sqlite3_blob *blob = nullptr;
+   int rc = sqlite3_blob_open(db, "main", "sampleblocks", column,
+      mBlockID, 0 /* read only */, &blob);
+   if (rc != SQLITE_OK)
    {
-      ADD_EXCEPTION_CONTEXT(
-         "sqlite3.rc", std::to_string(sqlite3_errcode(Conn()->DB())));
-      ADD_EXCEPTION_CONTEXT("sqlite3.context", "SqliteSampleBlock::GetBlob::bind");
-
-      wxASSERT_MSG(false, wxT("Binding failed...bug!!!"));
-   }
+      // A handle may be returned even on failure
+      sqlite3_blob_close(blob);
 
-   // Execute the statement
-   rc = sqlite3_step(stmt);
-   if (rc != SQLITE_ROW)
-   {
       ADD_EXCEPTION_CONTEXT("sqlite3.rc", std::to_string(rc));
-      ADD_EXCEPTION_CONTEXT("sqlite3.context", "SqliteSampleBlock::GetBlob::step");
+      ADD_EXCEPTION_CONTEXT("sqlite3.context", "SqliteSampleBlock::OpenBlob");
 
-      wxLogDebug(wxT("SqliteSampleBlock::GetBlob - SQLITE error %s"), sqlite3_errmsg(db));
-
-      // Clear statement bindings and rewind statement
-      sqlite3_clear_bindings(stmt);
-      sqlite3_reset(stmt);
+      wxLogDebug(wxT("SqliteSampleBlock::OpenBlob - SQLITE error %s"), sqlite3_errmsg(db));
 
       // Just showing the user a simple message, not the library error too
       // which isn't internationalized
@@ -584,17 +1713,25 @@ size_t SqliteSampleBlock::GetBlob(void *dest,
       Conn()->ThrowException( false );
    }
 
-   // Retrieve returned data
-   samplePtr src = (samplePtr) sqlite3_column_blob(stmt, 0);
-   size_t blobbytes = (size_t) sqlite3_column_bytes(stmt, 0);
+   return blob;
+}
 
-   srcoffset = std::min(srcoffset, blobbytes);
-   minbytes = std::min(srcbytes, blobbytes - srcoffset);
+size_t SqliteSampleBlock::GetBlob(void *dest,
+                                  sampleFormat destformat,
+                                  const char *column,
+                                  sampleFormat srcformat,
+                                  size_t srcoffset,
+                                  size_t srcbytes)
+{
+   auto db = DB();
 
-   if (srcoffset != 0)
-   {
-      srcoffset += 0;
-   }
+   const auto blob = OpenBlob(column);
+   auto cleanup = finally([&]{ sqlite3_blob_close(blob); });
+
+   size_t blobbytes = (size_t) sqlite3_blob_bytes(blob);
+
+   srcoffset = std::min(srcoffset, blobbytes);
+   size_t minbytes = std::min(srcbytes, blobbytes - srcoffset);
 
    /*
     Will dithering happen in CopySamples?  Answering this as of 3.0.3 by
@@ -632,23 +1769,42 @@ size_t SqliteSampleBlock::GetBlob(void *dest,
     */
    wxASSERT(destformat == floatSample || destformat == srcformat);
 
-   CopySamples(src + srcoffset,
-               srcformat,
-               (samplePtr) dest,
-               destformat,
-               minbytes / SAMPLE_SIZE(srcformat));
+   // Read straight into the destination when no conversion is needed
+   ArrayOf<char> buffer;
+   samplePtr src = (samplePtr) dest;
+   if (destformat != srcformat)
+   {
+      buffer.reinit(minbytes);
+      src = buffer.get();
+   }
+
+   int rc = minbytes ? sqlite3_blob_read(blob, src, minbytes, srcoffset) : SQLITE_OK;
+   if (rc != SQLITE_OK)
+   {
+      ADD_EXCEPTION_CONTEXT("sqlite3.rc", std::to_string(rc));
+      ADD_EXCEPTION_CONTEXT("sqlite3.context", "SqliteSampleBlock::GetBlob::read");
+
+      wxLogDebug(wxT("SqliteSampleBlock::GetBlob - SQLITE error %s"), sqlite3_errmsg(db));
+
+      // Just showing the user a simple message, not the library error too
+      // which isn't internationalized
+      Conn()->ThrowException( false );
+   }
 
-   dest = ((samplePtr) dest) + minbytes;
+   if (src != dest)
+      CopySamples(src,
+                  srcformat,
+                  (samplePtr) dest,
+                  destformat,
+                  minbytes / SAMPLE_SIZE(srcformat));
+
+   dest = ((samplePtr) dest) + minbytes * SAMPLE_SIZE(destformat) / SAMPLE_SIZE(srcformat);
 
    if (srcbytes - minbytes)
    {
-      memset(dest, 0, srcbytes - minbytes);
+      memset(dest, 0, (srcbytes - minbytes) * SAMPLE_SIZE(destformat) / SAMPLE_SIZE(srcformat));
    }
 
-   // Clear statement bindings and rewind statement
-   sqlite3_clear_bindings(stmt);
-   sqlite3_reset(stmt);
-
    return srcbytes;
 }
 
@@ -668,8 +1824,11 @@ void SqliteSampleBlock::Load(SampleBlockID sbid)
 
    // Prepare and cache statement...automatically finalized at DB close
    sqlite3_stmt *stmt = Conn()->Prepare(DBConnection::LoadSampleBlock,
+      // substr() reads the whole blob, even its overflow pages, unlike
+      // length(); so take the header only from encoded blocks
       "SELECT sampleformat, summin, summax, sumrms,"
-      "       length(samples)"
+      "       length(samples),"
+      "       CASE WHEN sampleformat >= 16777216 THEN substr(samples, 1, 4) END"
       "  FROM sampleblocks WHERE blockid = ?1;");
 
    // Bind statement parameters
@@ -706,12 +1865,25 @@ void SqliteSampleBlock::Load(SampleBlockID sbid)
 
    // Retrieve returned data
    mBlockID = sbid;
-   mSampleFormat = (sampleFormat) sqlite3_column_int(stmt, 0);
+   const auto storedFormat = (unsigned) sqlite3_column_int(stmt, 0);
+   mSampleFormat = (sampleFormat) (storedFormat & ((1u << CodecShift) - 1));
+   mCodec = (SampleCodec::ID) (storedFormat >> CodecShift);
    mSumMin = sqlite3_column_double(stmt, 1);
    mSumMax = sqlite3_column_double(stmt, 2);
    mSumRms = sqlite3_column_double(stmt, 3);
-   mSampleBytes = sqlite3_column_int(stmt, 4);
-   mSampleCount = mSampleBytes / SAMPLE_SIZE(mSampleFormat);
+   if (mCodec == SampleCodec::None)
+   {
+      mSampleBytes = sqlite3_column_int(stmt, 4);
+      mSampleCount = mSampleBytes / SAMPLE_SIZE(mSampleFormat);
+   }
+   else
+   {
+      mpFactory->mEncoded.store(true, std::memory_order_relaxed);
+      // The count is in the header of the encoding
+      mSampleCount = SampleCodec::GetEncodedCount(
+         sqlite3_column_blob(stmt, 5), sqlite3_column_bytes(stmt, 5));
+      mSampleBytes = mSampleCount * SAMPLE_SIZE(mSampleFormat);
+   }
 
    // Clear statement bindings and rewind statement
    sqlite3_clear_bindings(stmt);
@@ -728,6 +1900,9 @@ void SqliteSampleBlock::Commit(Sizes sizes)
    auto db = DB();
    int rc;
 
+   std::vector<char> encoded;
+   const auto blob = EncodeSamples(mSamples.get(), encoded);
+
    // Prepare and cache statement...automatically finalized at DB close
    sqlite3_stmt *stmt = Conn()->Prepare(DBConnection::InsertSampleBlock,
       "INSERT INTO sampleblocks (sampleformat, summin, summax, sumrms,"
@@ -737,13 +1912,13 @@ void SqliteSampleBlock::Commit(Sizes sizes)
    // Bind statement parameters
    // Might return SQLITE_MISUSE which means it's our mistake that we violated
    // preconditions; should return SQL_OK which is 0
-   if (sqlite3_bind_int(stmt, 1, mSampleFormat) ||
+   if (sqlite3_bind_int(stmt, 1, StoredFormat()) ||
        sqlite3_bind_double(stmt, 2, mSumMin) ||
        sqlite3_bind_double(stmt, 3, mSumMax) ||
        sqlite3_bind_double(stmt, 4, mSumRms) ||
        sqlite3_bind_blob(stmt, 5, mSummary256.get(), mSummary256Bytes, SQLITE_STATIC) ||
        sqlite3_bind_blob(stmt, 6, mSummary64k.get(), mSummary64kBytes, SQLITE_STATIC) ||
-       sqlite3_bind_blob(stmt, 7, mSamples.get(), mSampleBytes, SQLITE_STATIC))
+       sqlite3_bind_blob(stmt, 7, blob.first, blob.second, SQLITE_STATIC))
    {
 
       ADD_EXCEPTION_CONTEXT(
@@ -794,6 +1969,8 @@ void SqliteSampleBlock::Delete()
 
    wxASSERT(!IsSilent());
 
+   SampleBlockCache::Get().Invalidate(*Conn(), mBlockID);
+
    // Prepare and cache statement...automatically finalized at DB close
    sqlite3_stmt *stmt = Conn()->Prepare(DBConnection::DeleteSampleBlock,
       "DELETE FROM sampleblocks WHERE blockid = ?1;");
@@ -855,22 +2032,22 @@ auto SqliteSampleBlock::SetSizes(
 /// This method also has the side effect of setting the mSumMin,
 /// mSumMax, and mSumRms members of this class.
 ///
-void SqliteSampleBlock::CalcSummary(Sizes sizes)
+void SqliteSampleBlock::CalcSummary(Sizes sizes, constSamplePtr src)
 {
    const auto mSummary256Bytes = sizes.first;
    const auto mSummary64kBytes = sizes.second;
 
    Floats samplebuffer;
-   float *samples;
+   const float *samples;
 
    if (mSampleFormat == floatSample)
    {
-      samples = (float *) mSamples.get();
+      samples = (const float *) src;
    }
    else
    {
       samplebuffer.reinit((unsigned) mSampleCount);
-      SamplesToFloats(mSamples.get(), mSampleFormat,
+      SamplesToFloats(src, mSampleFormat,
          samplebuffer.get(), mSampleCount);
       samples = samplebuffer.get();
    }
@@ -893,10 +2070,6 @@ void SqliteSampleBlock::CalcSummary(Sizes sizes)
 
    for (int i = 0; i < sumLen; ++i)
    {
-      min = samples[i * 256];
-      max = samples[i * 256];
-      sumsq = min * min;
-
       int jcount = 256;
       if (jcount > mSampleCount - i * 256)
       {
@@ -904,20 +2077,10 @@ void SqliteSampleBlock::CalcSummary(Sizes sizes)
          fraction = 1.0 - (jcount / 256.0);
       }
 
-      for (int j = 1; j < jcount; ++j)
-      {
-         float f1 = samples[i * 256 + j];
-         sumsq += f1 * f1;
-
-         if (f1 < min)
-         {
-            min = f1;
-         }
-         else if (f1 > max)
-         {
-            max = f1;
-         }
-      }
+      const auto result = SummarizeSamples(&samples[i * 256], jcount);
+      min = result.min;
+      max = result.max;
+      sumsq = result.sumsq;
 
       totalSquares += sumsq;
 
@@ -946,28 +2109,12 @@ void SqliteSampleBlock::CalcSummary(Sizes sizes)
 
    for (int i = 0; i < sumLen; ++i)
    {
-      min = summary256[3 * i * 256];
-      max = summary256[3 * i * 256 + 1];
-      sumsq = summary256[3 * i * 256 + 2];
-      sumsq *= sumsq;
-
-      for (int j = 1; j < 256; ++j)
-      {
-         // we can overflow the useful summary256 values here, but have put
-         // non-harmful values in them
-         if (summary256[3 * (i * 256 + j)] < min)
-         {
-            min = summary256[3 * (i * 256 + j)];
-         }
-
-         if (summary256[3 * (i * 256 + j) + 1] > max)
-         {
-            max = summary256[3 * (i * 256 + j) + 1];
-         }
-
-         float r1 = summary256[3 * (i * 256 + j) + 2];
-         sumsq += r1 * r1;
-      }
+      // we can overflow the useful summary256 values here, but have put
+      // non-harmful values in them
+      const auto result = SummarizeTriples(&summary256[3 * i * 256], 256);
+      min = result.min;
+      max = result.max;
+      sumsq = result.sumsq;
 
       double denom = (i < sumLen - 1) ? 256.0 : summaries - fraction;
       float rms = (float) sqrt(sumsq / denom);
@@ -988,25 +2135,24 @@ void SqliteSampleBlock::CalcSummary(Sizes sizes)
    }
 
    // Recalc block-level summary (mRMS already calculated)
-   min = summary64k[0];
-   max = summary64k[1];
+   const auto result = SummarizeTriples(summary64k, sumLen);
+   mSumMin = result.min;
+   mSumMax = result.max;
+}
 
-   for (int i = 1; i < sumLen; ++i)
+// Versions without codecs would misread the format of encoded blocks; they
+// all support at most 3.2.0.0, and AUDACITY_MODLEVEL was raised with the codecs
+static ProjectFormatExtensionsRegistry::Extension sampleCodecExtension(
+   [](const AudacityProject& project) -> ProjectFormatVersion
    {
-      if (summary64k[i * fields] < min)
-      {
-         min = summary64k[i * fields];
-      }
-
-      if (summary64k[i * fields + 1] > max)
-      {
-         max = summary64k[i * fields + 1];
-      }
+      const auto pFactory =
+         std::dynamic_pointer_cast<const SqliteSampleBlockFactory>(
+            WaveTrackFactory::Get(project).GetSampleBlockFactory());
+      if (pFactory && pFactory->HasEncodedBlocks())
+         return { 3, 2, 0, 1 };
+      return BaseProjectFormatVersion;
    }
-
-   mSumMin = min;
-   mSumMax = max;
-}
+);
 
 // Inject our database implementation at startup
 static SampleBlockFactory::Factory::Scope scope{ []( AudacityProject &project )
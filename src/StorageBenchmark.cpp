@@ -0,0 +1,333 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  @file StorageBenchmark.cpp
+  @brief Timings of the sample block storage, without user interface
+
+**********************************************************************/
+
+#include "StorageBenchmark.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <wx/ffile.h>
+#include <wx/filename.h>
+
+#include "AudacityException.h"
+#include "MemoryX.h"
+#include "Project.h"
+#include "ProjectFileIO.h"
+#include "SampleBlock.h"
+#include "SampleBlockCache.h"
+#include "Sequence.h"
+#include "TempDirectory.h"
+#include "Track.h"
+#include "WaveTrack.h"
+#include "commands/CommandTargets.h"
+
+namespace {
+
+struct Result {
+   const char *name;
+   double seconds;
+   size_t operations;
+   unsigned long long bytes;
+};
+
+class Stopwatch
+{
+public:
+   using Clock = std::chrono::steady_clock;
+   double Seconds() const
+   {
+      return std::chrono::duration<double>(Clock::now() - mStart).count();
+   }
+
+private:
+   const Clock::time_point mStart{ Clock::now() };
+};
+
+//! Deterministic test signal, so that any read can be checked; a tone
+//! with some noise, neither silent nor incompressible
+float SampleAt(unsigned long long position)
+{
+   const auto noise = static_cast<uint32_t>(position * 2654435761u) >> 20;
+   return 0.5f * static_cast<float>(sin(0.0137 * position)) +
+      (static_cast<float>(noise) - 2048.0f) / 65536.0f;
+}
+
+void FillSignal(float *buffer, unsigned long long first, size_t count)
+{
+   for (size_t ii = 0; ii < count; ++ii)
+      buffer[ii] = SampleAt(first + ii);
+}
+
+bool CheckSignal(const float *buffer, unsigned long long first, size_t count)
+{
+   for (size_t ii = 0; ii < count; ++ii)
+      if (buffer[ii] != SampleAt(first + ii))
+         return false;
+   return true;
+}
+
+class StorageBenchmark
+{
+public:
+   StorageBenchmark(
+      AudacityProject &project, const StorageBenchmarkSettings &settings)
+      : mProject{ project }
+      , mSettings{ settings }
+      , mTotal{ std::max<size_t>(1, settings.dataBytes / sizeof(float)) }
+      , mEngine{ settings.seed }
+   {}
+
+   void RunSequence();
+   void RunBlocks();
+   void RunProject(const FilePath &projectPath);
+
+   std::vector<Result> mResults;
+   bool mVerified{ true };
+
+private:
+   //! A random length no more than limit, and a random start for it in
+   //! a sequence of the given length
+   std::pair<size_t, size_t> RandomRange(size_t length, size_t limit);
+
+   AudacityProject &mProject;
+   const StorageBenchmarkSettings mSettings;
+   const size_t mTotal;
+   std::mt19937 mEngine;
+};
+
+std::pair<size_t, size_t> StorageBenchmark::RandomRange(
+   size_t length, size_t limit)
+{
+   limit = std::max<size_t>(1, std::min(limit, length));
+   const auto len = std::uniform_int_distribution<size_t>{ 1, limit }(mEngine);
+   const auto start =
+      std::uniform_int_distribution<size_t>{ 0, length - len }(mEngine);
+   return { start, len };
+}
+
+void StorageBenchmark::RunSequence()
+{
+   const auto factory = SampleBlockFactory::New(mProject);
+   Sequence sequence{ factory, floatSample };
+   const auto chunk = sequence.GetMaxBlockSize();
+   Floats buffer{ chunk };
+
+   {
+      size_t operations = 0;
+      Stopwatch stopwatch;
+      for (size_t done = 0; done < mTotal; ++operations) {
+         const auto count = std::min(chunk, mTotal - done);
+         FillSignal(buffer.get(), done, count);
+         sequence.Append((constSamplePtr)buffer.get(), floatSample, count);
+         done += count;
+      }
+      mResults.push_back({ "sequence_append",
+         stopwatch.Seconds(), operations, mTotal * sizeof(float) });
+   }
+
+   {
+      size_t operations = 0;
+      Stopwatch stopwatch;
+      for (size_t done = 0; done < mTotal; ++operations) {
+         const auto count = std::min(chunk, mTotal - done);
+         sequence.Get((samplePtr)buffer.get(), floatSample, done, count, true);
+         mVerified = CheckSignal(buffer.get(), done, count) && mVerified;
+         done += count;
+      }
+      mResults.push_back({ "sequence_get_sequential",
+         stopwatch.Seconds(), operations, mTotal * sizeof(float) });
+   }
+
+   {
+      unsigned long long bytes = 0;
+      Stopwatch stopwatch;
+      for (size_t ii = 0; ii < mSettings.edits; ++ii) {
+         const auto [start, len] = RandomRange(mTotal, chunk);
+         sequence.Get((samplePtr)buffer.get(), floatSample, start, len, true);
+         mVerified = CheckSignal(buffer.get(), start, len) && mVerified;
+         bytes += len * sizeof(float);
+      }
+      mResults.push_back({ "sequence_get_random",
+         stopwatch.Seconds(), mSettings.edits, bytes });
+   }
+
+   {
+      unsigned long long bytes = 0;
+      Stopwatch stopwatch;
+      for (size_t ii = 0; ii < mSettings.edits; ++ii) {
+         const auto length = sequence.GetNumSamples().as_size_t();
+         const auto [start, len] = RandomRange(length, 2 * chunk);
+         const auto copy = sequence.Copy(factory, start, start + len);
+         sequence.Paste(RandomRange(length, 1).first, copy.get());
+         bytes += len * sizeof(float);
+      }
+      mResults.push_back({ "sequence_copy_paste",
+         stopwatch.Seconds(), mSettings.edits, bytes });
+   }
+
+   {
+      unsigned long long bytes = 0;
+      Stopwatch stopwatch;
+      for (size_t ii = 0; ii < mSettings.edits; ++ii) {
+         const auto length = sequence.GetNumSamples().as_size_t();
+         if (length < 2)
+            break;
+         const auto [start, len] = RandomRange(length - 1, 2 * chunk);
+         sequence.Delete(start, len);
+         bytes += len * sizeof(float);
+      }
+      mResults.push_back({ "sequence_delete",
+         stopwatch.Seconds(), mSettings.edits, bytes });
+   }
+}
+
+void StorageBenchmark::RunBlocks()
+{
+   const auto factory = SampleBlockFactory::New(mProject);
+   const auto blockSamples =
+      std::max<size_t>(1, mSettings.blockBytes / sizeof(float));
+   const auto count = std::max<size_t>(1, mTotal / blockSamples);
+   Floats buffer{ blockSamples };
+   std::vector<SampleBlockPtr> blocks;
+   blocks.reserve(count);
+
+   {
+      Stopwatch stopwatch;
+      for (size_t ii = 0; ii < count; ++ii) {
+         FillSignal(buffer.get(), ii * blockSamples, blockSamples);
+         blocks.push_back(factory->Create(
+            (constSamplePtr)buffer.get(), blockSamples, floatSample));
+      }
+      factory->FlushCommits();
+      mResults.push_back({ "block_create",
+         stopwatch.Seconds(), count, count * blockSamples * sizeof(float) });
+   }
+
+   // Measure reads from the database, not from memory
+   SampleBlockCache::Get().Clear();
+   {
+      Stopwatch stopwatch;
+      for (size_t ii = 0; ii < count; ++ii) {
+         blocks[ii]->GetSamples(
+            (samplePtr)buffer.get(), floatSample, 0, blockSamples);
+         mVerified = CheckSignal(buffer.get(), ii * blockSamples, blockSamples)
+            && mVerified;
+      }
+      mResults.push_back({ "block_read",
+         stopwatch.Seconds(), count, count * blockSamples * sizeof(float) });
+   }
+}
+
+void StorageBenchmark::RunProject(const FilePath &projectPath)
+{
+   auto &tracks = TrackList::Get(mProject);
+   auto track = WaveTrackFactory::Get(mProject).NewWaveTrack(floatSample);
+   const auto chunk = track->GetMaxBlockSize();
+   Floats buffer{ chunk };
+   for (size_t done = 0; done < mTotal;) {
+      const auto count = std::min(chunk, mTotal - done);
+      FillSignal(buffer.get(), done, count);
+      track->Append((constSamplePtr)buffer.get(), floatSample, count);
+      done += count;
+   }
+   track->Flush();
+   tracks.Add(track);
+
+   auto &projectFileIO = ProjectFileIO::Get(mProject);
+   {
+      Stopwatch stopwatch;
+      mVerified = projectFileIO.SaveProject(projectPath, nullptr) && mVerified;
+      mResults.push_back({ "project_save",
+         stopwatch.Seconds(), 1, mTotal * sizeof(float) });
+   }
+
+   // Leave half of the blocks unused, as edits would
+   track->Clear(0, track->GetEndTime() / 2);
+   {
+      const auto before = projectFileIO.GetTotalUsage();
+      Stopwatch stopwatch;
+      projectFileIO.Compact({ &tracks }, true);
+      mVerified = projectFileIO.WasCompacted() && mVerified;
+      mResults.push_back({ "project_compact", stopwatch.Seconds(), 1,
+         static_cast<unsigned long long>(std::max<int64_t>(0, before)) });
+   }
+}
+
+}
+
+bool RunStorageBenchmark(
+   const FilePath &resultPath, const StorageBenchmarkSettings &settings)
+{
+   const auto oldBlockSize = Sequence::GetMaxDiskBlockSize();
+   Sequence::SetMaxDiskBlockSize(settings.blockBytes);
+   auto cleanup = finally([&]{
+      Sequence::SetMaxDiskBlockSize(oldBlockSize);
+   });
+
+   const auto projectPath = wxFileName{
+      TempDirectory::TempDir(), wxT("StorageBenchmark"), wxT("aup3")
+   }.GetFullPath();
+   ProjectFileIO::RemoveProject(projectPath);
+
+   std::vector<Result> results;
+   bool verified = false;
+   wxString error;
+   try {
+      InvisibleTemporaryProject tempProject;
+      StorageBenchmark benchmark{ tempProject.Project(), settings };
+      benchmark.RunSequence();
+      benchmark.RunBlocks();
+      benchmark.RunProject(projectPath);
+      results = std::move(benchmark.mResults);
+      verified = benchmark.mVerified;
+   }
+   catch (const AudacityException &) {
+      error = wxT("A storage operation failed");
+   }
+   // The project was saved, so its closing left the file
+   ProjectFileIO::RemoveProject(projectPath);
+
+   StringMessageTarget target;
+   target.StartStruct();
+   target.StartField(wxT("settings"));
+   target.StartStruct();
+   target.AddItem((double)settings.blockBytes, wxT("block_bytes"));
+   target.AddItem((double)settings.dataBytes, wxT("data_bytes"));
+   target.AddItem((double)settings.edits, wxT("edits"));
+   target.AddItem((double)settings.seed, wxT("seed"));
+   target.EndStruct();
+   target.EndField();
+   target.StartField(wxT("results"));
+   target.StartArray();
+   for (const auto &result : results) {
+      target.StartStruct();
+      target.AddItem(wxString{ result.name }, wxT("name"));
+      target.AddItem(result.seconds, wxT("seconds"));
+      target.AddItem((double)result.operations, wxT("operations"));
+      target.AddItem((double)result.bytes, wxT("bytes"));
+      target.AddItem(result.seconds > 0
+         ? result.bytes / 1048576.0 / result.seconds : 0.0,
+         wxT("mb_per_second"));
+      target.EndStruct();
+   }
+   target.EndArray();
+   target.EndField();
+   target.AddBool(verified, wxT("verified"));
+   if (!error.empty())
+      target.AddItem(error, wxT("error"));
+   target.EndStruct();
+
+   wxFFile file{ resultPath, wxT("w") };
+   const bool written = file.IsOpened() &&
+      file.Write(target.GetText() + wxT("\n")) && file.Close();
+   return written && verified && error.empty();
+}
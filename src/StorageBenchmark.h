@@ -0,0 +1,39 @@
+/**********************************************************************
+
+  Audacity: A Digital Audio Editor
+
+  @file StorageBenchmark.h
+  @brief Timings of the sample block storage, without user interface
+
+**********************************************************************/
+
+#ifndef __AUDACITY_STORAGE_BENCHMARK__
+#define __AUDACITY_STORAGE_BENCHMARK__
+
+#include <cstddef>
+
+#include "Identifier.h"
+
+//! Sizes for RunStorageBenchmark()
+struct StorageBenchmarkSettings {
+   //! Maximum bytes of a stored block, as for Sequence::SetMaxDiskBlockSize()
+   size_t blockBytes{ 1048576 };
+   //! Bytes of float samples in the test sequence and the saved project
+   size_t dataBytes{ 64 * 1048576 };
+   //! Number of each kind of random edit and read
+   size_t edits{ 100 };
+   unsigned seed{ 1 };
+};
+
+//! Time appending, reading, deleting and pasting in a Sequence, creating and
+//! reading sample blocks, and saving and compacting a project, all in an
+//! invisible temporary project, and write the results to a file as JSON
+/*!
+ @return false if the results could not be written, or if any operation
+ failed or read back wrong samples, which the results also report
+ */
+AUDACITY_DLL_API
+bool RunStorageBenchmark(
+   const FilePath &resultPath, const StorageBenchmarkSettings &settings);
+
+#endif
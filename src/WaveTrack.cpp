@@ -2315,6 +2315,18 @@ void WaveTrack::GetEnvelopeValues(double *buffer, size_t bufferLen,
    }
 }
 
+bool WaveTrack::HasUnityEnvelope(double t0, double t1) const
+{
+   // Outside of clips the value is 1.  Interpolation between points of value
+   // 1 may round to a double within an ulp or two of 1, which changes no
+   // float sample.
+   for (const auto &clip: mClips)
+      if (clip->GetPlayStartTime() < t1 && clip->GetPlayEndTime() > t0 &&
+          !clip->GetEnvelope()->IsConstant(t0, t1, 1.0))
+         return false;
+   return true;
+}
+
 WaveClip* WaveTrack::GetClipAtSample(sampleCount sample)
 {
    for (const auto &clip: mClips)
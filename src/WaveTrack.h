@@ -185,6 +185,9 @@ private:
    // default will do.
    Holder EmptyCopy(const SampleBlockFactoryPtr &pFactory = {} ) const;
 
+   const SampleBlockFactoryPtr &GetSampleBlockFactory() const
+   { return mpFactory; }
+
    // If forClipboard is true,
    // and there is no clip at the end time of the selection, then the result
    // will contain a "placeholder" clip whose only purpose is to make
@@ -267,6 +270,8 @@ private:
    void GetEnvelopeValues(double *buffer, size_t bufferLen,
                          double t0) const override;
 
+   bool HasUnityEnvelope(double t0, double t1) const override;
+
    // May assume precondition: t0 <= t1
    std::pair<float, float> GetMinMax(
       double t0, double t1, bool mayThrow = true) const;
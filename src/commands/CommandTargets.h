@@ -202,6 +202,18 @@ public:
    void Update(const wxString &) override {}
 };
 
+/// Accumulates a command's messages in a string, such as JSON to write to a
+/// file
+class StringMessageTarget final : public CommandMessageTarget
+{
+public:
+   void Update(const wxString &message) override { mText += message; }
+   const wxString &GetText() const { return mText; }
+
+private:
+   wxString mText;
+};
+
 /// Displays messages from a command in an AudacityMessageBox
 class AUDACITY_DLL_API MessageBoxTarget final : public CommandMessageTarget
 {
@@ -17,12 +17,14 @@ This class now lists
 - Clips
 - Labels
 - Boxes
+- Audio statistics
 
 *//*******************************************************************/
 
 
 #include "GetInfoCommand.h"
 
+#include "../AudioIO.h"
 #include "LoadCommands.h"
 #include "Project.h"
 #include "../ProjectWindows.h"
@@ -68,6 +70,7 @@ enum {
    kEnvelopes,
    kLabels,
    kBoxes,
+   kAudioStatistics,
    nTypes
 };
 
@@ -82,6 +85,7 @@ static const EnumValueSymbol kTypes[nTypes] =
    { XO("Envelopes") },
    { XO("Labels") },
    { XO("Boxes") },
+   { wxT("AudioStatistics"), XO("Audio Statistics") },
 };
 
 enum {
@@ -162,6 +166,7 @@ bool GetInfoCommand::ApplyInner(const CommandContext &context)
       case kEnvelopes    : return SendEnvelopes( context );
       case kLabels       : return SendLabels( context );
       case kBoxes        : return SendBoxes( context );
+      case kAudioStatistics : return SendAudioStatistics( context );
       default:
          context.Status( "Command options not recognised" );
    }
@@ -616,6 +621,51 @@ bool GetInfoCommand::SendLabels(const CommandContext &context)
    return true;
 }
 
+bool GetInfoCommand::SendAudioStatistics(const CommandContext &context)
+{
+   auto gAudioIO = AudioIO::Get();
+   if (!gAudioIO)
+      return false;
+   // The latest stream's records, even if it has stopped
+   const auto snapshot = gAudioIO->GetStatistics().GetSnapshot();
+
+   context.StartStruct();
+   context.AddItem( (double)snapshot.nCallbacks, "callbacks" );
+   context.AddItem( (double)snapshot.nExchanges, "exchanges" );
+
+   context.StartField( "callback_records" );
+   context.StartArray();
+   for (const auto &record : snapshot.callbacks) {
+      context.StartStruct();
+      context.AddItem( record.time, "time" );
+      context.AddItem( record.duration, "duration" );
+      context.AddItem( record.deadline, "deadline" );
+      context.AddItem( (double)record.playbackReady, "playback_ready" );
+      context.AddItem( (double)record.captureFree, "capture_free" );
+      context.AddBool( record.xrun, "xrun" );
+      context.EndStruct();
+   }
+   context.EndArray();
+   context.EndField();
+
+   context.StartField( "exchange_records" );
+   context.StartArray();
+   for (const auto &record : snapshot.exchanges) {
+      context.StartStruct();
+      context.AddItem( record.time, "time" );
+      context.AddItem( record.duration, "duration" );
+      context.AddItem( record.effectsDuration, "effects" );
+      context.AddItem( (double)record.playbackReady, "playback_ready" );
+      context.AddItem( (double)record.captureFree, "capture_free" );
+      context.EndStruct();
+   }
+   context.EndArray();
+   context.EndField();
+
+   context.EndStruct();
+   return true;
+}
+
 /*******************************************************************
 The various Explore functions are called from the Send functions,
 and may be recursive.  'Send' is the top level.
@@ -111,7 +111,7 @@ void RealtimeEffectManager::Finalize() noexcept
 void RealtimeEffectManager::Suspend()
 {
    // Protect...
-   std::lock_guard<std::mutex> guard(mLock);
+   std::lock_guard<std::shared_mutex> guard(mLock);
 
    // Already suspended...bail
    if (mSuspended)
@@ -129,7 +129,7 @@ void RealtimeEffectManager::Suspend()
 void RealtimeEffectManager::Resume() noexcept
 {
    // Protect...
-   std::lock_guard<std::mutex> guard(mLock);
+   std::lock_guard<std::shared_mutex> guard(mLock);
 
    // Already running...bail
    if (!mSuspended)
@@ -150,7 +150,7 @@ void RealtimeEffectManager::Resume() noexcept
 void RealtimeEffectManager::ProcessStart()
 {
    // Protect...
-   std::lock_guard<std::mutex> guard(mLock);
+   std::lock_guard<std::shared_mutex> guard(mLock);
 
    // Can be suspended because of the audio stream being paused or because effects
    // have been suspended.
@@ -171,14 +171,62 @@ size_t RealtimeEffectManager::Process(Track *track,
    size_t numSamples)
 {
    // Protect...
-   std::lock_guard<std::mutex> guard(mLock);
+   std::lock_guard<std::shared_mutex> guard(mLock);
 
    // Can be suspended because of the audio stream being paused or because effects
    // have been suspended, so allow the samples to pass as-is.
    if (mSuspended)
       return numSamples;
 
-   auto chans = mChans[track];
+   return ProcessStates(track,
+      [&](StateVisitor func){ VisitGroup(track, func); },
+      buffers, scratch, numSamples);
+}
+
+//
+// This will be called in a different thread than the main GUI thread.
+//
+size_t RealtimeEffectManager::ProcessProjectEffects(Track *track,
+   float *const *buffers, float *const *scratch,
+   size_t numSamples)
+{
+   // Protect...
+   std::lock_guard<std::shared_mutex> guard(mLock);
+
+   if (mSuspended)
+      return numSamples;
+
+   return ProcessStates(track,
+      [&](StateVisitor func){ RealtimeEffectList::Get(mProject).Visit(func); },
+      buffers, scratch, numSamples);
+}
+
+//
+// This may be called in several threads at once, for different tracks.
+//
+size_t RealtimeEffectManager::ProcessTrackEffects(Track *track,
+   float *const *buffers, float *const *scratch,
+   size_t numSamples)
+{
+   // Protect against the main thread, but not against other tracks, whose
+   // states are distinct
+   std::shared_lock<std::shared_mutex> guard(mLock);
+
+   if (mSuspended)
+      return numSamples;
+
+   return ProcessStates(track,
+      [&](StateVisitor func){ RealtimeEffectList::Get(*track).Visit(func); },
+      buffers, scratch, numSamples);
+}
+
+size_t RealtimeEffectManager::ProcessStates(Track *track,
+   const std::function<void(StateVisitor)> &visit,
+   float *const *buffers, float *const *scratch, size_t numSamples)
+{
+   // Don't insert into the map, which may be shared with other threads
+   const auto iter = mChans.find(track);
+   const unsigned chans = (iter == mChans.end()) ? 0 : iter->second;
 
    // Remember when we started so we can calculate the amount of latency we
    // are introducing
@@ -202,7 +250,7 @@ size_t RealtimeEffectManager::Process(Track *track,
    // output of one effect as the input to the next effect
    // Tracks how many processors were called
    size_t called = 0;
-   VisitGroup(track,
+   visit(
       [&](RealtimeEffectState &state, bool bypassed)
       {
          if (bypassed)
@@ -239,7 +287,7 @@ size_t RealtimeEffectManager::Process(Track *track,
 void RealtimeEffectManager::ProcessEnd() noexcept
 {
    // Protect...
-   std::lock_guard<std::mutex> guard(mLock);
+   std::lock_guard<std::shared_mutex> guard(mLock);
 
    // Can be suspended because of the audio stream being paused or because effects
    // have been suspended.
@@ -290,7 +338,7 @@ RealtimeEffectManager::AddState(
          return nullptr;
    }
    // Protect...
-   std::lock_guard<std::mutex> guard(mLock);
+   std::lock_guard<std::shared_mutex> guard(mLock);
 
    auto pState = states.AddState(id);
    if (!pState)
@@ -334,7 +382,7 @@ void RealtimeEffectManager::RemoveState(
          return;
    }
    // Protect...
-   std::lock_guard<std::mutex> guard(mLock);
+   std::lock_guard<std::shared_mutex> guard(mLock);
 
    if (mActive)
       state.Finalize();
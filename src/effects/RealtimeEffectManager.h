@@ -15,6 +15,7 @@
 #include <chrono>
 #include <memory>
 #include <mutex>
+#include <shared_mutex>
 #include <unordered_map>
 #include <vector>
 
@@ -88,6 +89,12 @@ private:
    /*! @copydoc ProcessScope::Process */
    size_t Process(Track *track,
       float *const *buffers, float *const *scratch, size_t numSamples);
+   /*! @copydoc ProcessScope::ProcessProjectEffects */
+   size_t ProcessProjectEffects(Track *track,
+      float *const *buffers, float *const *scratch, size_t numSamples);
+   /*! @copydoc ProcessScope::ProcessTrackEffects */
+   size_t ProcessTrackEffects(Track *track,
+      float *const *buffers, float *const *scratch, size_t numSamples);
    void ProcessEnd() noexcept;
 
    RealtimeEffectManager(const RealtimeEffectManager&) = delete;
@@ -99,14 +106,22 @@ private:
    //! Visit the per-project states first, then states for leader if not null
    void VisitGroup(Track *leader, StateVisitor func);
 
+   //! Pass buffers through the chain of states that visit finds
+   /*! @pre mLock is held, and processing is not suspended */
+   size_t ProcessStates(Track *track,
+      const std::function<void(StateVisitor)> &visit,
+      float *const *buffers, float *const *scratch, size_t numSamples);
+
    //! Visit the per-project states first, then all tracks from AddTrack
    /*! Tracks are visited in unspecified order */
    void VisitAll(StateVisitor func);
 
    AudacityProject &mProject;
 
-   std::mutex mLock;
-   Latency mLatency{ 0 };
+   //! Held shared only by ProcessTrackEffects(), which changes no states
+   //! but those of the given track
+   std::shared_mutex mLock;
+   std::atomic<Latency> mLatency{ Latency{ 0 } };
 
    double mRate;
 
@@ -212,6 +227,31 @@ public:
          return numSamples; // consider them trivially processed
    }
 
+   //! Like Process(), but only through the per-project effects
+   /*! Then ProcessTrackEffects() should complete the processing */
+   size_t ProcessProjectEffects(Track *track,
+      float *const *buffers, float *const *scratch, size_t numSamples)
+   {
+      if (auto pProject = mwProject.lock())
+         return RealtimeEffectManager::Get(*pProject)
+            .ProcessProjectEffects(track, buffers, scratch, numSamples);
+      else
+         return numSamples; // consider them trivially processed
+   }
+
+   //! Like Process(), but only through the effects of the track
+   /*! May be called at once in several threads, for different tracks and
+    scratch buffers, but all calls for one track must be in one thread */
+   size_t ProcessTrackEffects(Track *track,
+      float *const *buffers, float *const *scratch, size_t numSamples)
+   {
+      if (auto pProject = mwProject.lock())
+         return RealtimeEffectManager::Get(*pProject)
+            .ProcessTrackEffects(track, buffers, scratch, numSamples);
+      else
+         return numSamples; // consider them trivially processed
+   }
+
 private:
    std::weak_ptr<AudacityProject> mwProject;
 };
@@ -6,7 +6,7 @@
 
 #include "../AboutDialog.h"
 #include "AllThemeResources.h"
-#include "AudioIOBase.h"
+#include "../AudioIO.h"
 #include "../CommonCommandFlags.h"
 #include "../CrashReport.h" // for HAS_CRASH_REPORT
 #include "FileNames.h"
@@ -282,6 +282,16 @@ void OnAudioDeviceInfo(const CommandContext &context)
       XO("Audio Device Info"), wxT("deviceinfo.txt") );
 }
 
+void OnAudioStatistics(const CommandContext &context)
+{
+   auto &project = context.project;
+   auto gAudioIO = AudioIO::Get();
+   const auto info =
+      AudioIOStatistics::ToCSV(gAudioIO->GetStatistics().GetSnapshot());
+   ShowDiagnostics( project, info,
+      XO("Audio Timing Statistics"), wxT("audiostatistics.csv") );
+}
+
 void OnShowLog( const CommandContext &context )
 {
    LogWindow::Show();
@@ -477,6 +487,9 @@ BaseItemSharedPtr HelpMenu()
             Command( wxT("DeviceInfo"), XXO("Au&dio Device Info..."),
                FN(OnAudioDeviceInfo),
                AudioIONotBusyFlag() ),
+            Command( wxT("AudioStatistics"),
+               XXO("Audio &Timing Statistics..."),
+               FN(OnAudioStatistics), AlwaysEnabledFlag ),
             Command( wxT("Log"), XXO("Show &Log..."), FN(OnShowLog),
                AlwaysEnabledFlag ),
       #if defined(HAS_CRASH_REPORT)
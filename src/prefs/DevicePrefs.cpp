@@ -38,6 +38,8 @@ other settings.
 #include "portaudio.h"
 
 #include "Prefs.h"
+#include "../AudioIO.h"
+#include "../PlaybackSchedule.h"
 #include "../ShuttleGui.h"
 #include "DeviceManager.h"
 
@@ -203,6 +205,11 @@ void DevicePrefs::PopulateOrExchange(ShuttleGui & S)
          S.AddUnits(XO("milliseconds"));
       }
       S.EndThreeColumn();
+
+      S.TieCheckBox(XXO("&Adapt playback buffering to system load"),
+         AdaptivePlaybackBuffers);
+      S.TieCheckBox(XXO("Process track &effects in parallel"),
+         AudioIORealtimeInParallel);
    }
    S.EndStatic();
    S.EndScroller();
@@ -25,6 +25,7 @@
 
 #include "AudioIOBase.h"
 #include "Dither.h"
+#include "Mix.h"
 #include "Prefs.h"
 #include "Resample.h"
 #include "../ShuttleGui.h"
@@ -181,6 +182,8 @@ void QualityPrefs::PopulateOrExchange(ShuttleGui & S)
                      Dither::BestSetting);
       }
       S.EndMultiColumn();
+
+      S.TieCheckBox(XXO("&Mix tracks in parallel"), MixInParallel);
    }
    S.EndStatic();
    S.EndScroller();
@@ -17,58 +17,50 @@
 #include "SampleBlock.h"
 #include "SampleCount.h"
 #include "Sequence.h"
+#include "VectorOps.h"
 
 namespace {
 
-struct MinMaxSumsq
+struct MinMaxSumsq : MinMaxSumSq
 {
    MinMaxSumsq(const float *pv, int count, int divisor)
+      : MinMaxSumSq{ divisor == 256 || divisor == 65536
+         // array holds triples of min, max, and rms values
+         ? SummarizeTriples(pv, count)
+         // array holds samples
+         : SummarizeSamples(pv, count) }
    {
-      min = FLT_MAX, max = -FLT_MAX, sumsq = 0.0f;
-      while (count--) {
-         float v;
-         switch (divisor) {
-         default:
-         case 1:
-            // array holds samples
-            v = *pv++;
-            if (v < min)
-               min = v;
-            if (v > max)
-               max = v;
-            sumsq += v * v;
-            break;
-         case 256:
-         case 65536:
-            // array holds triples of min, max, and rms values
-            v = *pv++;
-            if (v < min)
-               min = v;
-            v = *pv++;
-            if (v > max)
-               max = v;
-            v = *pv++;
-            sumsq += v * v;
-            break;
-         }
-      }
    }
-
-   float min;
-   float max;
-   float sumsq;
 };
 
+//! Index of the block containing pos, which blocks must cover
+unsigned FindBlock(const BlockArray &blocks, sampleCount pos)
+{
+   const auto iter = std::upper_bound(blocks.begin(), blocks.end(), pos,
+      [](sampleCount position, const SeqBlock &block){
+         return position < block.start; });
+   return std::max<ptrdiff_t>(0, (iter - blocks.begin()) - 1);
+}
+
 }
 
 bool GetWaveDisplay(const Sequence &sequence,
    float *min, float *max, float *rms, int* bl,
    size_t len, const sampleCount *where)
+{
+   return GetWaveDisplay(sequence.GetBlockArray(),
+      sequence.GetNumSamples(), sequence.GetMaxBlockSize(),
+      min, max, rms, bl, len, where);
+}
+
+bool GetWaveDisplay(const BlockArray &blocks,
+   sampleCount numSamples, size_t maxSamples,
+   float *min, float *max, float *rms, int* bl,
+   size_t len, const sampleCount *where)
 {
    wxASSERT(len > 0);
    const auto s0 = std::max(sampleCount(0), where[0]);
-   const auto numSamples = sequence.GetNumSamples();
-   if (s0 >= numSamples)
+   if (s0 >= numSamples || blocks.empty())
       // None of the samples asked for are in range. Abandon.
       return false;
 
@@ -76,22 +68,20 @@ bool GetWaveDisplay(const Sequence &sequence,
    // so we load at least one pixel for column len - 1
    // ... unless the mNumSamples ceiling applies, and then there are other defenses
    const auto s1 = std::clamp(where[len], 1 + where[len - 1], numSamples);
-   const auto maxSamples = sequence.GetMaxBlockSize();
    Floats temp{ maxSamples };
 
    decltype(len) pixel = 0;
 
    auto srcX = s0;
    decltype(srcX) nextSrcX = 0;
-   int lastRmsDenom = 0;
+   double lastRmsDenom = 0;
    int lastDivisor = 0;
    auto whereNow = std::min(s1 - 1, where[0]);
    decltype(whereNow) whereNext = 0;
    // Loop over block files, opening and reading and closing each
    // not more than once
-   const auto &blocks = sequence.GetBlockArray();
    unsigned nBlocks = blocks.size();
-   const unsigned int block0 = sequence.FindBlock(s0);
+   const unsigned int block0 = FindBlock(blocks, s0);
    for (unsigned int b = block0; b < nBlocks; ++b) {
       if (b > block0)
          srcX = nextSrcX;
@@ -121,15 +111,31 @@ bool GetWaveDisplay(const Sequence &sequence,
                 (whereNext = std::min(s1 - 1, where[nextPixel])) < nextSrcX)
             ++nextPixel;
       }
-      if (nextPixel == pixel)
+      if (nextPixel == pixel) {
          // The entire block's samples fall within one pixel column.
          // Either it's a rare odd block at the end, or else,
          // we must be really zoomed out!
-         // Omit the entire block's contents from min/max/rms
-         // calculation, which is not correct, but correctness might not
-         // be worth the compute time if this happens every pixel
-         // column. -- PRL
+         // The summary of the whole block is in memory, so fold it into
+         // that column at no cost
+         if (pixel > 0) {
+            // no-throw for display operations!
+            const auto results = seqBlock.sb->GetMinMaxRMS(false);
+            const auto blockSamples = seqBlock.sb->GetSampleCount();
+            const int lastPixel = pixel - 1;
+            min[lastPixel] = std::min(min[lastPixel], results.min);
+            max[lastPixel] = std::max(max[lastPixel], results.max);
+            float &lastRms = rms[lastPixel];
+            const double lastNumSamples = lastRmsDenom * lastDivisor;
+            const double numSamples = lastNumSamples + blockSamples;
+            lastRms = sqrt(
+               (lastRms * lastRms * lastNumSamples +
+                  results.RMS * results.RMS * blockSamples) / numSamples);
+            // Further blocks in the column weigh against all these samples
+            lastDivisor = 1;
+            lastRmsDenom = numSamples;
+         }
          continue;
+      }
       if (nextPixel == len)
          whereNext = s1;
 
@@ -171,7 +177,7 @@ bool GetWaveDisplay(const Sequence &sequence,
       case 1:
          // Read samples
          // no-throw for display operations!
-         sequence.Read(
+         Sequence::Read(
             (samplePtr)temp.get(), floatSample, seqBlock, startPosition, num, false);
          break;
       case 256:
@@ -204,7 +210,7 @@ bool GetWaveDisplay(const Sequence &sequence,
             float &lastMax = max[lastPixel];
             lastMax = std::max(lastMax, values.max);
             float &lastRms = rms[lastPixel];
-            int lastNumSamples = lastRmsDenom * lastDivisor;
+            const double lastNumSamples = lastRmsDenom * lastDivisor;
             lastRms = sqrt(
                (lastRms * lastRms * lastNumSamples + values.sumsq * divisor) /
                (lastNumSamples + diff * divisor)
@@ -261,3 +267,48 @@ bool GetWaveDisplay(const Sequence &sequence,
 
    return true;
 }
+
+void GetCoarseWaveDisplay(const BlockArray &blocks,
+   sampleCount numSamples,
+   float *min, float *max, float *rms, int* bl,
+   size_t len, const sampleCount *where)
+{
+   std::fill(min, min + len, 0.0f);
+   std::fill(max, max + len, 0.0f);
+   std::fill(rms, rms + len, 0.0f);
+   std::fill(bl, bl + len, -1);
+   if (blocks.empty())
+      return;
+
+   auto b = FindBlock(blocks, std::clamp(where[0], sampleCount(0), numSamples));
+   for (size_t pixel = 0; pixel < len; ++pixel) {
+      const auto s0 = std::max(sampleCount(0), where[pixel]);
+      const auto s1 = std::min(numSamples, std::max(s0 + 1, where[pixel + 1]));
+      // Fold the summaries of all blocks that meet the column, weighing the
+      // rms by the samples of each
+      float theMin = FLT_MAX, theMax = -FLT_MAX;
+      double sumsq = 0, count = 0;
+      for (auto bb = b; bb < blocks.size() && blocks[bb].start < s1; ++bb) {
+         const auto &block = blocks[bb];
+         const auto blockEnd = block.start + block.sb->GetSampleCount();
+         if (blockEnd <= s0) {
+            b = bb + 1;
+            continue;
+         }
+         // no-throw for display operations!
+         const auto results = block.sb->GetMinMaxRMS(false);
+         const auto overlap = (std::min(s1, blockEnd) -
+            std::max(s0, block.start)).as_double();
+         theMin = std::min(theMin, results.min);
+         theMax = std::max(theMax, results.max);
+         sumsq += results.RMS * results.RMS * overlap;
+         count += overlap;
+         bl[pixel] = bb;
+      }
+      if (count > 0) {
+         min[pixel] = theMin;
+         max[pixel] = theMax;
+         rms[pixel] = sqrt(sumsq / count);
+      }
+   }
+}
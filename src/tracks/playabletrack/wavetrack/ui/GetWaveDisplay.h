@@ -12,6 +12,7 @@
 #define __AUDACITY_GET_WAVE_DISPLAY__
 
 #include <cstddef>
+class BlockArray;
 class Sequence;
 class sampleCount;
 
@@ -26,4 +27,19 @@ bool GetWaveDisplay(const Sequence &sequence,
    float *min, float *max, float *rms, int* bl,
    size_t len, const sampleCount *where);
 
+// The same, reading a copy of some of the blocks of a sequence instead, so
+// that it may run in another thread while the sequence changes.  The blocks
+// must cover the samples from where[0] up to where[len], or to numSamples.
+bool GetWaveDisplay(const BlockArray &blocks,
+   sampleCount numSamples, size_t maxBlockSize,
+   float *min, float *max, float *rms, int* bl,
+   size_t len, const sampleCount *where);
+
+// Fill the outputs at once, with no database reads, from the summaries of
+// whole blocks.  Columns that meet no block get bl of -1.
+void GetCoarseWaveDisplay(const BlockArray &blocks,
+   sampleCount numSamples,
+   float *min, float *max, float *rms, int* bl,
+   size_t len, const sampleCount *where);
+
 #endif
@@ -10,13 +10,17 @@
 
 #include "SpectrumCache.h"
 
+#include <algorithm>
 #include <cmath>
 #include "RealFFTf.h"
 #include "SampleTrackCache.h"
+#include "Sequence.h"
 #include "../../../../prefs/SpectrogramSettings.h"
 #include "Spectrum.h"
+#include "SpectrumTileStore.h"
 #include "WaveClipUtilities.h"
 #include "WaveTrack.h"
+#include "WorkerPool.h"
 
 class WaveTrack;
 
@@ -101,7 +105,8 @@ bool SpecCache::CalculateOneSpectrum
     double offset, double rate, double pixelsPerSecond,
     int lowerBoundX, int upperBoundX,
     const std::vector<float> &gainFactors,
-    float* __restrict scratch, float* __restrict out) const
+    float* __restrict scratch, float* __restrict out,
+    Spill *pSpill, int ownBeginX, int ownEndX) const
 {
    bool result = false;
    const bool reassignment =
@@ -283,13 +288,12 @@ bool SpecCache::CalculateOneSpectrum
 
                   // This is non-negative, because bin and correctedX are
                   auto ind = (int)nBins * correctedX + bin;
-#ifdef _OPENMP
-                  // This assignment can race if index reaches into another thread's bins.
-                  // The probability of a race very low, so this carries little overhead,
-                  // about 5% slower vs allowing it to race.
-                  #pragma omp atomic update
-#endif
-                  out[ind] += power;
+                  // Another task may be writing the other columns
+                  if (pSpill &&
+                      (correctedX < ownBeginX || correctedX >= ownEndX))
+                     pSpill->emplace_back(ind, power);
+                  else
+                     out[ind] += power;
                }
             }
          }
@@ -343,7 +347,7 @@ void SpecCache::Grow(size_t len_, const SpectrogramSettings& settings,
 
 void SpecCache::Populate
    (const SpectrogramSettings &settings, SampleTrackCache &waveTrackCache,
-    int copyBegin, int copyEnd, size_t numPixels,
+    const Ranges &ranges,
     sampleCount numSamples,
     double offset, double rate, double pixelsPerSecond)
 {
@@ -368,49 +372,55 @@ void SpecCache::Populate
    if (!autocorrelation)
       ComputeSpectrogramGainFactors(fftLen, rate, frequencyGainSetting, gainFactors);
 
-   // Loop over the ranges before and after the copied portion and compute anew.
-   // One of the ranges may be empty.
-   for (int jj = 0; jj < 2; ++jj) {
-      const int lowerBoundX = jj == 0 ? 0 : copyEnd;
-      const int upperBoundX = jj == 0 ? copyBegin : numPixels;
-
-#ifdef _OPENMP
-      // Storage for mutable per-thread data.
-      // private clause ensures one copy per thread
-      struct ThreadLocalStorage {
-         ThreadLocalStorage()  { }
-         ~ThreadLocalStorage() { }
-
-         void init(SampleTrackCache &waveTrackCache, size_t scratchSize) {
-            if (!cache) {
-               cache = std::make_unique<SampleTrackCache>(waveTrackCache.GetTrack());
-               scratch.resize(scratchSize);
-            }
+   auto &pool = WorkerPool::Get();
+
+   // Loop over the ranges, such as those before and after a copied portion,
+   // and compute anew.  Some ranges may be empty.
+   for (const auto &[lowerBoundX, upperBoundX] : ranges) {
+      if (upperBoundX <= lowerBoundX)
+         continue;
+      const size_t width = upperBoundX - lowerBoundX;
+
+      // Divide the columns into contiguous runs, a few for each thread, but
+      // not so short that the overhead of the tasks would dominate
+      constexpr size_t MinColumnsPerTask = 8;
+      const auto nTasks = std::max<size_t>(1, std::min(
+         4 * pool.GetConcurrency(), width / MinColumnsPerTask));
+      const auto TaskBegin = [&](size_t iTask){
+         return lowerBoundX + static_cast<int>(width * iTask / nTasks);
+      };
+      std::vector<Spill> spills(reassignment ? nTasks : 0);
+
+      pool.ParallelFor(nTasks, [&](size_t iTask){
+         const auto beginX = TaskBegin(iTask), endX = TaskBegin(iTask + 1);
+         // Each task needs its own cache of samples, and its own scratch;
+         // the first may use those of the caller
+         std::unique_ptr<SampleTrackCache> pCache;
+         std::vector<float> taskScratch;
+         if (iTask > 0) {
+            pCache =
+               std::make_unique<SampleTrackCache>(waveTrackCache.GetTrack());
+            taskScratch.resize(scratchSize);
          }
-         std::unique_ptr<SampleTrackCache> cache;
-         std::vector<float> scratch;
-      } tls;
-
-      #pragma omp parallel for private(tls)
-#endif
-      for (auto xx = lowerBoundX; xx < upperBoundX; ++xx)
-      {
-#ifdef _OPENMP
-         tls.init(waveTrackCache, scratchSize);
-         SampleTrackCache& cache = *tls.cache;
-         float* buffer = &tls.scratch[0];
-#else
-         SampleTrackCache& cache = waveTrackCache;
-         float* buffer = &scratch[0];
-#endif
-         CalculateOneSpectrum(
-            settings, cache, xx, numSamples,
-            offset, rate, pixelsPerSecond,
-            lowerBoundX, upperBoundX,
-            gainFactors, buffer, &freq[0]);
-      }
+         SampleTrackCache &cache = pCache ? *pCache : waveTrackCache;
+         float *const buffer = pCache ? &taskScratch[0] : &scratch[0];
+         Spill *const pSpill = reassignment ? &spills[iTask] : nullptr;
+         for (auto xx = beginX; xx < endX; ++xx)
+            CalculateOneSpectrum(
+               settings, cache, xx, numSamples,
+               offset, rate, pixelsPerSecond,
+               lowerBoundX, upperBoundX,
+               gainFactors, buffer, &freq[0],
+               pSpill, beginX, endX);
+      });
 
       if (reassignment) {
+         // Accumulate the powers that crossed into the columns of other
+         // tasks, now that no task is writing
+         for (const auto &spill : spills)
+            for (const auto &[ind, power] : spill)
+               freq[ind] += power;
+
          // Need to look beyond the edges of the range to accumulate more
          // time reassignments.
          // I'm not sure what's a good stopping criterion?
@@ -444,24 +454,24 @@ void SpecCache::Populate
 
          // Now Convert to dB terms.  Do this only after accumulating
          // power values, which may cross columns with the time correction.
-#ifdef _OPENMP
-         #pragma omp parallel for
-#endif
-         for (xx = lowerBoundX; xx < upperBoundX; ++xx) {
-            float *const results = &freq[nBins * xx];
-            for (size_t ii = 0; ii < nBins; ++ii) {
-               float &power = results[ii];
-               if (power <= 0)
-                  power = -160.0;
-               else
-                  power = 10.0*log10f(power);
-            }
-            if (!gainFactors.empty()) {
-               // Apply a frequency-dependent gain factor
-               for (size_t ii = 0; ii < nBins; ++ii)
-                  results[ii] += gainFactors[ii];
+         pool.ParallelFor(nTasks, [&](size_t iTask){
+            const auto endX = TaskBegin(iTask + 1);
+            for (auto xx = TaskBegin(iTask); xx < endX; ++xx) {
+               float *const results = &freq[nBins * xx];
+               for (size_t ii = 0; ii < nBins; ++ii) {
+                  float &power = results[ii];
+                  if (power <= 0)
+                     power = -160.0;
+                  else
+                     power = 10.0*log10f(power);
+               }
+               if (!gainFactors.empty()) {
+                  // Apply a frequency-dependent gain factor
+                  for (size_t ii = 0; ii < nBins; ++ii)
+                     results[ii] += gainFactors[ii];
+               }
             }
-         }
+         });
       }
    }
 }
@@ -521,6 +531,9 @@ bool WaveClipSpectrumCache::GetSpectrogram(const WaveClip &clip,
 
    int oldX0 = 0;
    double correction = 0.0;
+   // Columns lie in a grid beginning at the start of the sequence, so that
+   // caches made at different times, or in different sessions, agree
+   long long origin = llrint(t0 / tstep);
 
    int copyBegin = 0, copyEnd = 0;
    if (match) {
@@ -534,12 +547,16 @@ bool WaveClipSpectrumCache::GetSpectrogram(const WaveClip &clip,
       copyEnd = std::min((int)numPixels, std::max(0,
          (int)mSpecCache->len - oldX0
       ));
+      if (copyEnd > copyBegin)
+         origin = mSpecCache->origin + oldX0;
    }
+   correction = origin * samplesPerPixel - t0 * rate;
 
    // Resize the cache, keep the contents unchanged.
    mSpecCache->Grow(numPixels, settings, pixelsPerSecond, t0);
    mSpecCache->leftTrim = clip.GetTrimLeft();
    mSpecCache->rightTrim = clip.GetTrimRight();
+   mSpecCache->origin = origin;
    auto nBins = settings.NBins();
 
    // Optimization: if the old cache is good and overlaps
@@ -576,11 +593,27 @@ bool WaveClipSpectrumCache::GetSpectrogram(const WaveClip &clip,
    fillWhere(mSpecCache->where, numPixels, 0.5, correction,
       t0, rate, samplesPerPixel);
 
+   SpecCache::Ranges ranges{
+      { 0, copyBegin }, { copyEnd, (int)numPixels } };
+
+   // Reassignment moves energy across columns, so that a column depends on
+   // the range computed with it; don't store those
+   AudacityProject *pProject = nullptr;
+   if (settings.algorithm != SpectrogramSettings::algReassignment &&
+       SpectrumTileStore::IsEnabled())
+      if (const auto pList = track->GetOwner())
+         pProject = pList->GetOwner();
+   if (pProject)
+      LoadTiles(*pProject, clip, settings, ranges);
+
    mSpecCache->Populate
-      (settings, waveTrackCache, copyBegin, copyEnd, numPixels,
+      (settings, waveTrackCache, ranges,
        clip.GetSequenceSamplesCount(),
        clip.GetSequenceStartTime(), rate, pixelsPerSecond);
 
+   if (pProject)
+      SaveTiles(*pProject, clip, settings);
+
    mSpecCache->dirty = mDirty;
    spectrogram = &mSpecCache->freq[0];
    where = &mSpecCache->where[0];
@@ -588,6 +621,146 @@ bool WaveClipSpectrumCache::GetSpectrogram(const WaveClip &clip,
    return true;
 }
 
+namespace {
+
+//! Number of columns in each stored tile
+constexpr long long TileColumns = 64;
+
+//! Change this to invalidate tiles stored by earlier versions
+constexpr int TileFormat = 1;
+
+//! Fowler-Noll-Vo hash, which unlike std::hash, is the same in all sessions
+class TileHash
+{
+public:
+   template<typename T> void Add(const T &value)
+   {
+      auto bytes = reinterpret_cast<const unsigned char *>(&value);
+      for (size_t ii = 0; ii < sizeof(T); ++ii)
+         mValue = (mValue ^ bytes[ii]) * 1099511628211ull;
+   }
+   uint64_t Value() const { return mValue; }
+
+private:
+   uint64_t mValue{ 14695981039346656037ull };
+};
+
+//! Identify all that a tile of the spectrogram depends on:  the settings,
+//! the zoom, and the sample blocks under its columns
+uint64_t TileKey(const WaveClip &clip, const SpectrogramSettings &settings,
+   double pixelsPerSecond, long long tile)
+{
+   const auto rate = clip.GetRate();
+   const double samplesPerPixel = rate / pixelsPerSecond;
+   const long long windowSize = settings.WindowSize();
+
+   TileHash hash;
+   hash.Add(TileFormat);
+   hash.Add(settings.algorithm);
+   hash.Add(settings.windowType);
+   hash.Add(windowSize);
+   hash.Add(settings.ZeroPaddingFactor());
+   hash.Add(settings.frequencyGain);
+   hash.Add(rate);
+   hash.Add(pixelsPerSecond);
+   hash.Add(tile);
+   // Samples are read from the track, which is silent in the trimmed parts,
+   // and rounds the start of the sequence
+   hash.Add(llrint(clip.GetTrimLeft() * rate));
+   hash.Add(llrint(clip.GetTrimRight() * rate));
+   const double first = clip.GetSequenceStartTime() * rate;
+   hash.Add(llrint((first - floor(first)) * 1024));
+
+   // The samples in the windows of the columns, as fillWhere and
+   // CalculateOneSpectrum find them, with a sample to spare for rounding
+   const long long numSamples =
+      clip.GetSequenceSamplesCount().as_long_long();
+   const auto column = tile * TileColumns;
+   const auto begin = std::max(0LL,
+      (long long)floor(1.0 + column * samplesPerPixel)
+         - windowSize / 2 - 1);
+   const auto end = std::min(numSamples,
+      (long long)floor(1.0 + (column + TileColumns) * samplesPerPixel)
+         + windowSize / 2 + 1);
+   hash.Add(begin);
+   hash.Add(end);
+
+   // Blocks are never modified, so their ids stand for their samples
+   const auto &blocks = clip.GetSequence()->GetBlockArray();
+   auto iter = std::upper_bound(blocks.begin(), blocks.end(), begin,
+      [](long long position, const SeqBlock &block){
+         return position < block.start.as_long_long(); });
+   if (iter != blocks.begin())
+      --iter;
+   for (; iter != blocks.end() && iter->start.as_long_long() < end; ++iter) {
+      hash.Add(iter->sb->GetBlockID());
+      hash.Add(iter->start.as_long_long() - begin);
+      hash.Add(iter->sb->GetSampleCount());
+   }
+   return hash.Value();
+}
+
+}
+
+void WaveClipSpectrumCache::LoadTiles(AudacityProject &project,
+   const WaveClip &clip, const SpectrogramSettings &settings,
+   SpecCache::Ranges &ranges)
+{
+   auto &cache = *mSpecCache;
+   const auto nBins = settings.NBins();
+   std::vector<float> buffer(TileColumns * nBins);
+   SpecCache::Ranges remaining;
+   for (auto [lower, upper] : ranges) {
+      while (lower < upper) {
+         // The tile containing column lower
+         const auto column = cache.origin + lower;
+         const auto tile = column >= 0 ? column / TileColumns : -1;
+         const auto tileEnd = std::min<long long>(upper,
+            (tile + 1) * TileColumns - cache.origin);
+         const auto key =
+            tile >= 0 ? TileKey(clip, settings, cache.pps, tile) : 0;
+         if (tile >= 0 && SpectrumTileStore::Load(project,
+               key, buffer.data(), buffer.size())) {
+            mStoredTiles.insert(key);
+            const auto skip = column - tile * TileColumns;
+            std::copy(buffer.begin() + skip * nBins,
+               buffer.begin() + (skip + tileEnd - lower) * nBins,
+               cache.freq.begin() + lower * nBins);
+         }
+         else if (!remaining.empty() && remaining.back().second == lower)
+            remaining.back().second = tileEnd;
+         else
+            remaining.emplace_back(lower, tileEnd);
+         lower = tileEnd;
+      }
+   }
+   ranges.swap(remaining);
+}
+
+void WaveClipSpectrumCache::SaveTiles(AudacityProject &project,
+   const WaveClip &clip, const SpectrogramSettings &settings)
+{
+   const auto &cache = *mSpecCache;
+   const auto nBins = settings.NBins();
+   const long long numSamples =
+      clip.GetSequenceSamplesCount().as_long_long();
+   const double samplesPerPixel = clip.GetRate() / cache.pps;
+   const auto first = std::max(0LL,
+      (cache.origin + TileColumns - 1) / TileColumns);
+   const auto last = (cache.origin + (long long)cache.len) / TileColumns;
+   for (auto tile = first; tile < last; ++tile) {
+      // Don't store tiles wholly past the end
+      if (tile * TileColumns * samplesPerPixel >= numSamples)
+         break;
+      const auto key = TileKey(clip, settings, cache.pps, tile);
+      if (!mStoredTiles.insert(key).second)
+         continue;
+      const auto column = tile * TileColumns - cache.origin;
+      SpectrumTileStore::Save(project, key,
+         &cache.freq[column * nBins], TileColumns * nBins);
+   }
+}
+
 WaveClipSpectrumCache::WaveClipSpectrumCache()
 : mSpecCache{ std::make_unique<SpecCache>() }
 , mSpecPxCache{ std::make_unique<SpecPxCache>(1) }
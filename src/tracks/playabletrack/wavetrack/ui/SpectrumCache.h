@@ -14,7 +14,11 @@
 class sampleCount;
 class SpectrogramSettings;
 class SampleTrackCache;
+class AudacityProject;
 
+#include <cstdint>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 #include "MemoryX.h"
 #include "WaveClip.h" // to inherit WaveClipListener
@@ -42,7 +46,13 @@ public:
    bool Matches(int dirty_, double pixelsPerSecond,
       const SpectrogramSettings &settings, double rate) const;
 
+   //! Reassigned powers, with their indices in freq, that one task of
+   //! Populate() defers because they fall outside of its own columns
+   using Spill = std::vector<std::pair<size_t, float>>;
+
    // Calculate one column of the spectrum
+   // If pSpill is not null, reassigned powers outside of columns
+   // [ownBeginX, ownEndX) are added to it instead of to out
    bool CalculateOneSpectrum
       (const SpectrogramSettings &settings,
        SampleTrackCache &waveTrackCache,
@@ -51,16 +61,20 @@ public:
        int lowerBoundX, int upperBoundX,
        const std::vector<float> &gainFactors,
        float* __restrict scratch,
-       float* __restrict out) const;
+       float* __restrict out,
+       Spill *pSpill = nullptr, int ownBeginX = 0, int ownEndX = 0) const;
 
    // Grow the cache while preserving the (possibly now invalid!) contents
    void Grow(size_t len_, const SpectrogramSettings& settings,
                double pixelsPerSecond, double start_);
 
-   // Calculate the dirty columns at the begin and end of the cache
+   //! Half-open intervals of columns
+   using Ranges = std::vector<std::pair<int, int>>;
+
+   // Calculate the dirty columns, in the given ranges
    void Populate
       (const SpectrogramSettings &settings, SampleTrackCache &waveTrackCache,
-       int copyBegin, int copyEnd, size_t numPixels,
+       const Ranges &ranges,
        sampleCount numSamples,
        double offset, double rate, double pixelsPerSecond);
 
@@ -70,6 +84,9 @@ public:
    double       leftTrim{ .0 };
    double       rightTrim{ .0 };
    double       start;
+   //! Index of the first column in the grid of columns at this zoom that
+   //! begins at the start of the sequence
+   long long    origin{ 0 };
    int          windowType;
    size_t       windowSize { 0 };
    unsigned     zeroPaddingFactor { 0 };
@@ -112,6 +129,8 @@ struct WaveClipSpectrumCache final : WaveClipListener
    std::unique_ptr<SpecPxCache> mSpecPxCache;
    std::unique_ptr<SpecCache> mSpecCache;
    int mDirty { 0 };
+   //! Keys of tiles known to be in SpectrumTileStore
+   std::unordered_set<uint64_t> mStoredTiles;
 
    static WaveClipSpectrumCache &Get( const WaveClip &clip );
 
@@ -124,6 +143,15 @@ struct WaveClipSpectrumCache final : WaveClipListener
                        const sampleCount *& where,
                        size_t numPixels,
                        double t0, double pixelsPerSecond);
+
+private:
+   //! Copy columns from stored tiles into the cache, and remove them from
+   //! ranges
+   void LoadTiles(AudacityProject &project, const WaveClip &clip,
+      const SpectrogramSettings &settings, SpecCache::Ranges &ranges);
+   //! Store the tiles that the cache covers completely, if not done before
+   void SaveTiles(AudacityProject &project, const WaveClip &clip,
+      const SpectrogramSettings &settings);
 };
 
 #endif
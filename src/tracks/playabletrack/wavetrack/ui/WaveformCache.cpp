@@ -10,10 +10,19 @@
 
 #include "WaveformCache.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include "BasicUI.h"
 #include "Sequence.h"
 #include "GetWaveDisplay.h"
+#include "VectorOps.h"
 #include "WaveClipUtilities.h"
+#include "../../../../DBConnection.h"
 
 class WaveCache {
 public:
@@ -53,6 +62,10 @@ public:
    const double start;
    const double pps;
    const int    rate;
+   //! Index of the first column, counting from the first column of the
+   //! first cache of the generation
+   long long    first { 0 };
+   unsigned     generation { 0 };
    std::vector<sampleCount> where;
    std::vector<float> min;
    std::vector<float> max;
@@ -60,6 +73,117 @@ public:
    std::vector<int> bl;
 };
 
+//! Columns of a WaveCache to compute in the background
+struct WaveDisplayJob {
+   //! Copies of the blocks to read, which the sequence may discard meanwhile
+   BlockArray blocks;
+   sampleCount numSamples;
+   size_t maxBlockSize;
+   long long first;
+   unsigned generation;
+   int dirty;
+   std::vector<sampleCount> where;
+   std::vector<float> min;
+   std::vector<float> max;
+   std::vector<float> rms;
+   std::vector<int> bl;
+   std::function<void()> onReady;
+
+   std::atomic<bool> cancelled{ false };
+   std::atomic<bool> done{ false };
+   bool succeeded{ false };
+};
+
+namespace {
+
+//! Don't compute in the background if fewer blocks would be read
+constexpr size_t MinJobBlocks = 8;
+
+//! One thread that computes waveform columns, most recent requests first, so
+//! that the display catches up with scrolling and zooming
+class WaveDisplayWorker final
+{
+public:
+   static WaveDisplayWorker &Get()
+   {
+      static WaveDisplayWorker instance;
+      return instance;
+   }
+
+   ~WaveDisplayWorker()
+   {
+      {
+         std::lock_guard<std::mutex> lock{ mMutex };
+         mStop = true;
+      }
+      mCondition.notify_one();
+      if (mThread.joinable())
+         mThread.join();
+   }
+
+   void Post(std::shared_ptr<WaveDisplayJob> pJob)
+   {
+      {
+         std::lock_guard<std::mutex> lock{ mMutex };
+         if (!mThread.joinable())
+            mThread = std::thread{ [this]{ Run(); } };
+         mJobs.push_back(std::move(pJob));
+      }
+      mCondition.notify_one();
+   }
+
+private:
+   WaveDisplayWorker() = default;
+
+   void Run()
+   {
+      while (true) {
+         std::shared_ptr<WaveDisplayJob> pJob;
+         {
+            std::unique_lock<std::mutex> lock{ mMutex };
+            mCondition.wait(lock, [this]{ return mStop || !mJobs.empty(); });
+            if (mStop)
+               return;
+            pJob = std::move(mJobs.back());
+            mJobs.pop_back();
+         }
+
+         auto &job = *pJob;
+         if (!job.cancelled) {
+            try {
+               // The project can't close its connection during the read
+               std::shared_lock<std::shared_mutex> readers{
+                  DBConnection::ReadersMutex() };
+               job.succeeded = ::GetWaveDisplay(job.blocks,
+                  job.numSamples, job.maxBlockSize,
+                  job.min.data(), job.max.data(), job.rms.data(),
+                  job.bl.data(), job.min.size(), job.where.data());
+            }
+            catch (...) {
+               // Perhaps the project closed.  Don't draw anything better.
+               job.succeeded = false;
+            }
+            job.done = true;
+         }
+
+         // Release the job in the main thread, because releasing the last
+         // reference to a block may delete it from the database
+         BasicUI::CallAfter([pJob = std::move(pJob)]{
+            if (!pJob->cancelled && pJob->onReady)
+               pJob->onReady();
+         });
+      }
+   }
+
+   std::thread mThread;
+   std::mutex mMutex;
+   std::condition_variable mCondition;
+   std::vector<std::shared_ptr<WaveDisplayJob>> mJobs;
+   bool mStop{ false };
+};
+
+}
+
 //
 // Getting high-level data from the track for screen display and
 // clipping calculations
@@ -67,7 +191,7 @@ public:
 
 bool WaveClipWaveformCache::GetWaveDisplay(
    const WaveClip &clip, WaveDisplay &display, double t0,
-   double pixelsPerSecond )
+   double pixelsPerSecond, std::function<void()> onReady )
 {
    t0 += clip.GetTrimLeft();
 
@@ -93,6 +217,8 @@ bool WaveClipWaveformCache::GetWaveDisplay(
       pWhere = &display.ownWhere;
    }
    else {
+      MergeJobs();
+
       const double tstep = 1.0 / pixelsPerSecond;
       const auto rate = clip.GetRate();
       const double samplesPerPixel = rate * tstep;
@@ -143,6 +269,15 @@ bool WaveClipWaveformCache::GetWaveDisplay(
          oldCache.reset(0);
 
       mWaveCache = std::make_unique<WaveCache>(numPixels, pixelsPerSecond, rate, t0, mDirty);
+      if (oldCache) {
+         // Columns of the old cache, and of its jobs, keep their numbers
+         mWaveCache->generation = oldCache->generation;
+         mWaveCache->first = oldCache->first + oldX0;
+      }
+      else {
+         CancelJobs();
+         mWaveCache->generation = ++mGeneration;
+      }
       min = &mWaveCache->min[0];
       max = &mWaveCache->max[0];
       rms = &mWaveCache->rms[0];
@@ -223,22 +358,10 @@ bool WaveClipWaveformCache::GetWaveDisplay(
                      seqFormat, b.get(), len);
                }
 
-               float theMax, theMin, sumsq;
-               {
-                  const float val = pb[0];
-                  theMax = theMin = val;
-                  sumsq = val * val;
-               }
-               for(decltype(len) j = 1; j < len; j++) {
-                  const float val = pb[j];
-                  theMax = std::max(theMax, val);
-                  theMin = std::min(theMin, val);
-                  sumsq += val * val;
-               }
-
-               min[i] = theMin;
-               max[i] = theMax;
-               rms[i] = (float)sqrt(sumsq / len);
+               const auto values = SummarizeSamples(pb, len);
+               min[i] = values.min;
+               max[i] = values.max;
+               rms[i] = (float)sqrt(values.sumsq / len);
                bl[i] = 1; //for now just fake it.
 
                didUpdate=true;
@@ -253,7 +376,9 @@ bool WaveClipWaveformCache::GetWaveDisplay(
       // Done with append buffer, now fetch the rest of the cache miss
       // from the sequence
       if (p1 > p0) {
-         if (!::GetWaveDisplay(*sequence, &min[p0],
+         const bool started =
+            !allocated && onReady && StartJob(*sequence, p0, p1, onReady);
+         if (!started && !::GetWaveDisplay(*sequence, &min[p0],
                                         &max[p0],
                                         &rms[p0],
                                         &bl[p0],
@@ -277,6 +402,88 @@ bool WaveClipWaveformCache::GetWaveDisplay(
    return true;
 }
 
+bool WaveClipWaveformCache::StartJob(const Sequence &sequence,
+   size_t p0, size_t p1, const std::function<void()> &onReady)
+{
+   auto &cache = *mWaveCache;
+   const auto numSamples = sequence.GetNumSamples();
+   const auto s0 = std::max(sampleCount(0), cache.where[p0]);
+   // As in GetWaveDisplay, the last column gets at least one sample
+   const auto s1 = std::min(numSamples, std::max(s0 + 1, cache.where[p1]));
+   if (s0 >= numSamples)
+      // Let the synchronous computation fail
+      return false;
+
+   // Find the blocks to read
+   const auto &blocks = sequence.GetBlockArray();
+   const auto b0 = sequence.FindBlock(s0);
+   auto b1 = b0;
+   while (b1 < (int)blocks.size() && blocks[b1].start < s1)
+      ++b1;
+   if (b1 - b0 < (int)MinJobBlocks)
+      return false;
+
+   auto pJob = std::make_shared<WaveDisplayJob>();
+   auto &job = *pJob;
+   job.blocks.assign(blocks.begin() + b0, blocks.begin() + b1);
+   job.numSamples = numSamples;
+   job.maxBlockSize = sequence.GetMaxBlockSize();
+   job.first = cache.first + p0;
+   job.generation = cache.generation;
+   job.dirty = cache.dirty;
+   job.where.assign(cache.where.begin() + p0, cache.where.begin() + p1 + 1);
+   const auto len = p1 - p0;
+   job.min.resize(len);
+   job.max.resize(len);
+   job.rms.resize(len);
+   job.bl.resize(len);
+   job.onReady = onReady;
+
+   // Something to draw now
+   GetCoarseWaveDisplay(job.blocks, numSamples,
+      &cache.min[p0], &cache.max[p0], &cache.rms[p0], &cache.bl[p0],
+      len, &cache.where[p0]);
+
+   mJobs.push_back(pJob);
+   WaveDisplayWorker::Get().Post(std::move(pJob));
+   return true;
+}
+
+void WaveClipWaveformCache::MergeJobs()
+{
+   auto &cache = *mWaveCache;
+   const auto end = std::remove_if(mJobs.begin(), mJobs.end(),
+      [&](const std::shared_ptr<WaveDisplayJob> &pJob){
+         auto &job = *pJob;
+         if (!job.done)
+            return false;
+         if (job.succeeded &&
+             job.generation == cache.generation && job.dirty == cache.dirty) {
+            // Copy those of the columns that the cache still has
+            const long long len = job.min.size();
+            const auto begin = std::max(0LL, cache.first - job.first);
+            const auto end = std::min(len,
+               cache.first + (long long)cache.len - job.first);
+            for (auto ii = begin; ii < end; ++ii) {
+               const auto xx = job.first + ii - cache.first;
+               cache.min[xx] = job.min[ii];
+               cache.max[xx] = job.max[ii];
+               cache.rms[xx] = job.rms[ii];
+               cache.bl[xx] = job.bl[ii];
+            }
+         }
+         return true;
+      });
+   mJobs.erase(end, mJobs.end());
+}
+
+void WaveClipWaveformCache::CancelJobs()
+{
+   for (auto &pJob : mJobs)
+      pJob->cancelled = true;
+   mJobs.clear();
+}
+
 WaveClipWaveformCache::WaveClipWaveformCache()
 : mWaveCache{ std::make_unique<WaveCache>() }
 {
@@ -284,6 +491,7 @@ WaveClipWaveformCache::WaveClipWaveformCache()
 
 WaveClipWaveformCache::~WaveClipWaveformCache()
 {
+   CancelJobs();
 }
 
 static WaveClip::Caches::RegisteredFactory sKeyW{ []( WaveClip& ){
@@ -299,10 +507,12 @@ WaveClipWaveformCache &WaveClipWaveformCache::Get( const WaveClip &clip )
 void WaveClipWaveformCache::MarkChanged()
 {
    ++mDirty;
+   CancelJobs();
 }
 
 void WaveClipWaveformCache::Invalidate()
 {
    // Invalidate wave display cache
    mWaveCache = std::make_unique<WaveCache>();
+   CancelJobs();
 }
@@ -11,9 +11,13 @@
 #ifndef __AUDACITY_WAVEFORM_CACHE__
 #define __AUDACITY_WAVEFORM_CACHE__
 
+#include <functional>
+#include <memory>
+#include <vector>
 #include "WaveClip.h"
 
 class WaveCache;
+struct WaveDisplayJob;
 
 struct WaveClipWaveformCache final : WaveClipListener
 {
@@ -23,6 +27,11 @@ struct WaveClipWaveformCache final : WaveClipListener
    // Cache of values for drawing the waveform
    std::unique_ptr<WaveCache> mWaveCache;
    int mDirty { 0 };
+   //! Distinguishes caches that are not copies of one another
+   unsigned mGeneration { 0 };
+   //! Columns being computed in the background, or computed but not yet
+   //! copied into mWaveCache
+   std::vector<std::shared_ptr<WaveDisplayJob>> mJobs;
 
    static WaveClipWaveformCache &Get( const WaveClip &clip );
 
@@ -33,8 +42,22 @@ struct WaveClipWaveformCache final : WaveClipListener
    void Clear();
 
    /** Getting high-level data for screen display */
+   /*! If onReady is not null, and the columns not cached would need many
+    blocks, then fill those columns at once from whole block summaries, and
+    compute them exactly in another thread.  onReady is then called in the
+    main thread, and another call gets the exact columns. */
    bool GetWaveDisplay(const WaveClip &clip, WaveDisplay &display,
-                       double t0, double pixelsPerSecond);
+                       double t0, double pixelsPerSecond,
+                       std::function<void()> onReady = {});
+
+private:
+   //! Start computing columns [p0, p1) of mWaveCache in the background
+   //! and fill them with coarse values, or return false if not worth it
+   bool StartJob(const Sequence &sequence, size_t p0, size_t p1,
+      const std::function<void()> &onReady);
+   //! Copy the results of finished jobs that are still relevant
+   void MergeJobs();
+   void CancelJobs();
 };
 
 #endif
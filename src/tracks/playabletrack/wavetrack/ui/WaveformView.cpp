@@ -27,6 +27,7 @@ Paul Licameli split from WaveTrackView.cpp
 #include "../../../../SyncLock.h"
 #include "../../../../TrackArt.h"
 #include "../../../../TrackArtist.h"
+#include "../../../../TrackPanel.h"
 #include "../../../../TrackPanelDrawingContext.h"
 #include "../../../../TrackPanelMouseEvent.h"
 #include "ViewInfo.h"
@@ -799,8 +800,11 @@ void DrawClipWaveform(TrackPanelDrawingContext &context,
          // fisheye moves over the background, there is then less to do when
          // redrawing.
 
+         // Columns that take long to compute are drawn coarsely at first,
+         // then again when ready
+         wxWeakRef<TrackPanel> pPanel{ artist->parent };
          if (!clipCache.GetWaveDisplay( *clip, display,
-            t0, pps))
+            t0, pps, [pPanel]{ if (pPanel) pPanel->Refresh(false); }))
             return;
       }
    }